@@ -0,0 +1,62 @@
+// Copyright (c) 2014-2017 The Dune Spice developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "chainparams.h"
+#include "miner.h"
+#include "random.h"
+#include "txmempool.h"
+
+#include <memory>
+
+// Fill pool with nTransactions, a quarter of them spending an output of the
+// transaction before it so there are ancestor packages to select
+static void FillMempool(CTxMemPool& pool, int nTransactions)
+{
+    seed_insecure_rand(true);
+    LOCK(pool.cs);
+    uint256 hashPrev;
+    for (int i = 0; i < nTransactions; i++) {
+        CMutableTransaction tx;
+        if (i > 0 && insecure_rand() % 4 == 0)
+            tx.vin.push_back(CTxIn(COutPoint(hashPrev, 0)));
+        else
+            tx.vin.push_back(CTxIn(COutPoint(GetRandHash(), 0)));
+        tx.vin[0].scriptSig = CScript() << std::vector<unsigned char>(100, 1);
+        tx.vout.push_back(CTxOut(COIN, CScript() << OP_TRUE));
+        tx.vout.push_back(CTxOut(COIN, CScript() << OP_TRUE));
+        CTransactionRef txref = MakeTransactionRef(tx);
+        CAmount nFee = 1000 + insecure_rand() % 100000;
+        CTxMemPoolEntry entry(txref, nFee, 0, 0, 1, true, 2 * COIN, false, 1, LockPoints());
+        pool.addUnchecked(txref->GetHash(), entry);
+        hashPrev = txref->GetHash();
+    }
+}
+
+// Selecting the transactions of a block template, which is the part of
+// getblocktemplate that grows with the size of the mempool
+static void BlockAssemblerSelect(benchmark::State& state, int nTransactions)
+{
+    SelectParams(CBaseChainParams::MAIN);
+    CTxMemPool pool(CFeeRate(1000));
+    FillMempool(pool, nTransactions);
+
+    while (state.KeepRunning()) {
+        std::unique_ptr<CBlockTemplate> pblocktemplate(BlockAssembler(Params(), pool).SelectTransactions(100, 0));
+        assert(pblocktemplate->block.vtx.size() > 1);
+    }
+}
+
+static void BlockAssemblerSelect10k(benchmark::State& state)
+{
+    BlockAssemblerSelect(state, 10000);
+}
+
+static void BlockAssemblerSelect50k(benchmark::State& state)
+{
+    BlockAssemblerSelect(state, 50000);
+}
+
+BENCHMARK(BlockAssemblerSelect10k);
+BENCHMARK(BlockAssemblerSelect50k);
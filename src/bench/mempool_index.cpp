@@ -0,0 +1,59 @@
+// Copyright (c) 2014-2017 The Dune Spice developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "coins.h"
+#include "random.h"
+#include "txmempool.h"
+
+#include <list>
+#include <vector>
+
+static CScript GetScriptForKeyID(const uint160& hash)
+{
+    return CScript() << OP_DUP << OP_HASH160 << ToByteVector(hash) << OP_EQUALVERIFY << OP_CHECKSIG;
+}
+
+// Adding transactions to (and removing them from) a mempool that also
+// maintains the address and spent indexes, like -addressindex and -spentindex do
+static void MempoolAddRemoveWithIndexes(benchmark::State& state)
+{
+    const int nTransactions = 1000;
+    const int nAddresses = 100;
+
+    seed_insecure_rand(true);
+    std::vector<uint160> vAddresses;
+    for (int i = 0; i < nAddresses; i++)
+        vAddresses.push_back(uint160(std::vector<unsigned char>(20, i)));
+
+    CCoinsView viewDummy;
+    CCoinsViewCache view(&viewDummy);
+    std::vector<CTransactionRef> vTransactions;
+    for (int i = 0; i < nTransactions; i++) {
+        CMutableTransaction tx;
+        for (int j = 0; j < 2; j++) {
+            COutPoint prevout(GetRandHash(), j);
+            view.AddCoin(prevout, Coin(CTxOut(10 * COIN, GetScriptForKeyID(vAddresses[insecure_rand() % nAddresses])), 1, false), false);
+            tx.vin.push_back(CTxIn(prevout));
+            tx.vout.push_back(CTxOut(9 * COIN, GetScriptForKeyID(vAddresses[insecure_rand() % nAddresses])));
+        }
+        vTransactions.push_back(MakeTransactionRef(tx));
+    }
+
+    CTxMemPool pool(CFeeRate(1000));
+    LOCK(pool.cs);
+    while (state.KeepRunning()) {
+        for (size_t i = 0; i < vTransactions.size(); i++) {
+            CTxMemPoolEntry entry(vTransactions[i], 2 * COIN, 0, 0, 1, true, 20 * COIN, false, 4, LockPoints());
+            pool.addUnchecked(vTransactions[i]->GetHash(), entry, false);
+            pool.addAddressIndex(entry, view);
+            pool.addSpentIndex(entry, view);
+        }
+        std::list<CTransaction> removed;
+        for (size_t i = 0; i < vTransactions.size(); i++)
+            pool.remove(*vTransactions[i], removed, false);
+    }
+}
+
+BENCHMARK(MempoolAddRemoveWithIndexes);
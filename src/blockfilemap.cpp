@@ -0,0 +1,130 @@
+// Copyright (c) 2014-2017 The Dune Spice developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfilemap.h"
+#include "crypto/common.h"
+#include "util.h"
+#include "validation.h"
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+CBlockFileMapCache blockfilemaps;
+
+CMappedFile::~CMappedFile()
+{
+#ifndef WIN32
+    munmap((void*)pdata, nSize);
+#endif
+}
+
+CMappedFileRef CBlockFileMapCache::MapFile(const CDiskBlockPos& pos, const char* prefix)
+{
+#ifdef WIN32
+    return CMappedFileRef();
+#else
+    boost::filesystem::path path = GetBlockPosFilename(pos, prefix);
+    int fd = open(path.string().c_str(), O_RDONLY);
+    if(fd == -1) return CMappedFileRef();
+
+    CMappedFileRef mapped;
+    struct stat st;
+    if(fstat(fd, &st) == 0 && st.st_size > 0) {
+        void* pdata = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if(pdata != MAP_FAILED) {
+            mapped = std::make_shared<const CMappedFile>((const char*)pdata, st.st_size);
+        } else {
+            LogPrintf("CBlockFileMapCache::MapFile -- Unable to map %s\n", path.string());
+        }
+    }
+    // the mapping stays valid after closing the descriptor
+    close(fd);
+    return mapped;
+#endif
+}
+
+void CBlockFileMapCache::Prune()
+{
+    // readers still holding a reference keep their mapping until they're done
+    while(listItems.size() > nMaxFiles) {
+        mapIndex.erase(listItems.back().first);
+        listItems.pop_back();
+    }
+}
+
+void CBlockFileMapCache::SetMaxFiles(size_t nMaxFilesIn)
+{
+    LOCK(cs);
+    nMaxFiles = nMaxFilesIn;
+    Prune();
+}
+
+bool CBlockFileMapCache::HasRecord(const CMappedFile& mapped, const CDiskBlockPos& pos, unsigned int nTrailer)
+{
+    if(pos.nPos < 4 || pos.nPos > mapped.size()) return false;
+    uint64_t nEnd = (uint64_t)pos.nPos + ReadLE32((const unsigned char*)mapped.begin() + pos.nPos - 4) + nTrailer;
+    return nEnd <= mapped.size();
+}
+
+CMappedFileRef CBlockFileMapCache::Get(const CDiskBlockPos& pos, const char* prefix, unsigned int nTrailer)
+{
+    key_t key(prefix, pos.nFile);
+
+    LOCK(cs);
+    if(nMaxFiles == 0) return CMappedFileRef();
+
+    std::map<key_t, list_t::iterator>::iterator it = mapIndex.find(key);
+    if(it != mapIndex.end()) {
+        if(HasRecord(*it->second->second, pos, nTrailer)) {
+            listItems.splice(listItems.begin(), listItems, it->second);
+            return it->second->second;
+        }
+        // the file grew since we mapped it
+        listItems.erase(it->second);
+        mapIndex.erase(it);
+    }
+
+    CMappedFileRef mapped = MapFile(pos, prefix);
+    if(!mapped) return CMappedFileRef();
+    if(!HasRecord(*mapped, pos, nTrailer)) {
+        // still being written, or a bad size: the caller reads the file instead
+        return CMappedFileRef();
+    }
+
+    listItems.push_front(std::make_pair(key, mapped));
+    mapIndex[key] = listItems.begin();
+    Prune();
+
+    return mapped;
+}
+
+void CBlockFileMapCache::Erase(int nFile)
+{
+    LOCK(cs);
+    for(list_t::iterator it = listItems.begin(); it != listItems.end(); ) {
+        if(it->first.second == nFile) {
+            mapIndex.erase(it->first);
+            it = listItems.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void CBlockFileMapCache::Clear()
+{
+    LOCK(cs);
+    listItems.clear();
+    mapIndex.clear();
+}
+
+size_t CBlockFileMapCache::GetCount()
+{
+    LOCK(cs);
+    return listItems.size();
+}
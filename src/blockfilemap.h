@@ -0,0 +1,86 @@
+// Copyright (c) 2014-2017 The Dune Spice developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BLOCKFILEMAP_H
+#define BLOCKFILEMAP_H
+
+#include "chain.h"
+#include "sync.h"
+
+#include <list>
+#include <map>
+#include <memory>
+#include <string>
+
+class CBlockFileMapCache;
+
+/** Default for -blockmmap, mappings only cost address space but 32-bit systems don't have much of it */
+static const int DEFAULT_BLOCKFILEMAPS = sizeof(void*) >= 8 ? 64 : 0;
+
+extern CBlockFileMapCache blockfilemaps;
+
+/** Read-only memory mapping of a whole file, unmapped when the last reference goes away */
+class CMappedFile
+{
+private:
+    CMappedFile(const CMappedFile&);
+    CMappedFile& operator=(const CMappedFile&);
+
+    const char* pdata;
+    size_t nSize;
+
+public:
+    CMappedFile(const char* pdataIn, size_t nSizeIn) : pdata(pdataIn), nSize(nSizeIn) {}
+    ~CMappedFile();
+
+    const char* begin() const { return pdata; }
+    const char* end() const { return pdata + nSize; }
+    size_t size() const { return nSize; }
+};
+
+typedef std::shared_ptr<const CMappedFile> CMappedFileRef;
+
+/**
+ * Least recently used set of memory mapped blk?????.dat and rev?????.dat files.
+ *
+ * Only files which are never truncated again may be mapped, see MapBlockFile
+ * in validation.cpp. Files may still grow (undo data is appended to rev files
+ * of earlier block files), so a record that doesn't fit in a cached mapping
+ * remaps the file.
+ */
+class CBlockFileMapCache
+{
+private:
+    typedef std::pair<std::string, int> key_t;
+    typedef std::list<std::pair<key_t, CMappedFileRef> > list_t;
+
+    CCriticalSection cs;
+    list_t listItems;
+    std::map<key_t, list_t::iterator> mapIndex;
+    size_t nMaxFiles;
+
+    static CMappedFileRef MapFile(const CDiskBlockPos& pos, const char* prefix);
+    static bool HasRecord(const CMappedFile& mapped, const CDiskBlockPos& pos, unsigned int nTrailer);
+    void Prune();
+
+public:
+    CBlockFileMapCache(size_t nMaxFilesIn = 0) : nMaxFiles(nMaxFilesIn) {}
+
+    /// Set how many files may be mapped at the same time, 0 disables mapping
+    void SetMaxFiles(size_t nMaxFilesIn);
+
+    /**
+     * Mapping of the file containing the record at pos, NULL if it can't be
+     * mapped or the record isn't complete in it. Records are preceded by their
+     * 32-bit size, as in blk and rev files, and followed by nTrailer bytes.
+     */
+    CMappedFileRef Get(const CDiskBlockPos& pos, const char* prefix, unsigned int nTrailer = 0);
+    /// Drop the mappings of a block file and its undo file, e.g. when pruned
+    void Erase(int nFile);
+
+    void Clear();
+    size_t GetCount();
+};
+
+#endif
@@ -0,0 +1,217 @@
+// Copyright (c) 2014-2017 The Dune Spice developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfileparser.h"
+#include "clientversion.h"
+#include "consensus/merkle.h"
+#include "util.h"
+
+#include <boost/bind.hpp>
+
+CBlockFileParser::CBlockFileParser(FILE* fileIn, const CMessageHeader::MessageStartChars& pchMessageStartIn, unsigned int nMaxBlockSizeIn, int nThreads) :
+    nMaxBlockSize(nMaxBlockSizeIn),
+    blkdat(fileIn, 2*nMaxBlockSizeIn, nMaxBlockSizeIn+8, SER_DISK, CLIENT_VERSION),
+    nPendingBytes(0),
+    fReaderDone(false),
+    fRescan(false),
+    nRescanPos(0),
+    fStop(false)
+{
+    memcpy(pchMessageStart, pchMessageStartIn, sizeof(pchMessageStart));
+
+    threadGroup.create_thread(boost::bind(&CBlockFileParser::ReaderThread, this));
+    for(int i = 0; i < std::max(nThreads, 1); i++) {
+        threadGroup.create_thread(boost::bind(&CBlockFileParser::WorkerThread, this));
+    }
+}
+
+CBlockFileParser::~CBlockFileParser()
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        fStop = true;
+    }
+    condWork.notify_all();
+    condSpace.notify_all();
+    threadGroup.join_all();
+}
+
+void CBlockFileParser::ReaderThread()
+{
+    RenameThread("spice-loadblk-read");
+
+    uint64_t nRewind = blkdat.GetPos();
+    while (true) {
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            if (fRescan) {
+                // the reader is ahead of the block, usually further than blkdat can rewind
+                fRescan = false;
+                nRewind = nRescanPos;
+                if (!blkdat.Seek(nRewind)) {
+                    LogPrintf("CBlockFileParser::ReaderThread -- failed to seek to %u\n", nRewind);
+                    fReaderDone = true;
+                    break;
+                }
+            }
+        }
+
+        ReadFrames(nRewind);
+
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            if (fStop || !fRescan) {
+                fReaderDone = true;
+                break;
+            }
+        }
+    }
+    condWork.notify_all();
+    condDone.notify_all();
+}
+
+void CBlockFileParser::ReadFrames(uint64_t nRewind)
+{
+    try {
+        while (!blkdat.eof()) {
+            blkdat.SetPos(nRewind);
+            nRewind++; // start one byte further next time, in case of failure
+            blkdat.SetLimit(); // remove former limit
+            unsigned int nSize = 0;
+            uint64_t nRescan = 0;
+            try {
+                // locate a header
+                unsigned char buf[MESSAGE_START_SIZE];
+                blkdat.FindByte(pchMessageStart[0]);
+                nRewind = blkdat.GetPos()+1;
+                nRescan = nRewind;
+                blkdat >> FLATDATA(buf);
+                if (memcmp(buf, pchMessageStart, MESSAGE_START_SIZE))
+                    continue;
+                // read size
+                blkdat >> nSize;
+                if (nSize < 80 || nSize > nMaxBlockSize)
+                    continue;
+            } catch (const std::exception&) {
+                // no valid block header found; don't complain
+                break;
+            }
+
+            std::shared_ptr<block_t> pblock;
+            std::vector<char> vch(nSize);
+            try {
+                // read the framed block data, it's parsed by the workers
+                uint64_t nBlockPos = blkdat.GetPos();
+                blkdat.SetLimit(nBlockPos + nSize);
+                blkdat.read(&vch[0], nSize);
+                nRewind = blkdat.GetPos();
+                pblock = std::make_shared<block_t>(nBlockPos, nSize, nRescan);
+            } catch (const std::exception& e) {
+                LogPrintf("CBlockFileParser::ReaderThread -- Deserialize or I/O error - %s\n", e.what());
+                continue;
+            }
+
+            {
+                boost::unique_lock<boost::mutex> lock(mutex);
+                // always allow one block, or a huge one would never make it through
+                while (!fStop && !fRescan && nPendingBytes > 0 && nPendingBytes + nSize > MAX_PENDING_BYTES) {
+                    condSpace.wait(lock);
+                }
+                // a rescan drops everything framed after the block that failed
+                if (fStop || fRescan) break;
+                dequeBlocks.push_back(pblock);
+                dequeUnparsed.push_back(std::make_pair(pblock, std::vector<char>()));
+                dequeUnparsed.back().second.swap(vch);
+                nPendingBytes += nSize;
+            }
+            condWork.notify_one();
+        }
+    } catch (const std::exception& e) {
+        LogPrintf("CBlockFileParser::ReaderThread -- %s\n", e.what());
+    }
+}
+
+void CBlockFileParser::Parse(block_t& block, const std::vector<char>& vch)
+{
+    try {
+        CDataStream ss(vch, SER_DISK, CLIENT_VERSION);
+        std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+        ss >> *pblock;
+
+        // the header hash is cached in the block, and so is a good merkle root
+        pblock->GetHash();
+        bool mutated;
+        if (BlockMerkleRoot(*pblock, &mutated) == pblock->hashMerkleRoot && !mutated)
+            pblock->fMerkleRootChecked = true;
+
+        block.pblock = pblock;
+    } catch (const std::exception& e) {
+        block.strError = e.what();
+    }
+}
+
+void CBlockFileParser::WorkerThread()
+{
+    RenameThread("spice-loadblk-parse");
+
+    while (true) {
+        std::pair<std::shared_ptr<block_t>, std::vector<char> > job;
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            // keep waiting until the last block was handed out, it may need a rescan
+            while (!fStop && dequeUnparsed.empty() && !(fReaderDone && dequeBlocks.empty())) {
+                condWork.wait(lock);
+            }
+            if (fStop || dequeUnparsed.empty()) return;
+            job.first = dequeUnparsed.front().first;
+            job.second.swap(dequeUnparsed.front().second);
+            dequeUnparsed.pop_front();
+        }
+
+        Parse(*job.first, job.second);
+
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            job.first->fDone = true;
+        }
+        condDone.notify_all();
+    }
+}
+
+bool CBlockFileParser::Next(std::shared_ptr<block_t>& blockRet)
+{
+    bool fLast = false;
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        while (!(!dequeBlocks.empty() && dequeBlocks.front()->fDone) && !(dequeBlocks.empty() && fReaderDone)) {
+            condDone.wait(lock);
+        }
+        if (dequeBlocks.empty()) return false;
+
+        blockRet = dequeBlocks.front();
+        dequeBlocks.pop_front();
+        nPendingBytes -= blockRet->nSize;
+
+        if (!blockRet->pblock) {
+            // Like a sequential scan, look for the next header right after the
+            // message start of the frame that couldn't be deserialized. The
+            // blocks framed after it may have been framed wrong, drop them.
+            dequeBlocks.clear();
+            dequeUnparsed.clear();
+            nPendingBytes = 0;
+            fRescan = true;
+            nRescanPos = blockRet->nRescanPos;
+            if (fReaderDone) {
+                fReaderDone = false;
+                threadGroup.create_thread(boost::bind(&CBlockFileParser::ReaderThread, this));
+            }
+        }
+        fLast = fReaderDone && dequeBlocks.empty();
+    }
+    condSpace.notify_all();
+    if (fLast)
+        condWork.notify_all();
+
+    return true;
+}
@@ -0,0 +1,86 @@
+// Copyright (c) 2014-2017 The Dune Spice developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BLOCKFILEPARSER_H
+#define BLOCKFILEPARSER_H
+
+#include "primitives/block.h"
+#include "protocol.h"
+#include "streams.h"
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+/**
+ * Parses the blocks of a blk?????.dat style file ahead of LoadExternalBlockFile.
+ *
+ * A reader thread scans the file for message start / size frames, worker
+ * threads deserialize the framed blocks and compute their hashes and merkle
+ * roots, and Next() hands the blocks out in file order. Parsing runs at most
+ * MAX_PENDING_BYTES ahead of the caller. If a framed block can't be
+ * deserialized, the file is scanned again from right after its message start.
+ */
+class CBlockFileParser
+{
+public:
+    struct block_t {
+        uint64_t nPos; // position of the block data in the file, after the frame
+        unsigned int nSize;
+        uint64_t nRescanPos; // where to look for the next frame if the data can't be deserialized
+        std::shared_ptr<CBlock> pblock; // NULL if the framed data couldn't be deserialized
+        std::string strError;
+        bool fDone;
+
+        block_t(uint64_t nPosIn, unsigned int nSizeIn, uint64_t nRescanPosIn) : nPos(nPosIn), nSize(nSizeIn), nRescanPos(nRescanPosIn), fDone(false) {}
+    };
+
+private:
+    static const size_t MAX_PENDING_BYTES = 64 * 1024 * 1024;
+
+    CBlockFileParser(const CBlockFileParser&);
+    CBlockFileParser& operator=(const CBlockFileParser&);
+
+    CMessageHeader::MessageStartChars pchMessageStart;
+    unsigned int nMaxBlockSize;
+    CBufferedFile blkdat;
+
+    boost::mutex mutex;
+    boost::condition_variable condWork;
+    boost::condition_variable condDone;
+    boost::condition_variable condSpace;
+
+    // Framed blocks in file order, and the raw data of those not parsed yet
+    std::deque<std::shared_ptr<block_t> > dequeBlocks;
+    std::deque<std::pair<std::shared_ptr<block_t>, std::vector<char> > > dequeUnparsed;
+    size_t nPendingBytes;
+    bool fReaderDone;
+    // Set by Next() when a block couldn't be deserialized, the reader continues at nRescanPos
+    bool fRescan;
+    uint64_t nRescanPos;
+    bool fStop;
+
+    boost::thread_group threadGroup;
+
+    void ReaderThread();
+    void ReadFrames(uint64_t nRewind);
+    void WorkerThread();
+    static void Parse(block_t& block, const std::vector<char>& vch);
+
+public:
+    /// Takes over fileIn and starts the reader and nThreads worker threads
+    CBlockFileParser(FILE* fileIn, const CMessageHeader::MessageStartChars& pchMessageStartIn, unsigned int nMaxBlockSizeIn, int nThreads);
+    /// Stops and joins all threads, even if the file wasn't read to the end
+    ~CBlockFileParser();
+
+    /// Wait for the next block in file order, returns false at the end of the file
+    bool Next(std::shared_ptr<block_t>& blockRet);
+};
+
+#endif
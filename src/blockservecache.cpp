@@ -0,0 +1,87 @@
+// Copyright (c) 2014-2017 The Dune Spice developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockservecache.h"
+#include "core_memusage.h"
+#include "memusage.h"
+#include "protocol.h"
+#include "version.h"
+
+CBlockServeCache blockservecache;
+
+size_t CBlockServeCache::EntrySize(const entry_t& entry)
+{
+    return memusage::MallocUsage(sizeof(CBlock)) + RecursiveDynamicUsage(*entry.pblock) +
+           memusage::MallocUsage(entry.msgBlock->capacity());
+}
+
+void CBlockServeCache::Prune()
+{
+    while(nCurrentSize > nMaxSize && !listItems.empty()) {
+        nCurrentSize -= EntrySize(listItems.back().second);
+        mapIndex.erase(listItems.back().first);
+        listItems.pop_back();
+    }
+}
+
+void CBlockServeCache::SetMaxSize(size_t nMaxSizeIn)
+{
+    LOCK(cs);
+    nMaxSize = nMaxSizeIn;
+    Prune();
+}
+
+bool CBlockServeCache::Get(const uint256& hash, entry_t& entryRet)
+{
+    LOCK(cs);
+    std::map<uint256, list_t::iterator>::iterator it = mapIndex.find(hash);
+    if(it == mapIndex.end()) return false;
+
+    // move to the front, it's the least likely to be dropped now
+    listItems.splice(listItems.begin(), listItems, it->second);
+    entryRet = it->second->second;
+    return true;
+}
+
+CBlockServeCache::entry_t CBlockServeCache::Insert(const std::shared_ptr<const CBlock>& pblock, CConnman& connman)
+{
+    entry_t entry;
+    entry.pblock = pblock;
+    // block encoding does not depend on the peer version, so all peers can share it
+    entry.msgBlock = connman.MakeMessage(PROTOCOL_VERSION, NetMsgType::BLOCK, *pblock);
+
+    const uint256& hash = pblock->GetHash();
+    size_t nEntrySize = EntrySize(entry);
+
+    LOCK(cs);
+    // don't flush the whole cache for a single block that doesn't fit anyway
+    if(nEntrySize > nMaxSize || mapIndex.count(hash)) return entry;
+
+    listItems.push_front(std::make_pair(hash, entry));
+    mapIndex[hash] = listItems.begin();
+    nCurrentSize += nEntrySize;
+    Prune();
+
+    return entry;
+}
+
+void CBlockServeCache::Clear()
+{
+    LOCK(cs);
+    listItems.clear();
+    mapIndex.clear();
+    nCurrentSize = 0;
+}
+
+size_t CBlockServeCache::GetSize() const
+{
+    LOCK(cs);
+    return nCurrentSize;
+}
+
+size_t CBlockServeCache::GetCount() const
+{
+    LOCK(cs);
+    return listItems.size();
+}
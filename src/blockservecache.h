@@ -0,0 +1,69 @@
+// Copyright (c) 2014-2017 The Dune Spice developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BLOCKSERVECACHE_H
+#define BLOCKSERVECACHE_H
+
+#include "net.h"
+#include "primitives/block.h"
+#include "sync.h"
+#include "uint256.h"
+
+#include <list>
+#include <map>
+#include <memory>
+
+class CBlockServeCache;
+
+/** Default for -blockservecache, in megabytes */
+static const int64_t DEFAULT_BLOCKSERVECACHE = 16;
+
+extern CBlockServeCache blockservecache;
+
+/**
+ * Least recently used cache of blocks requested by our peers.
+ *
+ * Every entry keeps the block twice: as a ready to send "block" message,
+ * which is queued for every peer asking for it without being copied, and
+ * deserialized with its header and transaction hashes already computed,
+ * to build "merkleblock" messages for peers with a bloom filter.
+ * Blocks never change once stored, so entries are only dropped to make room.
+ */
+class CBlockServeCache
+{
+public:
+    struct entry_t {
+        std::shared_ptr<const CBlock> pblock;
+        CSerializedNetMsg msgBlock;
+    };
+
+private:
+    typedef std::list<std::pair<uint256, entry_t> > list_t;
+
+    mutable CCriticalSection cs;
+    list_t listItems;
+    std::map<uint256, list_t::iterator> mapIndex;
+    size_t nMaxSize;
+    size_t nCurrentSize;
+
+    static size_t EntrySize(const entry_t& entry);
+    void Prune();
+
+public:
+    CBlockServeCache(size_t nMaxSizeIn = 0) : nMaxSize(nMaxSizeIn), nCurrentSize(0) {}
+
+    /// Set the memory limit in bytes, 0 disables the cache
+    void SetMaxSize(size_t nMaxSizeIn);
+
+    /// Look up a block and mark it as recently used
+    bool Get(const uint256& hash, entry_t& entryRet);
+    /// Serialize a block for sending and store it
+    entry_t Insert(const std::shared_ptr<const CBlock>& pblock, CConnman& connman);
+
+    void Clear();
+    size_t GetSize() const;
+    size_t GetCount() const;
+};
+
+#endif
@@ -40,7 +40,8 @@ struct CacheItem
 
 
 /**
- * Map like container that keeps the N most recently added items
+ * Map like container that keeps the N most recently added items,
+ * or most recently used ones if lookups go through GetAndTouch()
  */
 template<typename K, typename V, typename Size = uint32_t>
 class CacheMap
@@ -141,6 +142,18 @@ public:
         return true;
     }
 
+    /// Look up an item and move it to the front, so the least recently used items are pruned first
+    bool GetAndTouch(const K& key, V& value)
+    {
+        map_it it = mapIndex.find(key);
+        if(it == mapIndex.end()) {
+            return false;
+        }
+        listItems.splice(listItems.begin(), listItems, it->second);
+        value = it->second->value;
+        return true;
+    }
+
     void Erase(const K& key)
     {
         map_it it = mapIndex.find(key);
@@ -225,6 +225,14 @@ public:
      */
     bool HaveCoinInCache(const COutPoint &outpoint) const;
 
+    /**
+     * Add an unspent coin that was read from the backing CCoinsView, unless
+     * this cache already has an entry for outpoint. The caller guarantees
+     * that coin is still what the backing view holds. Returns whether the
+     * coin was added.
+     */
+    bool WarmCoin(const COutPoint &outpoint, Coin&& coin);
+
     /**
      * Return a reference to Coin in the cache, or a pruned one if not found. This is
      * more efficient than GetCoin.
@@ -0,0 +1,210 @@
+// Copyright (c) 2014-2017 The Dune Spice developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "coinsprefetch.h"
+#include "reverselock.h"
+#include "txdb.h"
+#include "util.h"
+#include "validation.h"
+
+#include <set>
+
+#include <boost/bind.hpp>
+
+CCoinsPrefetcher* pcoinsPrefetcher = NULL;
+
+CCoinsPrefetcher::CCoinsPrefetcher(CCoinsViewDB* pcoinsdbIn, const Consensus::Params& consensusParamsIn, int nThreads) :
+    pcoinsdb(pcoinsdbIn),
+    consensusParams(consensusParamsIn),
+    fStop(false)
+{
+    for (int i = 0; i < std::max(nThreads, 1); i++) {
+        threadGroup.create_thread(boost::bind(&CCoinsPrefetcher::WorkerThread, this));
+    }
+}
+
+CCoinsPrefetcher::~CCoinsPrefetcher()
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        fStop = true;
+    }
+    condWork.notify_all();
+    threadGroup.join_all();
+}
+
+void CCoinsPrefetcher::SetOutPoints(job_t& job, const CBlock& block)
+{
+    // Outputs created inside the block can't be in the database yet
+    std::set<uint256> setBlockTxids;
+    for (size_t i = 0; i < block.vtx.size(); i++) {
+        const CTransaction& tx = *block.vtx[i];
+        if (!tx.IsCoinBase()) {
+            BOOST_FOREACH(const CTxIn& txin, tx.vin) {
+                if (!setBlockTxids.count(txin.prevout.hash))
+                    job.vOutPoints.push_back(txin.prevout);
+            }
+        }
+        setBlockTxids.insert(tx.GetHash());
+    }
+    job.fRead = true;
+}
+
+void CCoinsPrefetcher::Enqueue(const std::shared_ptr<job_t>& job)
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        BOOST_FOREACH(const std::shared_ptr<job_t>& jobQueued, listJobs) {
+            if (jobQueued->hashBlock == job->hashBlock)
+                return;
+        }
+        // Blocks that never got connected (or were connected without
+        // calling Apply) would pile up otherwise
+        if (listJobs.size() >= MAX_QUEUED_BLOCKS)
+            listJobs.pop_front();
+        listJobs.push_back(job);
+    }
+    condWork.notify_all();
+}
+
+void CCoinsPrefetcher::Prefetch(const CBlock& block)
+{
+    std::shared_ptr<job_t> job = std::make_shared<job_t>(block.GetHash());
+    SetOutPoints(*job, block);
+    if (!job->vOutPoints.empty())
+        Enqueue(job);
+}
+
+void CCoinsPrefetcher::Prefetch(const CBlockIndex* pindex)
+{
+    AssertLockHeld(cs_main);
+    if (!(pindex->nStatus & BLOCK_HAVE_DATA))
+        return;
+    std::shared_ptr<job_t> job = std::make_shared<job_t>(pindex->GetBlockHash());
+    job->pos = pindex->GetBlockPos();
+    Enqueue(job);
+}
+
+void CCoinsPrefetcher::WorkerThread()
+{
+    RenameThread("spice-prefetch");
+
+    boost::unique_lock<boost::mutex> lock(mutex);
+    while (true) {
+        // Find the oldest block with work left: either it still has to be
+        // read from disk or it has outpoints nobody fetches yet
+        std::shared_ptr<job_t> job;
+        BOOST_FOREACH(const std::shared_ptr<job_t>& jobQueued, listJobs) {
+            if ((!jobQueued->fRead && !jobQueued->fReading) || (jobQueued->fRead && jobQueued->nNext < jobQueued->vOutPoints.size())) {
+                job = jobQueued;
+                break;
+            }
+        }
+        if (fStop)
+            return;
+        if (!job) {
+            condWork.wait(lock);
+            continue;
+        }
+
+        if (!job->fRead) {
+            job->fReading = true;
+            CBlock block;
+            bool fOk;
+            {
+                reverse_lock<boost::unique_lock<boost::mutex> > unlock(lock);
+                fOk = ReadBlockFromDisk(block, job->pos, consensusParams) && block.GetHash() == job->hashBlock;
+            }
+            job->fReading = false;
+            if (fOk)
+                SetOutPoints(*job, block);
+            else
+                job->fRead = true; // nothing to prefetch, ConnectTip will complain if it's really broken
+            condWork.notify_all();
+            condDone.notify_all();
+            continue;
+        }
+
+        size_t nBegin = job->nNext;
+        size_t nEnd = std::min(nBegin + OUTPOINTS_PER_BATCH, job->vOutPoints.size());
+        job->nNext = nEnd;
+        job->nPending += nEnd - nBegin;
+
+        std::vector<std::pair<COutPoint, Coin> > vFetched;
+        uint64_t nGeneration;
+        {
+            reverse_lock<boost::unique_lock<boost::mutex> > unlock(lock);
+            // Read the generation first: if a write completes while we're
+            // reading, the coins are tagged with an outdated generation and
+            // won't be applied
+            nGeneration = pcoinsdb->GetWriteGeneration();
+            for (size_t i = nBegin; i < nEnd; i++) {
+                Coin coin;
+                if (pcoinsdb->GetCoin(job->vOutPoints[i], coin))
+                    vFetched.push_back(std::make_pair(job->vOutPoints[i], std::move(coin)));
+            }
+        }
+
+        for (size_t i = 0; i < vFetched.size(); i++) {
+            job->vFetched.push_back(std::move(vFetched[i]));
+            job->vGeneration.push_back(nGeneration);
+        }
+        job->nPending -= nEnd - nBegin;
+        if (job->nPending == 0)
+            condDone.notify_all();
+    }
+}
+
+bool CCoinsPrefetcher::IsIdle() const
+{
+    BOOST_FOREACH(const std::shared_ptr<job_t>& job, listJobs) {
+        if (!job->fRead || job->nNext < job->vOutPoints.size() || job->nPending > 0)
+            return false;
+    }
+    return true;
+}
+
+void CCoinsPrefetcher::WaitForIdle()
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    while (!fStop && !IsIdle())
+        condDone.wait(lock);
+}
+
+size_t CCoinsPrefetcher::Apply(const uint256& hashBlock, CCoinsViewCache& cache)
+{
+    AssertLockHeld(cs_main);
+
+    std::shared_ptr<job_t> job;
+    size_t nOutPoints;
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        for (std::list<std::shared_ptr<job_t> >::iterator it = listJobs.begin(); it != listJobs.end(); ++it) {
+            if ((*it)->hashBlock == hashBlock) {
+                job = *it;
+                listJobs.erase(it);
+                break;
+            }
+        }
+        if (!job)
+            return 0;
+        // Whatever wasn't handed out yet (including a block that is still
+        // being read) is looked up by ConnectBlock itself, only wait for the
+        // batches that are being fetched right now
+        nOutPoints = job->vOutPoints.size();
+        job->nNext = nOutPoints;
+        while (job->nPending > 0)
+            condDone.wait(lock);
+    }
+
+    // The database can only be written to under cs_main, which we hold
+    uint64_t nGeneration = pcoinsdb->GetWriteGeneration();
+    size_t nApplied = 0;
+    for (size_t i = 0; i < job->vFetched.size(); i++) {
+        if (job->vGeneration[i] == nGeneration && cache.WarmCoin(job->vFetched[i].first, std::move(job->vFetched[i].second)))
+            nApplied++;
+    }
+    LogPrint("bench", "    - Prefetched %u of %u coins for block %s\n", nApplied, nOutPoints, hashBlock.ToString());
+    return nApplied;
+}
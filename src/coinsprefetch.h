@@ -0,0 +1,99 @@
+// Copyright (c) 2014-2017 The Dune Spice developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef COINSPREFETCH_H
+#define COINSPREFETCH_H
+
+#include "chain.h"
+#include "coins.h"
+#include "consensus/params.h"
+#include "primitives/block.h"
+
+#include <list>
+#include <memory>
+#include <vector>
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+class CCoinsViewDB;
+
+//! -prefetchthreads default
+static const int DEFAULT_PREFETCH_THREADS = 4;
+//! Maximum number of -prefetchthreads
+static const int MAX_PREFETCH_THREADS = 16;
+
+/**
+ * Reads the coins spent by blocks that are about to be connected from the
+ * coins database on a small pool of threads, so ConnectBlock finds them in
+ * pcoinsTip instead of waiting on one LevelDB lookup after the other.
+ *
+ * Blocks are queued as soon as they are received, or by their position on
+ * disk when ActivateBestChain is about to connect them. Apply() moves what
+ * was fetched into the coins cache right before the block is connected.
+ * Coins are only applied if the database wasn't written to after they were
+ * read, so a flush can never resurrect a spent coin.
+ */
+class CCoinsPrefetcher
+{
+private:
+    struct job_t {
+        uint256 hashBlock;
+        CDiskBlockPos pos; // the block still has to be read from here if fRead is false
+        bool fRead;
+        bool fReading;
+        std::vector<COutPoint> vOutPoints;
+        size_t nNext; // next outpoint to hand out to a worker
+        size_t nPending; // outpoints handed out but not fetched yet
+        std::vector<std::pair<COutPoint, Coin> > vFetched;
+        std::vector<uint64_t> vGeneration; // database write generation each fetched coin was read at
+
+        job_t(const uint256& hashBlockIn) : hashBlock(hashBlockIn), fRead(false), fReading(false), nNext(0), nPending(0) {}
+    };
+
+    static const size_t MAX_QUEUED_BLOCKS = 64;
+    static const size_t OUTPOINTS_PER_BATCH = 16;
+
+    CCoinsPrefetcher(const CCoinsPrefetcher&);
+    CCoinsPrefetcher& operator=(const CCoinsPrefetcher&);
+
+    CCoinsViewDB* pcoinsdb;
+    const Consensus::Params& consensusParams;
+
+    boost::mutex mutex;
+    boost::condition_variable condWork;
+    boost::condition_variable condDone;
+
+    // Queued blocks, oldest first
+    std::list<std::shared_ptr<job_t> > listJobs;
+    bool fStop;
+
+    boost::thread_group threadGroup;
+
+    void WorkerThread();
+    void Enqueue(const std::shared_ptr<job_t>& job);
+    bool IsIdle() const;
+    static void SetOutPoints(job_t& job, const CBlock& block);
+
+public:
+    /// Starts nThreads worker threads reading from pcoinsdbIn
+    CCoinsPrefetcher(CCoinsViewDB* pcoinsdbIn, const Consensus::Params& consensusParamsIn, int nThreads);
+    /// Stops and joins all threads
+    ~CCoinsPrefetcher();
+
+    /// Queue the coins spent by a block we have in memory
+    void Prefetch(const CBlock& block);
+    /// Queue the coins spent by a stored block, the block is read from disk by a worker. Requires cs_main.
+    void Prefetch(const CBlockIndex* pindex);
+    /// Add the coins fetched for hashBlock to cache and forget about the block, returns the number of coins added
+    size_t Apply(const uint256& hashBlock, CCoinsViewCache& cache);
+    /// Wait until every queued block was read and all of its coins were fetched
+    void WaitForIdle();
+};
+
+/** Global prefetcher for pcoinsTip, NULL if -prefetchthreads=0 */
+extern CCoinsPrefetcher* pcoinsPrefetcher;
+
+#endif
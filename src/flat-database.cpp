@@ -0,0 +1,189 @@
+// Copyright (c) 2014-2017 The Dune Spice developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "flat-database.h"
+
+//! Records larger than this are taken for garbage at the end of a journal
+static const uint32_t MAX_JOURNAL_RECORD_SIZE = 32 * 1024 * 1024;
+
+CFlatDBJournal::CFlatDBJournal() :
+    file(NULL),
+    nSize(0)
+{
+}
+
+CFlatDBJournal::~CFlatDBJournal()
+{
+    Close();
+}
+
+bool CFlatDBJournal::IsOpen() const
+{
+    LOCK(cs);
+    return file != NULL;
+}
+
+uint64_t CFlatDBJournal::GetSize() const
+{
+    LOCK(cs);
+    return nSize;
+}
+
+bool CFlatDBJournal::WriteHeader(FILE* fileOut, const uint256& hashBase)
+{
+    CDataStream ssHeader(SER_DISK, CLIENT_VERSION);
+    ssHeader << strMagicMessage; // specific magic message for this type of object
+    ssHeader << FLATDATA(Params().MessageStart()); // network specific magic number
+    ssHeader << hashBase;
+    if (fwrite(&ssHeader[0], 1, ssHeader.size(), fileOut) != ssHeader.size())
+        return false;
+    nSize = ssHeader.size();
+    return true;
+}
+
+void CFlatDBJournal::Fail(const std::string& strError)
+{
+    error("CFlatDBJournal: %s %s, changes are only saved on shutdown", strError, pathJournal.string());
+    if (file)
+        fclose(file);
+    file = NULL;
+}
+
+bool CFlatDBJournal::Open(const boost::filesystem::path& pathIn, const std::string& strMagicMessageIn, const uint256& hashBase, std::vector<CDataStream>& vRecordsRet)
+{
+    LOCK(cs);
+    if (file)
+        fclose(file);
+    file = NULL;
+    pathJournal = pathIn;
+    strMagicMessage = strMagicMessageIn;
+    vRecordsRet.clear();
+
+    // Read the records that extend the file we loaded, up to the first incomplete one
+    long nValid = 0;
+    CAutoFile filein(fopen(pathJournal.string().c_str(), "rb"), SER_DISK, CLIENT_VERSION);
+    if (!filein.IsNull()) {
+        try {
+            std::string strMagicMessageTmp;
+            unsigned char pchMsgTmp[4];
+            uint256 hashBaseTmp;
+            filein >> strMagicMessageTmp >> FLATDATA(pchMsgTmp) >> hashBaseTmp;
+            if (strMagicMessageTmp == strMagicMessage && !memcmp(pchMsgTmp, Params().MessageStart(), sizeof(pchMsgTmp)) && hashBaseTmp == hashBase) {
+                nValid = ftell(filein.Get());
+                while (true) {
+                    uint32_t nRecordSize;
+                    filein >> nRecordSize;
+                    if (nRecordSize == 0 || nRecordSize > MAX_JOURNAL_RECORD_SIZE)
+                        break;
+                    std::vector<char> vchRecord(nRecordSize);
+                    filein.read(&vchRecord[0], nRecordSize);
+                    unsigned char pchChecksum[4];
+                    filein >> FLATDATA(pchChecksum);
+                    uint256 hashRecord = Hash(vchRecord.begin(), vchRecord.end());
+                    if (memcmp(pchChecksum, hashRecord.begin(), sizeof(pchChecksum)))
+                        break;
+                    vRecordsRet.push_back(CDataStream(vchRecord, SER_DISK, CLIENT_VERSION));
+                    nValid = ftell(filein.Get());
+                }
+            } else if (!hashBaseTmp.IsNull() || !hashBase.IsNull()) {
+                LogPrintf("CFlatDBJournal: %s doesn't extend the file that was loaded, starting over\n", pathJournal.string());
+            }
+        } catch (const std::exception&) {
+            // the end of the journal, possibly in the middle of a record a crash cut short
+        }
+        filein.fclose();
+    }
+
+    if (nValid > 0) {
+        file = fopen(pathJournal.string().c_str(), "r+b");
+        if (!file || !TruncateFile(file, (unsigned int)nValid) || fseek(file, 0, SEEK_END) != 0) {
+            Fail("Failed to reopen");
+            return false;
+        }
+        nSize = nValid;
+    } else {
+        file = fopen(pathJournal.string().c_str(), "wb");
+        if (!file || !WriteHeader(file, hashBase) || fflush(file) != 0) {
+            Fail("Failed to create");
+            return false;
+        }
+    }
+    return true;
+}
+
+bool CFlatDBJournal::Restart(const uint256& hashBase, uint64_t nKeepFrom)
+{
+    LOCK(cs);
+    if (pathJournal.empty())
+        return true; // never opened, nothing is logged
+
+    // The records logged while the file was written
+    std::vector<char> vchTail;
+    if (file && nKeepFrom > 0 && nKeepFrom < nSize) {
+        vchTail.resize(nSize - nKeepFrom);
+        FILE* fileIn = fopen(pathJournal.string().c_str(), "rb");
+        bool fOk = fflush(file) == 0 && fileIn && fseek(fileIn, nKeepFrom, SEEK_SET) == 0 &&
+                   fread(&vchTail[0], 1, vchTail.size(), fileIn) == vchTail.size();
+        if (fileIn)
+            fclose(fileIn);
+        if (!fOk) {
+            Fail("Failed to read");
+            return false;
+        }
+    }
+    if (file)
+        fclose(file);
+    file = NULL;
+
+    boost::filesystem::path pathTmp = pathJournal;
+    pathTmp.replace_extension(".journal.new");
+    FILE* fileOut = fopen(pathTmp.string().c_str(), "wb");
+    if (!fileOut || !WriteHeader(fileOut, hashBase) ||
+        (!vchTail.empty() && fwrite(&vchTail[0], 1, vchTail.size(), fileOut) != vchTail.size())) {
+        if (fileOut)
+            fclose(fileOut);
+        Fail("Failed to write");
+        return false;
+    }
+    FileCommit(fileOut);
+    fclose(fileOut);
+    nSize += vchTail.size();
+
+    if (!RenameOver(pathTmp, pathJournal) || !(file = fopen(pathJournal.string().c_str(), "ab"))) {
+        Fail("Failed to replace");
+        return false;
+    }
+    return true;
+}
+
+void CFlatDBJournal::Close()
+{
+    LOCK(cs);
+    if (!file)
+        return;
+    fflush(file);
+    FileCommit(file);
+    fclose(file);
+    file = NULL;
+}
+
+void CFlatDBJournal::Append(const CDataStream& ssRecord)
+{
+    LOCK(cs);
+    if (!file)
+        return;
+
+    uint256 hashRecord = Hash(ssRecord.begin(), ssRecord.end());
+    CDataStream ssOut(SER_DISK, CLIENT_VERSION);
+    ssOut << (uint32_t)ssRecord.size();
+    ssOut.write(&ssRecord[0], ssRecord.size());
+    ssOut.write((const char*)hashRecord.begin(), 4);
+
+    // Flushing to the OS is enough to survive a crash of the node itself
+    if (fwrite(&ssOut[0], 1, ssOut.size(), file) != ssOut.size() || fflush(file) != 0) {
+        Fail("Failed to append to");
+        return;
+    }
+    nSize += ssOut.size();
+}
@@ -9,10 +9,93 @@
 #include "clientversion.h"
 #include "hash.h"
 #include "streams.h"
+#include "sync.h"
 #include "util.h"
 
+#include <vector>
+
 #include <boost/filesystem.hpp>
 
+/** Don't rewrite a journaled file while its journal is smaller than the file and this */
+static const uint64_t FLATDB_JOURNAL_MIN_COMPACT_SIZE = 1 << 20;
+/** Seconds between checks whether a journal needs to be compacted */
+static const int64_t FLATDB_JOURNAL_COMPACT_INTERVAL = 10 * 60;
+
+/**
+ * Append-only log of the changes made to a cache since its flat database
+ * file was last written in full.
+ *
+ * The journal starts with the magic message, the network magic and the
+ * checksum of the file it extends. Each record is its size, the data and
+ * the first four bytes of its hash, so a record cut short by a crash ends
+ * the journal. Records have to be idempotent: those logged while the file
+ * is being rewritten are kept in the new journal, although the new file
+ * may already contain them.
+ */
+class CFlatDBJournal
+{
+private:
+    CFlatDBJournal(const CFlatDBJournal&);
+    CFlatDBJournal& operator=(const CFlatDBJournal&);
+
+    mutable CCriticalSection cs;
+    FILE* file; // NULL until the cache is loaded, or once logging failed
+    boost::filesystem::path pathJournal;
+    std::string strMagicMessage;
+    uint64_t nSize; // bytes in the journal, including the header
+
+    bool WriteHeader(FILE* fileOut, const uint256& hashBase);
+    void Fail(const std::string& strError);
+
+public:
+    CFlatDBJournal();
+    ~CFlatDBJournal();
+
+    bool IsOpen() const;
+    uint64_t GetSize() const;
+
+    /**
+     * Start logging to pathIn. If the journal there extends the file with
+     * checksum hashBase its records are returned and new ones are appended
+     * after them, otherwise it is started over.
+     */
+    bool Open(const boost::filesystem::path& pathIn, const std::string& strMagicMessageIn, const uint256& hashBase, std::vector<CDataStream>& vRecordsRet);
+    /** Start over after the file was rewritten, keeping the records logged from byte nKeepFrom on */
+    bool Restart(const uint256& hashBase, uint64_t nKeepFrom);
+    /** Flush to disk and stop logging */
+    void Close();
+
+    void Append(const CDataStream& ssRecord);
+
+    void Append(unsigned char nType)
+    {
+        CDataStream ssRecord(SER_DISK, CLIENT_VERSION);
+        ssRecord << nType;
+        Append(ssRecord);
+    }
+
+    template<typename R>
+    void Append(unsigned char nType, const R& record)
+    {
+        if (!IsOpen())
+            return;
+        CDataStream ssRecord(SER_DISK, CLIENT_VERSION);
+        ssRecord << nType << record;
+        Append(ssRecord);
+    }
+};
+
+/** A cache that logs its changes to a journal, so its file only needs to be rewritten once in a while */
+class CFlatDBJournaledCache
+{
+public:
+    CFlatDBJournal journal;
+
+    virtual ~CFlatDBJournaledCache() {}
+    /** Apply a change read back from the journal, returns false if the record is unknown */
+    virtual bool ApplyJournalRecord(CDataStream& ssRecord) = 0;
+};
+
 /** 
 *   Generic Dumping and Loading
 *   ---------------------------
@@ -34,15 +117,35 @@ private:
     };
 
     boost::filesystem::path pathDB;
+    boost::filesystem::path pathJournal;
     std::string strFilename;
     std::string strMagicMessage;
 
-    bool Write(const T& objToSave)
+    // Only caches deriving from CFlatDBJournaledCache have a journal
+    static CFlatDBJournaledCache* GetJournaled(CFlatDBJournaledCache* pobj) { return pobj; }
+    static CFlatDBJournaledCache* GetJournaled(void* pobj) { return NULL; }
+
+    bool NeedsCompaction(const CFlatDBJournaledCache& journaled)
+    {
+        if (!journaled.journal.IsOpen())
+            return true;
+        boost::system::error_code ec;
+        uint64_t nFileSize = boost::filesystem::file_size(pathDB, ec);
+        if (ec)
+            nFileSize = 0;
+        return journaled.journal.GetSize() > std::max(nFileSize, FLATDB_JOURNAL_MIN_COMPACT_SIZE);
+    }
+
+    bool Write(T& objToSave)
     {
         // LOCK(objToSave.cs);
 
         int64_t nStart = GetTimeMillis();
 
+        // Changes logged from here on may or may not end up in the file, keep them in the journal
+        CFlatDBJournaledCache* pjournaled = GetJournaled(&objToSave);
+        uint64_t nJournalPos = pjournaled ? pjournaled->journal.GetSize() : 0;
+
         // serialize, checksum data up to that point, then append checksum
         CDataStream ssObj(SER_DISK, CLIENT_VERSION);
         ssObj << strMagicMessage; // specific magic message for this type of object
@@ -51,11 +154,12 @@ private:
         uint256 hash = Hash(ssObj.begin(), ssObj.end());
         ssObj << hash;
 
-        // open output file, and associate with CAutoFile
-        FILE *file = fopen(pathDB.string().c_str(), "wb");
+        // open a temporary output file, and associate with CAutoFile
+        boost::filesystem::path pathTmp = GetDataDir() / (strFilename + ".new");
+        FILE *file = fopen(pathTmp.string().c_str(), "wb");
         CAutoFile fileout(file, SER_DISK, CLIENT_VERSION);
         if (fileout.IsNull())
-            return error("%s: Failed to open file %s", __func__, pathDB.string());
+            return error("%s: Failed to open file %s", __func__, pathTmp.string());
 
         // Write and commit header, data
         try {
@@ -64,15 +168,23 @@ private:
         catch (std::exception &e) {
             return error("%s: Serialize or I/O error - %s", __func__, e.what());
         }
+        FileCommit(fileout.Get());
         fileout.fclose();
 
+        // replace the old file only once the new one is complete, the
+        // journal still extends the old one until it is restarted
+        if (!RenameOver(pathTmp, pathDB))
+            return error("%s: Failed to rename %s to %s", __func__, pathTmp.string(), pathDB.string());
+        if (pjournaled && !pjournaled->journal.Restart(hash, nJournalPos))
+            LogPrintf("%s: Failed to restart the journal of %s, changes are only saved on shutdown\n", __func__, strFilename);
+
         LogPrintf("Written info to %s  %dms\n", strFilename, GetTimeMillis() - nStart);
         LogPrintf("     %s\n", objToSave.ToString());
 
         return true;
     }
 
-    ReadResult Read(T& objToLoad, bool fDryRun = false)
+    ReadResult Read(T& objToLoad, uint256& hashRet)
     {
         //LOCK(objToLoad.cs);
 
@@ -92,13 +204,20 @@ private:
         // Don't try to resize to a negative number if file is small
         if (dataSize < 0)
             dataSize = 0;
-        std::vector<unsigned char> vchData;
-        vchData.resize(dataSize);
         uint256 hashIn;
 
-        // read data and checksum from file
+        // read the data straight into the stream and hash it chunk by chunk
+        // while it is still in the cache, instead of hashing a second copy
+        const int nChunkSize = 1 << 20;
+        CDataStream ssObj(SER_DISK, CLIENT_VERSION);
+        CHash256 hasher;
         try {
-            filein.read((char *)&vchData[0], dataSize);
+            ssObj.resize(dataSize);
+            for (int nPos = 0; nPos < dataSize; nPos += nChunkSize) {
+                int nChunk = std::min(dataSize - nPos, nChunkSize);
+                filein.read((char *)&ssObj[nPos], nChunk);
+                hasher.Write((const unsigned char *)&ssObj[nPos], nChunk);
+            }
             filein >> hashIn;
         }
         catch (std::exception &e) {
@@ -107,10 +226,10 @@ private:
         }
         filein.fclose();
 
-        CDataStream ssObj(vchData, SER_DISK, CLIENT_VERSION);
-
         // verify stored checksum matches input data
-        uint256 hashTmp = Hash(ssObj.begin(), ssObj.end());
+        uint256 hashTmp;
+        hasher.Finalize(hashTmp.begin());
+        hashRet = hashIn;
         if (hashIn != hashTmp)
         {
             error("%s: Checksum mismatch, data corrupted", __func__);
@@ -153,28 +272,53 @@ private:
 
         LogPrintf("Loaded info from %s  %dms\n", strFilename, GetTimeMillis() - nStart);
         LogPrintf("     %s\n", objToLoad.ToString());
-        if(!fDryRun) {
-            LogPrintf("%s: Cleaning....\n", __func__);
-            objToLoad.CheckAndRemove();
-            LogPrintf("     %s\n", objToLoad.ToString());
-        }
 
         return Ok;
     }
 
+    void ReplayJournal(CFlatDBJournaledCache& journaled, const uint256& hashBase)
+    {
+        int64_t nStart = GetTimeMillis();
+        std::vector<CDataStream> vRecords;
+        if (!journaled.journal.Open(pathJournal, strMagicMessage, hashBase, vRecords)) {
+            LogPrintf("%s: Failed to open the journal of %s, changes are only saved on shutdown\n", __func__, strFilename);
+            return;
+        }
+
+        size_t nApplied = 0;
+        for (size_t i = 0; i < vRecords.size(); i++) {
+            try {
+                if (journaled.ApplyJournalRecord(vRecords[i]))
+                    nApplied++;
+            }
+            catch (std::exception &e) {
+                error("%s: Deserialize error - %s", __func__, e.what());
+            }
+        }
+        LogPrintf("Applied %u of %u changes from the journal of %s  %dms\n", nApplied, vRecords.size(), strFilename, GetTimeMillis() - nStart);
+    }
+
 
 public:
     CFlatDB(std::string strFilenameIn, std::string strMagicMessageIn)
     {
         pathDB = GetDataDir() / strFilenameIn;
+        pathJournal = pathDB;
+        pathJournal.replace_extension(".journal");
         strFilename = strFilenameIn;
         strMagicMessage = strMagicMessageIn;
     }
 
-    bool Load(T& objToLoad)
+    /**
+     * Read the file into objToLoad. Without fCleanup the object isn't
+     * checked against the chain, so this can run while the chain is still
+     * loading; call Cleanup() once it is.
+     */
+    bool Load(T& objToLoad, bool fCleanup = true)
     {
         LogPrintf("Reading info from %s...\n", strFilename);
-        ReadResult readResult = Read(objToLoad);
+        uint256 hashBase;
+        ReadResult readResult = Read(objToLoad, hashBase);
         if (readResult == FileError)
             LogPrintf("Missing file %s, will try to recreate\n", strFilename);
         else if (readResult != Ok)
@@ -190,34 +334,75 @@ public:
                 return false;
             }
         }
+
+        // a journal can only extend a file that was read
+        if (readResult != Ok)
+            hashBase.SetNull();
+        CFlatDBJournaledCache* pjournaled = GetJournaled(&objToLoad);
+        if (pjournaled)
+            ReplayJournal(*pjournaled, hashBase);
+        if (fCleanup)
+            Cleanup(objToLoad);
         return true;
     }
 
+    void Cleanup(T& objToLoad)
+    {
+        LogPrintf("%s: Cleaning %s....\n", __func__, strFilename);
+        objToLoad.CheckAndRemove();
+        LogPrintf("     %s\n", objToLoad.ToString());
+    }
+
+    /** Rewrite the file if its journal grew too large */
+    bool Compact(T& objToSave)
+    {
+        CFlatDBJournaledCache* pjournaled = GetJournaled(&objToSave);
+        if (!pjournaled || !pjournaled->journal.IsOpen() || !NeedsCompaction(*pjournaled))
+            return true;
+        LogPrintf("Compacting %s, journal size %u\n", strFilename, pjournaled->journal.GetSize());
+        return Write(objToSave);
+    }
+
     bool Dump(T& objToSave)
     {
         int64_t nStart = GetTimeMillis();
 
-        LogPrintf("Verifying %s format...\n", strFilename);
-        T tmpObjToLoad;
-        ReadResult readResult = Read(tmpObjToLoad, true);
+        // A journal that isn't too large already has everything worth keeping
+        CFlatDBJournaledCache* pjournaled = GetJournaled(&objToSave);
+        if (pjournaled && !NeedsCompaction(*pjournaled)) {
+            pjournaled->journal.Close();
+            LogPrintf("%s is up to date, %u bytes of changes in its journal  %dms\n", strFilename, pjournaled->journal.GetSize(), GetTimeMillis() - nStart);
+            return true;
+        }
 
-        // there was an error and it was not an error on file opening => do not proceed
-        if (readResult == FileError)
-            LogPrintf("Missing file %s, will try to recreate\n", strFilename);
-        else if (readResult != Ok)
-        {
-            LogPrintf("Error reading %s: ", strFilename);
-            if(readResult == IncorrectFormat)
-                LogPrintf("%s: Magic is ok but data has invalid format, will try to recreate\n", __func__);
-            else
+        // The file of a journaled cache was checked when it was loaded, a
+        // journal can only extend a file that was read
+        if (!pjournaled) {
+            LogPrintf("Verifying %s format...\n", strFilename);
+            T tmpObjToLoad;
+            uint256 hashTmp;
+            ReadResult readResult = Read(tmpObjToLoad, hashTmp);
+
+            // there was an error and it was not an error on file opening => do not proceed
+            if (readResult == FileError)
+                LogPrintf("Missing file %s, will try to recreate\n", strFilename);
+            else if (readResult != Ok)
             {
-                LogPrintf("%s: File format is unknown or invalid, please fix it manually\n", __func__);
-                return false;
+                LogPrintf("Error reading %s: ", strFilename);
+                if(readResult == IncorrectFormat)
+                    LogPrintf("%s: Magic is ok but data has invalid format, will try to recreate\n", __func__);
+                else
+                {
+                    LogPrintf("%s: File format is unknown or invalid, please fix it manually\n", __func__);
+                    return false;
+                }
             }
         }
 
         LogPrintf("Writing info to %s...\n", strFilename);
         Write(objToSave);
+        if (pjournaled)
+            pjournaled->journal.Close();
         LogPrintf("%s dump finished  %dms\n", strFilename, GetTimeMillis() - nStart);
 
         return true;
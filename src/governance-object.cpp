@@ -194,21 +194,42 @@ bool CGovernanceObject::ProcessVote(CNode* pfrom,
         fileVotes.AddVote(vote);
     }
     fDirtyCache = true;
+    governance.journal.Append(CGovernanceManager::JOURNAL_GOVERNANCE_VOTE, vote);
     return true;
 }
 
+void CGovernanceObject::RestoreVote(const CGovernanceVote& vote)
+{
+    // the vote itself was written to the vote database when it was processed,
+    // only the tally may be older than the journal
+    vote_instance_t& voteInstance = mapCurrentMNVotes[vote.GetMasternodeOutpoint()].mapInstances[int(vote.GetSignal())];
+    if(vote.GetTimestamp() >= voteInstance.nCreationTime) {
+        voteInstance = vote_instance_t(vote.GetOutcome(), voteInstance.nTime, vote.GetTimestamp());
+    }
+    if(!fileVotes.HasVote(vote.GetHash())) {
+        fileVotes.AddVote(vote);
+    }
+    fDirtyCache = true;
+}
+
 void CGovernanceObject::ClearMasternodeVotes()
 {
+    std::set<COutPoint> setRemoved;
     vote_m_it it = mapCurrentMNVotes.begin();
     while(it != mapCurrentMNVotes.end()) {
         if(!mnodeman.Has(it->first)) {
-            fileVotes.RemoveVotesFromMasternode(it->first);
+            setRemoved.insert(it->first);
             mapCurrentMNVotes.erase(it++);
         }
         else {
             ++it;
         }
     }
+    // one pass over the votes in the database for all removed masternodes
+    if(!setRemoved.empty()) {
+        fileVotes.RemoveVotesFromMasternodes(setRemoved);
+        governance.journal.Append(CGovernanceManager::JOURNAL_CLEAR_MASTERNODE_VOTES, std::make_pair(GetHash(), setRemoved));
+    }
 }
 
 std::string CGovernanceObject::GetSignatureMessage() const
@@ -692,6 +713,7 @@ void CGovernanceObject::UpdateSentinelVariables()
         fCachedDelete = true;
         if(nDeletionTime == 0) {
             nDeletionTime = GetAdjustedTime();
+            governance.JournalObjectState(*this);
         }
     }
     if(GetAbsoluteYesCount(VOTE_SIGNAL_ENDORSED) >= nAbsVoteReq) fCachedEndorsed = true;
@@ -317,6 +317,9 @@ public:
         READWRITE(nObjectType);
         READWRITE(vinMasternode);
         READWRITE(vchSig);
+        if(ser_action.ForRead()) {
+            fileVotes.SetParentHash(GetHash());
+        }
         if(nType & SER_DISK) {
             // Only include these for the disk file format
             LogPrint("gobject", "CGovernanceObject::SerializationOp Reading/writing votes from/to disk\n");
@@ -346,6 +349,9 @@ private:
                      CGovernanceException& exception,
                      CConnman& connman);
 
+    /// Re-apply a vote read back from the governance journal, it was checked when it was processed
+    void RestoreVote(const CGovernanceVote& vote);
+
     /// Called when MN's which have voted on this object have been removed
     void ClearMasternodeVotes();
 
@@ -3,15 +3,144 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "governance-votedb.h"
+#include "util.h"
+
+#include <boost/scoped_ptr.hpp>
+
+static const char DB_GOVERNANCE_VOTE = 'v';
+
+//! Erased keys are written in batches of about this size
+static const size_t MAX_ERASE_BATCH_SIZE = 1 << 20;
+
+CGovernanceVoteDB* pgovernancevotedb = NULL;
+
+typedef std::pair<char, std::pair<uint256, uint256> > vote_key_t;
+
+static vote_key_t MakeVoteKey(const uint256& nParentHash, const uint256& nHash)
+{
+    return std::make_pair(DB_GOVERNANCE_VOTE, std::make_pair(nParentHash, nHash));
+}
+
+CGovernanceVoteDB::CGovernanceVoteDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "govvotes", nCacheSize, fMemory, fWipe)
+{
+}
+
+bool CGovernanceVoteDB::WriteVote(const CGovernanceVote& vote)
+{
+    return Write(MakeVoteKey(vote.GetParentHash(), vote.GetHash()), vote);
+}
+
+bool CGovernanceVoteDB::HaveVote(const uint256& nParentHash, const uint256& nHash) const
+{
+    return Exists(MakeVoteKey(nParentHash, nHash));
+}
+
+bool CGovernanceVoteDB::ReadVote(const uint256& nParentHash, const uint256& nHash, CGovernanceVote& vote) const
+{
+    return Read(MakeVoteKey(nParentHash, nHash), vote);
+}
+
+bool CGovernanceVoteDB::ReadVotes(const uint256& nParentHash, std::vector<CGovernanceVote>& vecVotes)
+{
+    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+    pcursor->Seek(MakeVoteKey(nParentHash, uint256()));
+
+    while (pcursor->Valid()) {
+        vote_key_t key;
+        if (!pcursor->GetKey(key) || key.first != DB_GOVERNANCE_VOTE || key.second.first != nParentHash)
+            break;
+        CGovernanceVote vote;
+        if (!pcursor->GetValue(vote))
+            return error("%s: failed to read vote %s", __func__, key.second.second.ToString());
+        vecVotes.push_back(vote);
+        pcursor->Next();
+    }
+    return true;
+}
+
+bool CGovernanceVoteDB::ReadVoteHashes(const uint256& nParentHash, std::vector<uint256>& vecHashes)
+{
+    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+    pcursor->Seek(MakeVoteKey(nParentHash, uint256()));
+
+    while (pcursor->Valid()) {
+        vote_key_t key;
+        if (!pcursor->GetKey(key) || key.first != DB_GOVERNANCE_VOTE || key.second.first != nParentHash)
+            break;
+        vecHashes.push_back(key.second.second);
+        pcursor->Next();
+    }
+    return true;
+}
+
+bool CGovernanceVoteDB::EraseVotesFromMasternodes(const uint256& nParentHash, const std::set<COutPoint>& setMasternodes, int& nErasedRet)
+{
+    nErasedRet = 0;
+    std::vector<CGovernanceVote> vecVotes;
+    if (!ReadVotes(nParentHash, vecVotes))
+        return false;
+
+    CDBBatch batch(*this);
+    for (size_t i = 0; i < vecVotes.size(); i++) {
+        if (setMasternodes.count(vecVotes[i].GetMasternodeOutpoint())) {
+            batch.Erase(MakeVoteKey(nParentHash, vecVotes[i].GetHash()));
+            nErasedRet++;
+        }
+    }
+    return nErasedRet == 0 || WriteBatch(batch);
+}
+
+bool CGovernanceVoteDB::EraseObjectVotes(const uint256& nParentHash)
+{
+    std::vector<uint256> vecHashes;
+    if (!ReadVoteHashes(nParentHash, vecHashes))
+        return false;
+
+    CDBBatch batch(*this);
+    for (size_t i = 0; i < vecHashes.size(); i++) {
+        batch.Erase(MakeVoteKey(nParentHash, vecHashes[i]));
+    }
+    return vecHashes.empty() || WriteBatch(batch);
+}
+
+bool CGovernanceVoteDB::EraseOrphanedVotes(const std::set<uint256>& setParentHashes)
+{
+    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+    pcursor->Seek(std::make_pair(DB_GOVERNANCE_VOTE, std::make_pair(uint256(), uint256())));
+
+    CDBBatch batch(*this);
+    int nErased = 0;
+    while (pcursor->Valid()) {
+        vote_key_t key;
+        if (!pcursor->GetKey(key) || key.first != DB_GOVERNANCE_VOTE)
+            break;
+        if (!setParentHashes.count(key.second.first)) {
+            batch.Erase(key);
+            nErased++;
+            if (batch.SizeEstimate() > MAX_ERASE_BATCH_SIZE) {
+                if (!WriteBatch(batch))
+                    return false;
+                batch.Clear();
+            }
+        }
+        pcursor->Next();
+    }
+    if (nErased > 0) {
+        LogPrint("gobject", "CGovernanceVoteDB::EraseOrphanedVotes -- erased %d votes on unknown objects\n", nErased);
+    }
+    return WriteBatch(batch);
+}
 
 CGovernanceObjectVoteFile::CGovernanceObjectVoteFile()
-    : nMemoryVotes(0),
+    : nParentHash(),
+      nVoteCount(0),
       listVotes(),
       mapVoteIndex()
 {}
 
 CGovernanceObjectVoteFile::CGovernanceObjectVoteFile(const CGovernanceObjectVoteFile& other)
-    : nMemoryVotes(other.nMemoryVotes),
+    : nParentHash(other.nParentHash),
+      nVoteCount(other.nVoteCount),
       listVotes(other.listVotes),
       mapVoteIndex()
 {
@@ -19,26 +148,37 @@ CGovernanceObjectVoteFile::CGovernanceObjectVoteFile(const CGovernanceObjectVote
 }
 
 void CGovernanceObjectVoteFile::AddVote(const CGovernanceVote& vote)
+{
+    if(!pgovernancevotedb->WriteVote(vote)) {
+        LogPrintf("CGovernanceObjectVoteFile::AddVote -- failed to write vote %s\n", vote.GetHash().ToString());
+    }
+    AddRecentVote(vote);
+    ++nVoteCount;
+}
+
+void CGovernanceObjectVoteFile::AddRecentVote(const CGovernanceVote& vote)
 {
     listVotes.push_front(vote);
     mapVoteIndex[vote.GetHash()] = listVotes.begin();
-    ++nMemoryVotes;
+    while(listVotes.size() > MAX_MEMORY_VOTES) {
+        mapVoteIndex.erase(listVotes.back().GetHash());
+        listVotes.pop_back();
+    }
 }
 
 bool CGovernanceObjectVoteFile::HasVote(const uint256& nHash) const
 {
-    vote_m_cit it = mapVoteIndex.find(nHash);
-    if(it == mapVoteIndex.end()) {
-        return false;
+    if(mapVoteIndex.count(nHash)) {
+        return true;
     }
-    return true;
+    return pgovernancevotedb->HaveVote(nParentHash, nHash);
 }
 
 bool CGovernanceObjectVoteFile::GetVote(const uint256& nHash, CGovernanceVote& vote) const
 {
     vote_m_cit it = mapVoteIndex.find(nHash);
     if(it == mapVoteIndex.end()) {
-        return false;
+        return pgovernancevotedb->ReadVote(nParentHash, nHash, vote);
     }
     vote = *(it->second);
     return true;
@@ -47,18 +187,28 @@ bool CGovernanceObjectVoteFile::GetVote(const uint256& nHash, CGovernanceVote& v
 std::vector<CGovernanceVote> CGovernanceObjectVoteFile::GetVotes() const
 {
     std::vector<CGovernanceVote> vecResult;
-    for(vote_l_cit it = listVotes.begin(); it != listVotes.end(); ++it) {
-        vecResult.push_back(*it);
-    }
+    pgovernancevotedb->ReadVotes(nParentHash, vecResult);
+    return vecResult;
+}
+
+std::vector<uint256> CGovernanceObjectVoteFile::GetVoteHashes() const
+{
+    std::vector<uint256> vecResult;
+    pgovernancevotedb->ReadVoteHashes(nParentHash, vecResult);
     return vecResult;
 }
 
-void CGovernanceObjectVoteFile::RemoveVotesFromMasternode(const COutPoint& outpointMasternode)
+void CGovernanceObjectVoteFile::RemoveVotesFromMasternodes(const std::set<COutPoint>& setMasternodes)
 {
+    int nErased = 0;
+    if(!pgovernancevotedb->EraseVotesFromMasternodes(nParentHash, setMasternodes, nErased)) {
+        LogPrintf("CGovernanceObjectVoteFile::RemoveVotesFromMasternodes -- failed to erase votes on %s\n", nParentHash.ToString());
+    }
+    nVoteCount -= nErased;
+
     vote_l_it it = listVotes.begin();
     while(it != listVotes.end()) {
-        if(it->GetMasternodeOutpoint() == outpointMasternode) {
-            --nMemoryVotes;
+        if(setMasternodes.count(it->GetMasternodeOutpoint())) {
             mapVoteIndex.erase(it->GetHash());
             listVotes.erase(it++);
         }
@@ -68,9 +218,45 @@ void CGovernanceObjectVoteFile::RemoveVotesFromMasternode(const COutPoint& outpo
     }
 }
 
+void CGovernanceObjectVoteFile::RemoveAllVotes()
+{
+    if(!pgovernancevotedb->EraseObjectVotes(nParentHash)) {
+        LogPrintf("CGovernanceObjectVoteFile::RemoveAllVotes -- failed to erase votes on %s\n", nParentHash.ToString());
+    }
+    nVoteCount = 0;
+    listVotes.clear();
+    mapVoteIndex.clear();
+}
+
+std::vector<uint256> CGovernanceObjectVoteFile::Migrate()
+{
+    // Votes are written before they are added to memory, so this only
+    // writes anything once, for a governance.dat that kept all of them
+    std::vector<uint256> vecHashes = GetVoteHashes();
+    std::set<uint256> setHashes(vecHashes.begin(), vecHashes.end());
+    CDBBatch batch(*pgovernancevotedb);
+    for(vote_l_cit it = listVotes.begin(); it != listVotes.end(); ++it) {
+        if(it->GetParentHash() == nParentHash && setHashes.insert(it->GetHash()).second) {
+            batch.Write(MakeVoteKey(nParentHash, it->GetHash()), *it);
+            vecHashes.push_back(it->GetHash());
+        }
+    }
+    if(!pgovernancevotedb->WriteBatch(batch)) {
+        LogPrintf("CGovernanceObjectVoteFile::Migrate -- failed to write votes on %s\n", nParentHash.ToString());
+    }
+
+    while(listVotes.size() > MAX_MEMORY_VOTES) {
+        mapVoteIndex.erase(listVotes.back().GetHash());
+        listVotes.pop_back();
+    }
+    nVoteCount = vecHashes.size();
+    return vecHashes;
+}
+
 CGovernanceObjectVoteFile& CGovernanceObjectVoteFile::operator=(const CGovernanceObjectVoteFile& other)
 {
-    nMemoryVotes = other.nMemoryVotes;
+    nParentHash = other.nParentHash;
+    nVoteCount = other.nVoteCount;
     listVotes = other.listVotes;
     RebuildIndex();
     return *this;
@@ -79,14 +265,12 @@ CGovernanceObjectVoteFile& CGovernanceObjectVoteFile::operator=(const CGovernanc
 void CGovernanceObjectVoteFile::RebuildIndex()
 {
     mapVoteIndex.clear();
-    nMemoryVotes = 0;
     vote_l_it it = listVotes.begin();
     while(it != listVotes.end()) {
         CGovernanceVote& vote = *it;
         uint256 nHash = vote.GetHash();
         if(mapVoteIndex.find(nHash) == mapVoteIndex.end()) {
             mapVoteIndex[nHash] = it;
-            ++nMemoryVotes;
             ++it;
         }
         else {
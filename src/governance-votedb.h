@@ -7,18 +7,48 @@
 
 #include <list>
 #include <map>
+#include <set>
+#include <vector>
 
+#include "dbwrapper.h"
 #include "governance-vote.h"
 #include "serialize.h"
 #include "uint256.h"
 
+//! Memory allocated to the governance vote database cache (MiB)
+static const int64_t nGovernanceVoteDBCache = 8;
+
+/**
+ * Votes of all governance objects, keyed by the hash of the object they
+ * are for and their own hash, so the votes of one object are read in a
+ * single pass.
+ */
+class CGovernanceVoteDB : public CDBWrapper
+{
+public:
+    CGovernanceVoteDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+
+    bool WriteVote(const CGovernanceVote& vote);
+    bool HaveVote(const uint256& nParentHash, const uint256& nHash) const;
+    bool ReadVote(const uint256& nParentHash, const uint256& nHash, CGovernanceVote& vote) const;
+    bool ReadVotes(const uint256& nParentHash, std::vector<CGovernanceVote>& vecVotes);
+    bool ReadVoteHashes(const uint256& nParentHash, std::vector<uint256>& vecHashes);
+    /// Erase the votes on nParentHash cast by the masternodes in setMasternodes
+    bool EraseVotesFromMasternodes(const uint256& nParentHash, const std::set<COutPoint>& setMasternodes, int& nErasedRet);
+    bool EraseObjectVotes(const uint256& nParentHash);
+    /// Erase the votes on every object that isn't in setParentHashes
+    bool EraseOrphanedVotes(const std::set<uint256>& setParentHashes);
+};
+
+/** Global governance vote database, NULL until step 6b of AppInit2 */
+extern CGovernanceVoteDB* pgovernancevotedb;
+
 /**
  * Represents the collection of votes associated with a given CGovernanceObject
- * Recently received votes are held in memory until a maximum size is reached after
- * which older votes a flushed to a disk file.
- *
- * Note: This is a stub implementation that doesn't limit the number of votes held
- * in memory and doesn't flush to disk.
+ * All votes are stored in the governance vote database; only the most recently
+ * received ones are held in memory, so memory use doesn't grow with the vote
+ * history. Older versions kept every vote in memory and serialized them into
+ * governance.dat, those are moved to the database by Migrate().
  */
 class CGovernanceObjectVoteFile
 {
@@ -36,9 +66,11 @@ public: // Types
     typedef vote_m_t::const_iterator vote_m_cit;
 
 private:
-    static const int MAX_MEMORY_VOTES = -1;
+    static const size_t MAX_MEMORY_VOTES = 100;
+
+    uint256 nParentHash;
 
-    int nMemoryVotes;
+    int nVoteCount;
 
     vote_l_t listVotes;
 
@@ -49,37 +81,57 @@ public:
 
     CGovernanceObjectVoteFile(const CGovernanceObjectVoteFile& other);
 
+    /**
+     * Set the hash of the object the votes are for, which keys them in the database
+     */
+    void SetParentHash(const uint256& nParentHashIn) {
+        nParentHash = nParentHashIn;
+    }
+
     /**
      * Add a vote to the file
      */
     void AddVote(const CGovernanceVote& vote);
 
     /**
-     * Return true if the vote with this hash is currently cached in memory
+     * Return true if the vote with this hash is in the file
      */
     bool HasVote(const uint256& nHash) const;
 
     /**
-     * Retrieve a vote cached in memory
+     * Retrieve a vote from memory, or from the database if it isn't recent
      */
     bool GetVote(const uint256& nHash, CGovernanceVote& vote) const;
 
     int GetVoteCount() {
-        return nMemoryVotes;
+        return nVoteCount;
     }
 
+    /**
+     * Read all votes from the database
+     */
     std::vector<CGovernanceVote> GetVotes() const;
 
+    std::vector<uint256> GetVoteHashes() const;
+
     CGovernanceObjectVoteFile& operator=(const CGovernanceObjectVoteFile& other);
 
-    void RemoveVotesFromMasternode(const COutPoint& outpointMasternode);
+    void RemoveVotesFromMasternodes(const std::set<COutPoint>& setMasternodes);
+
+    void RemoveAllVotes();
+
+    /**
+     * Write the votes read from an older governance.dat to the database,
+     * recount the votes and return their hashes
+     */
+    std::vector<uint256> Migrate();
 
     ADD_SERIALIZE_METHODS;
 
     template <typename Stream, typename Operation>
     inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
     {
-        READWRITE(nMemoryVotes);
+        READWRITE(nVoteCount);
         READWRITE(listVotes);
         if(ser_action.ForRead()) {
             RebuildIndex();
@@ -88,6 +140,8 @@ public:
 private:
     void RebuildIndex();
 
+    void AddRecentVote(const CGovernanceVote& vote);
+
 };
 
 #endif
@@ -295,6 +295,7 @@ void CGovernanceManager::CheckOrphanVotes(CGovernanceObject& govobj, CGovernance
         }
         if(fRemove) {
             mapOrphanVotes.Erase(nHash, pairVote);
+            journal.Append(JOURNAL_ERASE_ORPHAN_VOTE, std::make_pair(nHash, pairVote));
         }
     }
 }
@@ -350,7 +351,9 @@ void CGovernanceManager::AddGovernanceObject(CGovernanceObject& govobj, CConnman
     }
 
     // INSERT INTO OUR GOVERNANCE OBJECT MEMORY
+    govobj.GetVoteFile().SetParentHash(nHash);
     mapObjects.insert(std::make_pair(nHash, govobj));
+    journal.Append(JOURNAL_GOVERNANCE_OBJECT, govobj);
 
     // SHOULD WE ADD THIS OBJECT TO ANY OTHER MANANGERS?
 
@@ -412,6 +415,7 @@ bool CGovernanceManager::UpdateCurrentWatchdog(CGovernanceObject& watchdogNew)
             if(it->second.nDeletionTime == 0) {
                 it->second.nDeletionTime = nNow;
             }
+            JournalObjectState(it->second);
         }
         nHashWatchdogCurrent = watchdogNew.GetHash();
         nTimeWatchdogCurrent = watchdogNew.GetCreationTime();
@@ -447,6 +451,7 @@ void CGovernanceManager::UpdateCachesAndClean()
                     if(it2->second.nDeletionTime == 0) {
                         it2->second.nDeletionTime = nNow;
                     }
+                    JournalObjectState(it2->second);
                 }
                 if(it->first == nHashWatchdogCurrent) {
                     nHashWatchdogCurrent = uint256();
@@ -539,6 +544,8 @@ void CGovernanceManager::UpdateCachesAndClean()
             }
 
             mapErasedGovernanceObjects.insert(std::make_pair(nHash, nTimeExpired));
+            pObj->GetVoteFile().RemoveAllVotes();
+            journal.Append(JOURNAL_ERASE_GOVERNANCE_OBJECT, std::make_pair(nHash, nTimeExpired));
             mapObjects.erase(it++);
         } else {
             ++it;
@@ -838,6 +845,7 @@ void CGovernanceManager::MasternodeRateUpdate(const CGovernanceObject& govobj)
     }
 
     it->second.fStatusOK = true;
+    journal.Append(JOURNAL_LAST_MASTERNODE_OBJECT, *it);
 }
 
 bool CGovernanceManager::MasternodeRateCheck(const CGovernanceObject& govobj, bool fUpdateFailStatus)
@@ -920,8 +928,10 @@ bool CGovernanceManager::MasternodeRateCheck(const CGovernanceObject& govobj, bo
         LogPrintf("CGovernanceManager::MasternodeRateCheck -- Rate too high: object hash = %s, masternode vin = %s, object timestamp = %d, rate = %f, max rate = %f\n",
                   strHash, vin.prevout.ToStringShort(), nTimestamp, dRate, dMaxRate);
 
-        if (fUpdateFailStatus)
+        if (fUpdateFailStatus) {
             it->second.fStatusOK = false;
+            journal.Append(JOURNAL_LAST_MASTERNODE_OBJECT, *it);
+        }
     }
 
     return fRateOK;
@@ -950,7 +960,9 @@ bool CGovernanceManager::ProcessVote(CNode* pfrom, const CGovernanceVote& vote,
              << ", MN outpoint = " << vote.GetMasternodeOutpoint().ToStringShort()
              << ", governance object hash = " << vote.GetParentHash().ToString();
         exception = CGovernanceException(ostr.str(), GOVERNANCE_EXCEPTION_WARNING);
-        if(mapOrphanVotes.Insert(nHashGovobj, vote_time_pair_t(vote, GetAdjustedTime() + GOVERNANCE_ORPHAN_EXPIRATION_TIME))) {
+        vote_time_pair_t pairVote(vote, GetAdjustedTime() + GOVERNANCE_ORPHAN_EXPIRATION_TIME);
+        if(mapOrphanVotes.Insert(nHashGovobj, pairVote)) {
+            journal.Append(JOURNAL_ORPHAN_VOTE, std::make_pair(nHashGovobj, pairVote));
             LEAVE_CRITICAL_SECTION(cs);
             RequestGovernanceObject(pfrom, nHashGovobj, connman);
             LogPrintf("%s\n", ostr.str());
@@ -1121,10 +1133,10 @@ void CGovernanceManager::RequestGovernanceObject(CNode* pfrom, const uint256& nH
 
         if(pObj) {
             filter = CBloomFilter(Params().GetConsensus().nGovernanceFilterElements, GOVERNANCE_FILTER_FP_RATE, GetRandInt(999999), BLOOM_UPDATE_ALL);
-            std::vector<CGovernanceVote> vecVotes = pObj->GetVoteFile().GetVotes();
-            nVoteCount = vecVotes.size();
-            for(size_t i = 0; i < vecVotes.size(); ++i) {
-                filter.insert(vecVotes[i].GetHash());
+            std::vector<uint256> vecVoteHashes = pObj->GetVoteFile().GetVoteHashes();
+            nVoteCount = vecVoteHashes.size();
+            for(size_t i = 0; i < vecVoteHashes.size(); ++i) {
+                filter.insert(vecVoteHashes[i]);
             }
         }
     }
@@ -1270,12 +1282,18 @@ bool CGovernanceManager::AcceptMessage(const uint256& nHash, hash_s_t& setHash)
 void CGovernanceManager::RebuildIndexes()
 {
     mapVoteToObject.Clear();
+    std::set<uint256> setObjectHashes;
     for(object_m_it it = mapObjects.begin(); it != mapObjects.end(); ++it) {
         CGovernanceObject& govobj = it->second;
-        std::vector<CGovernanceVote> vecVotes = govobj.GetVoteFile().GetVotes();
-        for(size_t i = 0; i < vecVotes.size(); ++i) {
-            mapVoteToObject.Insert(vecVotes[i].GetHash(), &govobj);
+        std::vector<uint256> vecVoteHashes = govobj.GetVoteFile().Migrate();
+        for(size_t i = 0; i < vecVoteHashes.size(); ++i) {
+            mapVoteToObject.Insert(vecVoteHashes[i], &govobj);
         }
+        setObjectHashes.insert(it->first);
+    }
+    // votes on objects erased or cleared before the cache was last saved
+    if(!pgovernancevotedb->EraseOrphanedVotes(setObjectHashes)) {
+        LogPrintf("CGovernanceManager::RebuildIndexes -- failed to erase votes on unknown objects\n");
     }
 }
 
@@ -1294,6 +1312,118 @@ void CGovernanceManager::AddCachedTriggers()
     }
 }
 
+bool CGovernanceManager::ApplyJournalRecord(CDataStream& ssRecord)
+{
+    LOCK(cs);
+
+    unsigned char nType;
+    ssRecord >> nType;
+    switch(nType) {
+    case JOURNAL_CLEAR:
+        mapObjects.clear();
+        mapErasedGovernanceObjects.clear();
+        mapWatchdogObjects.clear();
+        nHashWatchdogCurrent = uint256();
+        nTimeWatchdogCurrent = 0;
+        mapInvalidVotes.Clear();
+        mapOrphanVotes.Clear();
+        mapLastMasternodeObject.clear();
+        return true;
+    case JOURNAL_GOVERNANCE_OBJECT: {
+        // the object passed the checks of AddGovernanceObject when it was logged
+        CGovernanceObject govobj;
+        ssRecord >> govobj;
+        uint256 nHash = govobj.GetHash();
+        if(mapObjects.count(nHash)) return true;
+        CGovernanceObject& govobjNew = mapObjects.insert(std::make_pair(nHash, govobj)).first->second;
+        if(govobjNew.GetObjectType() == GOVERNANCE_OBJECT_WATCHDOG) {
+            mapWatchdogObjects[nHash] = govobjNew.GetCreationTime() + GOVERNANCE_WATCHDOG_EXPIRATION_TIME;
+            UpdateCurrentWatchdog(govobjNew);
+        }
+        return true;
+    }
+    case JOURNAL_GOVERNANCE_VOTE: {
+        CGovernanceVote vote;
+        ssRecord >> vote;
+        object_m_it it = mapObjects.find(vote.GetParentHash());
+        if(it != mapObjects.end()) {
+            it->second.RestoreVote(vote);
+        }
+        return true;
+    }
+    case JOURNAL_ERASE_GOVERNANCE_OBJECT: {
+        std::pair<uint256, int64_t> pairErased;
+        ssRecord >> pairErased;
+        const uint256& nHash = pairErased.first;
+        mapObjects.erase(nHash);
+        mapWatchdogObjects.erase(nHash);
+        if(nHash == nHashWatchdogCurrent) {
+            nHashWatchdogCurrent = uint256();
+        }
+        mapErasedGovernanceObjects.insert(pairErased);
+        return true;
+    }
+    case JOURNAL_INVALID_VOTE: {
+        CGovernanceVote vote;
+        ssRecord >> vote;
+        mapInvalidVotes.Insert(vote.GetHash(), vote);
+        return true;
+    }
+    case JOURNAL_ORPHAN_VOTE: {
+        std::pair<uint256, vote_time_pair_t> pairOrphan;
+        ssRecord >> pairOrphan;
+        mapOrphanVotes.Insert(pairOrphan.first, pairOrphan.second);
+        return true;
+    }
+    case JOURNAL_ERASE_ORPHAN_VOTE: {
+        std::pair<uint256, vote_time_pair_t> pairOrphan;
+        ssRecord >> pairOrphan;
+        mapOrphanVotes.Erase(pairOrphan.first, pairOrphan.second);
+        return true;
+    }
+    case JOURNAL_LAST_MASTERNODE_OBJECT: {
+        std::pair<COutPoint, last_object_rec> pairLast;
+        ssRecord >> pairLast;
+        mapLastMasternodeObject[pairLast.first] = pairLast.second;
+        return true;
+    }
+    case JOURNAL_GOVERNANCE_OBJECT_STATE: {
+        uint256 nHash;
+        int64_t nDeletionTime;
+        bool fExpired;
+        ssRecord >> nHash >> nDeletionTime >> fExpired;
+        object_m_it it = mapObjects.find(nHash);
+        if(it != mapObjects.end()) {
+            it->second.nDeletionTime = nDeletionTime;
+            it->second.fExpired = fExpired;
+        }
+        return true;
+    }
+    case JOURNAL_CLEAR_MASTERNODE_VOTES: {
+        uint256 nHash;
+        std::set<COutPoint> setRemoved;
+        ssRecord >> nHash >> setRemoved;
+        object_m_it it = mapObjects.find(nHash);
+        if(it != mapObjects.end()) {
+            BOOST_FOREACH(const COutPoint& outpoint, setRemoved) {
+                it->second.mapCurrentMNVotes.erase(outpoint);
+            }
+            it->second.fDirtyCache = true;
+        }
+        return true;
+    }
+    }
+    return false;
+}
+
+void CGovernanceManager::JournalObjectState(const CGovernanceObject& govobj)
+{
+    if(!journal.IsOpen()) return;
+    CDataStream ssRecord(SER_DISK, CLIENT_VERSION);
+    ssRecord << (unsigned char)JOURNAL_GOVERNANCE_OBJECT_STATE << govobj.GetHash() << govobj.nDeletionTime << govobj.fExpired;
+    journal.Append(ssRecord);
+}
+
 void CGovernanceManager::InitOnLoad()
 {
     LOCK(cs);
@@ -1402,6 +1532,7 @@ void CGovernanceManager::CleanOrphanObjects()
         ++it;
         const vote_time_pair_t& pairVote = prevIt->value;
         if(pairVote.second < nNow) {
+            journal.Append(JOURNAL_ERASE_ORPHAN_VOTE, std::make_pair(prevIt->key, prevIt->value));
             mapOrphanVotes.Erase(prevIt->key, prevIt->value);
         }
     }
@@ -11,6 +11,7 @@
 #include "cachemap.h"
 #include "cachemultimap.h"
 #include "chain.h"
+#include "flat-database.h"
 #include "governance-exceptions.h"
 #include "governance-object.h"
 #include "governance-vote.h"
@@ -144,7 +145,7 @@ public:
 //
 // Governance Manager : Contains all proposals for the budget
 //
-class CGovernanceManager
+class CGovernanceManager : public CFlatDBJournaledCache
 {
     friend class CGovernanceObject;
 
@@ -219,6 +220,20 @@ public: // Types
     typedef hash_time_m_t::const_iterator hash_time_m_cit;
 
 private:
+    // Changes logged to the governance.dat journal
+    enum JournalRecordType {
+        JOURNAL_CLEAR = 0,
+        JOURNAL_GOVERNANCE_OBJECT = 1,
+        JOURNAL_GOVERNANCE_VOTE = 2,
+        JOURNAL_ERASE_GOVERNANCE_OBJECT = 3,
+        JOURNAL_INVALID_VOTE = 4,
+        JOURNAL_ORPHAN_VOTE = 5,
+        JOURNAL_ERASE_ORPHAN_VOTE = 6,
+        JOURNAL_LAST_MASTERNODE_OBJECT = 7,
+        JOURNAL_GOVERNANCE_OBJECT_STATE = 8,
+        JOURNAL_CLEAR_MASTERNODE_VOTES = 9
+    };
+
     static const int MAX_CACHE_SIZE = 1000000;
 
     static const std::string SERIALIZATION_VERSION_STRING;
@@ -334,8 +349,11 @@ public:
         mapInvalidVotes.Clear();
         mapOrphanVotes.Clear();
         mapLastMasternodeObject.clear();
+        journal.Append(JOURNAL_CLEAR);
     }
 
+    bool ApplyJournalRecord(CDataStream& ssRecord) override;
+
     std::string ToString() const;
 
     ADD_SERIALIZE_METHODS;
@@ -393,6 +411,9 @@ public:
 
     void AddSeenVote(uint256 nHash, int status);
 
+    // Log the deletion time and expiration flag after they changed
+    void JournalObjectState(const CGovernanceObject& govobj);
+
     void MasternodeRateUpdate(const CGovernanceObject& govobj);
 
     bool MasternodeRateCheck(const CGovernanceObject& govobj, bool fUpdateFailStatus = false);
@@ -429,11 +450,15 @@ private:
     void AddInvalidVote(const CGovernanceVote& vote)
     {
         mapInvalidVotes.Insert(vote.GetHash(), vote);
+        journal.Append(JOURNAL_INVALID_VOTE, vote);
     }
 
     void AddOrphanVote(const CGovernanceVote& vote)
     {
-        mapOrphanVotes.Insert(vote.GetHash(), vote_time_pair_t(vote, GetAdjustedTime() + GOVERNANCE_ORPHAN_EXPIRATION_TIME));
+        vote_time_pair_t pairVote(vote, GetAdjustedTime() + GOVERNANCE_ORPHAN_EXPIRATION_TIME);
+        if(mapOrphanVotes.Insert(vote.GetHash(), pairVote)) {
+            journal.Append(JOURNAL_ORPHAN_VOTE, std::make_pair(vote.GetHash(), pairVote));
+        }
     }
 
     bool ProcessVote(CNode* pfrom, const CGovernanceVote& vote, CGovernanceException& exception, CConnman& connman);
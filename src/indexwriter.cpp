@@ -0,0 +1,238 @@
+// Copyright (c) 2014-2017 The Dune Spice developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "indexwriter.h"
+#include "reverselock.h"
+#include "txdb.h"
+#include "util.h"
+#include "utiltime.h"
+#include "validation.h"
+
+#include <boost/bind.hpp>
+
+CIndexWriter* pIndexWriter = NULL;
+
+// Returns 2 for P2SH, 1 for P2PKH and 0 for scripts the address index doesn't know about
+static int GetAddressType(const CScript& script, uint160& hashBytes)
+{
+    if (script.IsPayToScriptHash()) {
+        hashBytes = uint160(std::vector<unsigned char>(script.begin()+2, script.begin()+22));
+        return 2;
+    } else if (script.IsPayToPublicKeyHash()) {
+        hashBytes = uint160(std::vector<unsigned char>(script.begin()+3, script.begin()+23));
+        return 1;
+    }
+    hashBytes.SetNull();
+    return 0;
+}
+
+void GetIndexUpdates(const CBlock& block, const CBlockUndo& blockundo, int nHeight, bool fConnect, CIndexUpdates& updates)
+{
+    updates.fEraseAddressIndex = !fConnect;
+
+    if (fTimestampIndex && fConnect)
+        updates.timestampIndex.push_back(CTimestampIndexKey(block.nTime, block.GetHash()));
+
+    if (!fAddressIndex && !fSpentIndex)
+        return;
+
+    // Disconnecting undoes the transactions in reverse order, so an output
+    // spent inside the block is restored before its creation is undone
+    for (size_t n = 0; n < block.vtx.size(); n++) {
+        const int i = fConnect ? n : block.vtx.size() - 1 - n;
+        const CTransaction& tx = *block.vtx[i];
+        const uint256 txhash = tx.GetHash();
+
+        if (!fConnect && fAddressIndex) {
+            for (unsigned int k = tx.vout.size(); k-- > 0;) {
+                uint160 hashBytes;
+                int addressType = GetAddressType(tx.vout[k].scriptPubKey, hashBytes);
+                if (addressType == 0)
+                    continue;
+                // undo receiving activity and the unspent output
+                updates.addressIndex.push_back(std::make_pair(CAddressIndexKey(addressType, hashBytes, nHeight, i, txhash, k, false), tx.vout[k].nValue));
+                updates.addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(addressType, hashBytes, txhash, k), CAddressUnspentValue()));
+            }
+        }
+
+        if (i > 0) {
+            const CTxUndo& txundo = blockundo.vtxundo[i-1];
+            for (size_t n2 = 0; n2 < tx.vin.size(); n2++) {
+                const unsigned int j = fConnect ? n2 : tx.vin.size() - 1 - n2;
+                const COutPoint& prevout = tx.vin[j].prevout;
+                const Coin& coin = txundo.vprevout[j];
+                uint160 hashBytes;
+                int addressType = GetAddressType(coin.out.scriptPubKey, hashBytes);
+
+                if (fAddressIndex && addressType > 0) {
+                    // record (or undo) spending activity
+                    updates.addressIndex.push_back(std::make_pair(CAddressIndexKey(addressType, hashBytes, nHeight, i, txhash, j, true), coin.out.nValue * -1));
+                    // remove (or restore) the output in the unspent index
+                    if (fConnect)
+                        updates.addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(addressType, hashBytes, prevout.hash, prevout.n), CAddressUnspentValue()));
+                    else
+                        updates.addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(addressType, hashBytes, prevout.hash, prevout.n), CAddressUnspentValue(coin.out.nValue, coin.out.scriptPubKey, coin.nHeight)));
+                }
+
+                if (fSpentIndex) {
+                    // the txid and input that spent an output, and the amount and address of the input
+                    if (fConnect)
+                        updates.spentIndex.push_back(std::make_pair(CSpentIndexKey(prevout.hash, prevout.n), CSpentIndexValue(txhash, j, nHeight, coin.out.nValue, addressType, hashBytes)));
+                    else
+                        updates.spentIndex.push_back(std::make_pair(CSpentIndexKey(prevout.hash, prevout.n), CSpentIndexValue()));
+                }
+            }
+        }
+
+        if (fConnect && fAddressIndex) {
+            for (unsigned int k = 0; k < tx.vout.size(); k++) {
+                uint160 hashBytes;
+                int addressType = GetAddressType(tx.vout[k].scriptPubKey, hashBytes);
+                if (addressType == 0)
+                    continue;
+                // record receiving activity and the unspent output
+                updates.addressIndex.push_back(std::make_pair(CAddressIndexKey(addressType, hashBytes, nHeight, i, txhash, k, false), tx.vout[k].nValue));
+                updates.addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(addressType, hashBytes, txhash, k), CAddressUnspentValue(tx.vout[k].nValue, tx.vout[k].scriptPubKey, nHeight)));
+            }
+        }
+    }
+}
+
+CIndexWriter::CIndexWriter(CBlockTreeDB* pblocktreedbIn) :
+    pblocktreedb(pblocktreedbIn),
+    nQueued(0),
+    nWritten(0),
+    nFlushRequests(0),
+    fFailed(false),
+    fStop(false),
+    fMigrating(false)
+{
+    thread = boost::thread(boost::bind(&CIndexWriter::ThreadWrite, this));
+}
+
+CIndexWriter::~CIndexWriter()
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        fStop = true;
+    }
+    condWork.notify_all();
+    thread.join();
+}
+
+bool CIndexWriter::Enqueue(const CBlock& block, CBlockUndo&& blockundo, int nHeight, bool fConnect, const uint256& hashIndexed)
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        while (!fFailed && dequeJobs.size() >= MAX_QUEUED_BLOCKS)
+            condDone.wait(lock);
+        if (fFailed)
+            return false;
+        dequeJobs.push_back(job_t());
+        job_t& job = dequeJobs.back();
+        job.block = block;
+        job.blockundo = std::move(blockundo);
+        job.nHeight = nHeight;
+        job.fConnect = fConnect;
+        job.hashIndexed = hashIndexed;
+        nQueued++;
+    }
+    condWork.notify_all();
+    return true;
+}
+
+bool CIndexWriter::Connect(const CBlock& block, CBlockUndo&& blockundo, const CBlockIndex* pindex)
+{
+    return Enqueue(block, std::move(blockundo), pindex->nHeight, true, pindex->GetBlockHash());
+}
+
+bool CIndexWriter::Disconnect(const CBlock& block, CBlockUndo&& blockundo, const CBlockIndex* pindex)
+{
+    return Enqueue(block, std::move(blockundo), pindex->nHeight, false, pindex->pprev->GetBlockHash());
+}
+
+bool CIndexWriter::Flush()
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    uint64_t nTarget = nQueued;
+    nFlushRequests++;
+    condWork.notify_all();
+    while (!fFailed && nWritten < nTarget)
+        condDone.wait(lock);
+    nFlushRequests--;
+    return !fFailed;
+}
+
+void CIndexWriter::StartMigration()
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        fMigrating = true;
+    }
+    condWork.notify_all();
+}
+
+void CIndexWriter::ThreadWrite()
+{
+    RenameThread("spice-indexwriter");
+
+    boost::unique_lock<boost::mutex> lock(mutex);
+    while (true) {
+        while (!fStop && dequeJobs.empty()) {
+            if (!fMigrating) {
+                condWork.wait(lock);
+                continue;
+            }
+            // Blocks queued meanwhile wait for at most one migration batch
+            bool fDone = false;
+            {
+                reverse_lock<boost::unique_lock<boost::mutex> > unlock(lock);
+                if (!pblocktreedb->MigrateAddressIndex(MIGRATE_BATCH_ENTRIES, fDone)) {
+                    LogPrintf("%s: failed to convert the address index, continuing with both formats\n", __func__);
+                    fDone = true;
+                }
+            }
+            fMigrating = !fDone;
+        }
+        if (dequeJobs.empty())
+            return;
+
+        // Give the next blocks a chance to end up in the same batch
+        boost::system_time deadline = boost::get_system_time() + boost::posix_time::milliseconds(BATCH_DELAY_MS);
+        while (!fStop && nFlushRequests == 0 && dequeJobs.size() < MAX_BATCH_BLOCKS && condWork.timed_wait(lock, deadline)) {}
+
+        // A disconnect never follows a connect in the same batch: rolling
+        // back an address balance needs the database to have every block
+        // below the disconnected one
+        std::vector<job_t> vJobs;
+        bool fHaveConnect = false;
+        while (!dequeJobs.empty() && vJobs.size() < MAX_BATCH_BLOCKS && !(fHaveConnect && !dequeJobs.front().fConnect)) {
+            fHaveConnect |= dequeJobs.front().fConnect;
+            vJobs.push_back(std::move(dequeJobs.front()));
+            dequeJobs.pop_front();
+        }
+        size_t nJobs = vJobs.size();
+
+        bool fOk;
+        {
+            reverse_lock<boost::unique_lock<boost::mutex> > unlock(lock);
+            int64_t nStart = GetTimeMicros();
+            std::vector<CIndexUpdates> vUpdates(vJobs.size());
+            for (size_t i = 0; i < vJobs.size(); i++)
+                GetIndexUpdates(vJobs[i].block, vJobs[i].blockundo, vJobs[i].nHeight, vJobs[i].fConnect, vUpdates[i]);
+            fOk = pblocktreedb->WriteIndexUpdates(vUpdates, vJobs.back().hashIndexed);
+            LogPrint("bench", "Index writer: wrote %u blocks in %.2fms\n", vJobs.size(), 0.001 * (GetTimeMicros() - nStart));
+        }
+
+        if (!fOk) {
+            LogPrintf("*** %s: failed to write the address, spent and timestamp indexes\n", __func__);
+            fFailed = true;
+            dequeJobs.clear();
+        }
+        nWritten += nJobs;
+        condDone.notify_all();
+        if (fFailed)
+            return;
+    }
+}
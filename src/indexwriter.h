@@ -0,0 +1,95 @@
+// Copyright (c) 2014-2017 The Dune Spice developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef INDEXWRITER_H
+#define INDEXWRITER_H
+
+#include "chain.h"
+#include "coins.h"
+#include "primitives/block.h"
+#include "undo.h"
+
+#include <deque>
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+class CBlockTreeDB;
+struct CIndexUpdates;
+
+/** Compute the -addressindex, -spentindex and -timestampindex changes of connecting (or disconnecting) block at nHeight */
+void GetIndexUpdates(const CBlock& block, const CBlockUndo& blockundo, int nHeight, bool fConnect, CIndexUpdates& updates);
+
+/**
+ * Writes the address, spent and timestamp indexes on a background thread.
+ *
+ * ConnectBlock and DisconnectBlock only queue the block and its undo data;
+ * the writer computes the index entries and writes the changes of several
+ * blocks in one LevelDB batch, together with the hash of the block the
+ * indexes are up to date with. ReplayIndexUpdates() brings the indexes back
+ * in line with the chain tip on startup if they weren't. While there is
+ * nothing to write it converts the address index to the compact format.
+ */
+class CIndexWriter
+{
+private:
+    struct job_t {
+        CBlock block;
+        CBlockUndo blockundo;
+        int nHeight;
+        bool fConnect;
+        uint256 hashIndexed; // the indexes are up to date with this block once the job is written
+    };
+
+    //! Maximum number of blocks waiting to be written before Connect/Disconnect block
+    static const size_t MAX_QUEUED_BLOCKS = 256;
+    //! Maximum number of blocks written in one batch
+    static const size_t MAX_BATCH_BLOCKS = 64;
+    //! How long to wait for more blocks before writing a partial batch
+    static const int BATCH_DELAY_MS = 100;
+    //! Address index entries converted to the compact format per batch while idle
+    static const size_t MIGRATE_BATCH_ENTRIES = 10000;
+
+    CIndexWriter(const CIndexWriter&);
+    CIndexWriter& operator=(const CIndexWriter&);
+
+    CBlockTreeDB* pblocktreedb;
+
+    boost::mutex mutex;
+    boost::condition_variable condWork;
+    boost::condition_variable condDone;
+
+    std::deque<job_t> dequeJobs;
+    uint64_t nQueued; // jobs ever queued
+    uint64_t nWritten; // jobs ever written
+    int nFlushRequests;
+    bool fFailed;
+    bool fStop;
+    bool fMigrating; // convert address index entries while there is nothing to write
+
+    boost::thread thread;
+
+    void ThreadWrite();
+    bool Enqueue(const CBlock& block, CBlockUndo&& blockundo, int nHeight, bool fConnect, const uint256& hashIndexed);
+
+public:
+    explicit CIndexWriter(CBlockTreeDB* pblocktreedbIn);
+    /// Writes whatever is still queued, then joins the thread
+    ~CIndexWriter();
+
+    /// Queue the index changes of connecting block at pindex, returns false if a previous write failed
+    bool Connect(const CBlock& block, CBlockUndo&& blockundo, const CBlockIndex* pindex);
+    /// Queue the index changes of disconnecting block at pindex, returns false if a previous write failed
+    bool Disconnect(const CBlock& block, CBlockUndo&& blockundo, const CBlockIndex* pindex);
+    /// Wait until everything queued so far is written, returns false if a write failed
+    bool Flush();
+    /// Convert the address index to the compact format whenever there is nothing to write
+    void StartMigration();
+};
+
+/** Global index writer for pblocktree, NULL if none of the indexes are enabled */
+extern CIndexWriter* pIndexWriter;
+
+#endif
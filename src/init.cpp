@@ -13,13 +13,17 @@
 #include "addrman.h"
 #include "amount.h"
 #include "base58.h"
+#include "blockfilemap.h"
+#include "blockservecache.h"
 #include "chain.h"
 #include "chainparams.h"
 #include "checkpoints.h"
+#include "coinsprefetch.h"
 #include "compat/sanity.h"
 #include "consensus/validation.h"
 #include "httpserver.h"
 #include "httprpc.h"
+#include "indexwriter.h"
 #include "key.h"
 #include "validation.h"
 #include "miner.h"
@@ -50,11 +54,13 @@
 #include "dsnotificationinterface.h"
 #include "flat-database.h"
 #include "governance.h"
+#include "governance-votedb.h"
 #include "instantx.h"
 #ifdef ENABLE_WALLET
 #include "keepass.h"
 #endif
 #include "masternode-payments.h"
+#include "masternode-sigqueue.h"
 #include "masternode-sync.h"
 #include "masternodeman.h"
 #include "masternodeconfig.h"
@@ -237,6 +243,11 @@ void PrepareShutdown()
     MapPort(false);
     UnregisterValidationInterface(peerLogic.get());
     peerLogic.reset();
+    if (pblocktemplatecache) {
+        UnregisterValidationInterface(pblocktemplatecache);
+        delete pblocktemplatecache;
+        pblocktemplatecache = NULL;
+    }
     g_connman.reset();
 
     // STORE DATA CACHES INTO SERIALIZED DAT FILES
@@ -248,6 +259,8 @@ void PrepareShutdown()
     flatdb3.Dump(governance);
     CFlatDB<CNetFulfilledRequestManager> flatdb4("netfulfilled.dat", "magicFulfilledCache");
     flatdb4.Dump(netfulfilledman);
+    delete pgovernancevotedb;
+    pgovernancevotedb = NULL;
 
     UnregisterNodeSignals(GetNodeSignals());
 
@@ -267,6 +280,10 @@ void PrepareShutdown()
         if (pcoinsTip != NULL) {
             FlushStateToDisk();
         }
+        delete pcoinsPrefetcher;
+        pcoinsPrefetcher = NULL;
+        delete pIndexWriter;
+        pIndexWriter = NULL;
         delete pcoinsTip;
         pcoinsTip = NULL;
         delete pcoinscatcher;
@@ -394,6 +411,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-version", _("Print version and exit"));
     strUsage += HelpMessageOpt("-alerts", strprintf(_("Receive and display P2P network alerts (default: %u)"), DEFAULT_ALERTS));
     strUsage += HelpMessageOpt("-alertnotify=<cmd>", _("Execute command when a relevant alert is received or we see a really long fork (%s in cmd is replaced by message)"));
+    strUsage += HelpMessageOpt("-blockmmap=<n>", strprintf(_("Read blocks from up to <n> memory mapped block files, 0 = disabled (default: %d)"), DEFAULT_BLOCKFILEMAPS));
     strUsage += HelpMessageOpt("-blocknotify=<cmd>", _("Execute command when the best block changes (%s in cmd is replaced by block hash)"));
     if (showDebug)
         strUsage += HelpMessageOpt("-blocksonly", strprintf(_("Whether to operate in a blocks only mode (default: %u)"), DEFAULT_BLOCKSONLY));
@@ -413,6 +431,8 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-mempoolexpiry=<n>", strprintf(_("Do not keep transactions in the mempool longer than <n> hours (default: %u)"), DEFAULT_MEMPOOL_EXPIRY));
     strUsage += HelpMessageOpt("-par=<n>", strprintf(_("Set the number of script verification threads (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)"),
         -GetNumCores(), MAX_SCRIPTCHECK_THREADS, DEFAULT_SCRIPTCHECK_THREADS));
+    strUsage += HelpMessageOpt("-prefetchthreads=<n>", strprintf(_("Set the number of threads reading the coins of blocks about to be connected ahead of time (0 to %d, 0 = disabled, default: %d)"),
+        MAX_PREFETCH_THREADS, DEFAULT_PREFETCH_THREADS));
 #ifndef WIN32
     strUsage += HelpMessageOpt("-pid=<file>", strprintf(_("Specify pid file (default: %s)"), BITCOIN_PID_FILENAME));
 #endif
@@ -446,6 +466,8 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-maxconnections=<n>", strprintf(_("Maintain at most <n> connections to peers (temporary service connections excluded) (default: %u)"), DEFAULT_MAX_PEER_CONNECTIONS));
     strUsage += HelpMessageOpt("-maxreceivebuffer=<n>", strprintf(_("Maximum per-connection receive buffer, <n>*1000 bytes (default: %u)"), DEFAULT_MAXRECEIVEBUFFER));
     strUsage += HelpMessageOpt("-maxsendbuffer=<n>", strprintf(_("Maximum per-connection send buffer, <n>*1000 bytes (default: %u)"), DEFAULT_MAXSENDBUFFER));
+    strUsage += HelpMessageOpt("-msghandthreads=<n>", strprintf(_("Set the number of threads processing peer messages, every peer is served by one of them (1 to %d, default: %d)"),
+        MAX_MSGHAND_THREADS, DEFAULT_MSGHAND_THREADS));
     strUsage += HelpMessageOpt("-onion=<ip:port>", strprintf(_("Use separate SOCKS5 proxy to reach peers via Tor hidden services (default: %s)"), "-proxy"));
     strUsage += HelpMessageOpt("-onlynet=<net>", _("Only connect to nodes in network <net> (ipv4, ipv6 or onion)"));
     strUsage += HelpMessageOpt("-permitbaremultisig", strprintf(_("Relay non-P2SH multisig (default: %u)"), DEFAULT_PERMIT_BAREMULTISIG));
@@ -456,6 +478,8 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-proxy=<ip:port>", _("Connect through SOCKS5 proxy"));
     strUsage += HelpMessageOpt("-proxyrandomize", strprintf(_("Randomize credentials for every proxy connection. This enables Tor stream isolation (default: %u)"), DEFAULT_PROXYRANDOMIZE));
     strUsage += HelpMessageOpt("-seednode=<ip>", _("Connect to a node to retrieve peer addresses, and disconnect"));
+    strUsage += HelpMessageOpt("-socketevents=<mode>", strprintf(_("Socket events mode, which must be one of: %s (default: %s)"),
+        GetSupportedSocketEventsModes(), GetSocketEventsModeName(DEFAULT_SOCKETEVENTS)));
     strUsage += HelpMessageOpt("-timeout=<n>", strprintf(_("Specify connection timeout in milliseconds (minimum: 1, default: %d)"), DEFAULT_CONNECT_TIMEOUT));
     strUsage += HelpMessageOpt("-torcontrol=<ip>:<port>", strprintf(_("Tor control port to use if onion listening enabled (default: %s)"), DEFAULT_TOR_CONTROL));
     strUsage += HelpMessageOpt("-torpassword=<pass>", _("Tor control port password (default: empty)"));
@@ -472,6 +496,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-whitelistrelay", strprintf(_("Accept relayed transactions received from whitelisted peers even when not relaying transactions (default: %d)"), DEFAULT_WHITELISTRELAY));
     strUsage += HelpMessageOpt("-whitelistforcerelay", strprintf(_("Force relay of transactions from whitelisted peers even they violate local relay policy (default: %d)"), DEFAULT_WHITELISTFORCERELAY));
     strUsage += HelpMessageOpt("-maxuploadtarget=<n>", strprintf(_("Tries to keep outbound traffic under the given target (in MiB per 24h), 0 = no limit (default: %d)"), DEFAULT_MAX_UPLOAD_TARGET));
+    strUsage += HelpMessageOpt("-blockservecache=<n>", strprintf(_("Keep recently requested blocks ready to send to peers, in megabytes, 0 = disabled (default: %d)"), DEFAULT_BLOCKSERVECACHE));
 
 #ifdef ENABLE_WALLET
     strUsage += HelpMessageGroup(_("Wallet options:"));
@@ -546,7 +571,7 @@ std::string HelpMessage(HelpMessageMode mode)
         strUsage += HelpMessageOpt("-limitdescendantcount=<n>", strprintf("Do not accept transactions if any ancestor would have <n> or more in-mempool descendants (default: %u)", DEFAULT_DESCENDANT_LIMIT));
         strUsage += HelpMessageOpt("-limitdescendantsize=<n>", strprintf("Do not accept transactions if any ancestor would have more than <n> kilobytes of in-mempool descendants (default: %u).", DEFAULT_DESCENDANT_SIZE_LIMIT));
     }
-    string debugCategories = "addrman, alert, bench, coindb, db, http, leveldb, libevent, lock, mempool, mempoolrej, net, proxy, prune, rand, reindex, rpc, selectcoins, tor, zmq, "
+    string debugCategories = "addrman, alert, bench, cmpctblock, coindb, db, http, leveldb, libevent, lock, mempool, mempoolrej, net, proxy, prune, rand, reindex, rpc, selectcoins, tor, zmq, "
                              "spice (or specifically: gobject, instantsend, keepass, masternode, mnpayments, mnsync, privatesend, spork)"; // Don't translate these and qt below
     if (mode == HMM_BITCOIN_QT)
         debugCategories += ", qt";
@@ -566,7 +591,7 @@ std::string HelpMessage(HelpMessageMode mode)
         strUsage += HelpMessageOpt("-mocktime=<n>", "Replace actual time with <n> seconds since epoch (default: 0)");
         strUsage += HelpMessageOpt("-limitfreerelay=<n>", strprintf("Continuously rate-limit free transactions to <n>*1000 bytes per minute (default: %u)", DEFAULT_LIMITFREERELAY));
         strUsage += HelpMessageOpt("-relaypriority", strprintf("Require high priority for relaying free or low-fee transactions (default: %u)", DEFAULT_RELAYPRIORITY));
-        strUsage += HelpMessageOpt("-maxsigcachesize=<n>", strprintf("Limit size of signature cache to <n> MiB (default: %u)", DEFAULT_MAX_SIG_CACHE_SIZE));
+        strUsage += HelpMessageOpt("-maxsigcachesize=<n>", strprintf("Limit sum of signature cache and script execution cache sizes to <n> MiB (default: %u)", DEFAULT_MAX_SIG_CACHE_SIZE));
     }
     strUsage += HelpMessageOpt("-minrelaytxfee=<amt>", strprintf(_("Fees (in %s/kB) smaller than this are considered zero fee for relaying, mining and transaction creation (default: %s)"),
         CURRENCY_UNIT, FormatMoney(DEFAULT_MIN_RELAY_TX_FEE)));
@@ -588,6 +613,8 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-mnconf=<file>", strprintf(_("Specify masternode configuration file (default: %s)"), "masternode.conf"));
     strUsage += HelpMessageOpt("-mnconflock=<n>", strprintf(_("Lock masternodes from masternode configuration file (default: %u)"), 1));
     strUsage += HelpMessageOpt("-masternodeprivkey=<n>", _("Set the masternode private key"));
+    strUsage += HelpMessageOpt("-mnsigthreads=<n>", strprintf(_("Set the number of threads verifying masternode message signatures (0 to %d, 0 = verify on the message handler thread, default: %d)"),
+        MAX_MASTERNODE_SIGCHECK_THREADS, DEFAULT_MASTERNODE_SIGCHECK_THREADS));
 
 #ifdef ENABLE_WALLET
     strUsage += HelpMessageGroup(_("PrivateSend options:"));
@@ -720,6 +747,43 @@ void CleanupBlockRevFiles()
     }
 }
 
+/** Read one of the flat database caches without checking it against the chain, see step 11b */
+template<typename T>
+static void ThreadLoadCache(std::string strFilename, std::string strMagicMessage, T* pobj, bool* pfLoaded)
+{
+    RenameThread("spice-loadcache");
+    CFlatDB<T> flatdb(strFilename, strMagicMessage);
+    *pfLoaded = flatdb.Load(*pobj, false);
+}
+
+/** Rewrite the payments and governance caches whose journals grew too large */
+static void CompactFlatDBCaches()
+{
+    CFlatDB<CMasternodePayments>("mnpayments.dat", "magicMasternodePaymentsCache").Compact(mnpayments);
+    CFlatDB<CGovernanceManager>("governance.dat", "magicGovernanceCache").Compact(governance);
+}
+
+/** The threads reading the flat database caches, joined on every way out of AppInit2 */
+struct CCacheLoadThreads
+{
+    boost::thread_group threads;
+    bool fJoined;
+    bool fMasternodesLoaded;
+    bool fPaymentsLoaded;
+    bool fGovernanceLoaded;
+    bool fFulfilledLoaded;
+
+    CCacheLoadThreads() : fJoined(false), fMasternodesLoaded(false), fPaymentsLoaded(false), fGovernanceLoaded(false), fFulfilledLoaded(false) {}
+    ~CCacheLoadThreads() { Join(); }
+
+    void Join()
+    {
+        if (!fJoined)
+            threads.join_all();
+        fJoined = true;
+    }
+};
+
 void ThreadImport(std::vector<boost::filesystem::path> vImportFiles)
 {
     const CChainParams& chainparams = Params();
@@ -1036,8 +1100,14 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     int nUserMaxConnections = GetArg("-maxconnections", DEFAULT_MAX_PEER_CONNECTIONS);
     int nMaxConnections = std::max(nUserMaxConnections, 0);
 
+    SocketEventsMode socketEventsMode = DEFAULT_SOCKETEVENTS;
+    if (mapArgs.count("-socketevents") && !ParseSocketEventsMode(GetArg("-socketevents", ""), socketEventsMode))
+        return InitError(strprintf(_("Invalid -socketevents ('%s') specified. Only these modes are supported: %s"), GetArg("-socketevents", ""), GetSupportedSocketEventsModes()));
+
     // Trim requested connection counts, to fit into system limitations
-    nMaxConnections = std::max(std::min(nMaxConnections, (int)(FD_SETSIZE - nBind - MIN_CORE_FILEDESCRIPTORS)), 0);
+    // (epoll is not limited by FD_SETSIZE, only by the file descriptor limit below)
+    if (socketEventsMode == SOCKETEVENTS_SELECT)
+        nMaxConnections = std::max(std::min(nMaxConnections, (int)(FD_SETSIZE - nBind - MIN_CORE_FILEDESCRIPTORS)), 0);
     int nFD = RaiseFileDescriptorLimit(nMaxConnections + MIN_CORE_FILEDESCRIPTORS);
     if (nFD < MIN_CORE_FILEDESCRIPTORS)
         return InitError(_("Not enough file descriptors available."));
@@ -1276,10 +1346,15 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     LogPrintf("Using at most %i connections (%i file descriptors available)\n", nMaxConnections, nFD);
     std::ostringstream strErrors;
 
+    InitSignatureCache();
+    InitScriptExecutionCache();
+
     LogPrintf("Using %u threads for script verification\n", nScriptCheckThreads);
     if (nScriptCheckThreads) {
         for (int i=0; i<nScriptCheckThreads-1; i++)
             threadGroup.create_thread(&ThreadScriptCheck);
+        for (int i=0; i<nScriptCheckThreads-1; i++)
+            threadGroup.create_thread(&ThreadHeaderHash);
     }
 
     if (mapArgs.count("-sporkkey")) // spork priv key
@@ -1488,10 +1563,26 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     pdsNotificationInterface = new CDSNotificationInterface(connman);
     RegisterValidationInterface(pdsNotificationInterface);
 
+    pblocktemplatecache = new CBlockTemplateCache(chainparams);
+    RegisterValidationInterface(pblocktemplatecache);
+
     if (mapArgs.count("-maxuploadtarget")) {
         connman.SetMaxOutboundTarget(GetArg("-maxuploadtarget", DEFAULT_MAX_UPLOAD_TARGET)*1024*1024);
     }
 
+    blockservecache.SetMaxSize(std::max(GetArg("-blockservecache", DEFAULT_BLOCKSERVECACHE), (int64_t)0) << 20);
+
+    // ********************************************************* Step 6b: start loading cache data
+
+    // The flat database caches don't depend on the block chain: read them
+    // while it loads and check them against it in step 11b
+    pgovernancevotedb = new CGovernanceVoteDB(nGovernanceVoteDBCache << 20);
+    CCacheLoadThreads cacheLoadThreads;
+    cacheLoadThreads.threads.create_thread(boost::bind(&ThreadLoadCache<CMasternodeMan>, "mncache.dat", "magicMasternodeCache", &mnodeman, &cacheLoadThreads.fMasternodesLoaded));
+    cacheLoadThreads.threads.create_thread(boost::bind(&ThreadLoadCache<CMasternodePayments>, "mnpayments.dat", "magicMasternodePaymentsCache", &mnpayments, &cacheLoadThreads.fPaymentsLoaded));
+    cacheLoadThreads.threads.create_thread(boost::bind(&ThreadLoadCache<CGovernanceManager>, "governance.dat", "magicGovernanceCache", &governance, &cacheLoadThreads.fGovernanceLoaded));
+    cacheLoadThreads.threads.create_thread(boost::bind(&ThreadLoadCache<CNetFulfilledRequestManager>, "netfulfilled.dat", "magicFulfilledCache", &netfulfilledman, &cacheLoadThreads.fFulfilledLoaded));
+
     // ********************************************************* Step 7: load block chain
 
     fReindex = GetBoolArg("-reindex", false);
@@ -1536,6 +1627,7 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     nTotalCache -= nCoinDBCache;
     nCoinCacheUsage = nTotalCache; // the rest goes to in-memory cache
     nMempoolSizeMax = GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000;
+    blockfilemaps.SetMaxFiles(std::max(GetArg("-blockmmap", DEFAULT_BLOCKFILEMAPS), (int64_t)0));
     LogPrintf("Cache configuration:\n");
     LogPrintf("* Using %.1fMiB for block index database\n", nBlockTreeDBCache * (1.0 / 1024 / 1024));
     LogPrintf("* Using %.1fMiB for chain state database\n", nCoinDBCache * (1.0 / 1024 / 1024));
@@ -1552,6 +1644,9 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
         do {
             try {
                 UnloadBlockIndex();
+                delete pcoinsPrefetcher;
+                delete pIndexWriter;
+                pIndexWriter = NULL;
                 delete pcoinsTip;
                 delete pcoinsdbview;
                 delete pcoinscatcher;
@@ -1561,6 +1656,8 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
                 pcoinsdbview = new CCoinsViewDB(nCoinDBCache, false, fReindex || fReindexChainState);
                 pcoinscatcher = new CCoinsViewErrorCatcher(pcoinsdbview);
                 pcoinsTip = new CCoinsViewCache(pcoinscatcher);
+                int nPrefetchThreads = std::min((int)GetArg("-prefetchthreads", DEFAULT_PREFETCH_THREADS), MAX_PREFETCH_THREADS);
+                pcoinsPrefetcher = nPrefetchThreads > 0 ? new CCoinsPrefetcher(pcoinsdbview, chainparams.GetConsensus(), nPrefetchThreads) : NULL;
 
                 if (fReindex) {
                     pblocktree->WriteReindexing(true);
@@ -1592,6 +1689,28 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
                     break;
                 }
 
+                // The address, spent and timestamp indexes are written in the background
+                if (fAddressIndex || fSpentIndex || fTimestampIndex)
+                    pIndexWriter = new CIndexWriter(pblocktree);
+                if (!ReplayIndexUpdates(chainparams)) {
+                    strLoadError = _("Unable to replay the address, spent and timestamp indexes. You will need to rebuild the database using -reindex.");
+                    break;
+                }
+
+                // Address indexes from before the balances were maintained need them computed once
+                bool fAddressBalanceIndex = false;
+                if (fAddressIndex && !(pblocktree->ReadFlag("addressbalanceindex", fAddressBalanceIndex) && fAddressBalanceIndex)) {
+                    uiInterface.InitMessage(_("Building address balance index..."));
+                    if (!pblocktree->BuildAddressBalanceIndex() || !pblocktree->WriteFlag("addressbalanceindex", true)) {
+                        strLoadError = _("Error building address balance index");
+                        break;
+                    }
+                }
+
+                // Now nothing else reads the whole address index, convert it to the compact format while idle
+                if (fAddressIndex)
+                    pIndexWriter->StartMigration();
+
                 // Check for changed -txindex state
                 if (fTxIndex != GetBoolArg("-txindex", DEFAULT_TXINDEX)) {
                     strLoadError = _("You need to rebuild the database using -reindex-chainstate to change -txindex");
@@ -1973,38 +2092,50 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     boost::filesystem::path pathDB = GetDataDir();
     std::string strDBName;
 
-    strDBName = "mncache.dat";
     uiInterface.InitMessage(_("Loading masternode cache..."));
+    cacheLoadThreads.Join();
+
+    strDBName = "mncache.dat";
     CFlatDB<CMasternodeMan> flatdb1(strDBName, "magicMasternodeCache");
-    if(!flatdb1.Load(mnodeman)) {
+    if(!cacheLoadThreads.fMasternodesLoaded) {
         return InitError(_("Failed to load masternode cache from") + "\n" + (pathDB / strDBName).string());
     }
+    flatdb1.Cleanup(mnodeman);
 
     if(mnodeman.size()) {
         strDBName = "mnpayments.dat";
         uiInterface.InitMessage(_("Loading masternode payment cache..."));
         CFlatDB<CMasternodePayments> flatdb2(strDBName, "magicMasternodePaymentsCache");
-        if(!flatdb2.Load(mnpayments)) {
+        if(!cacheLoadThreads.fPaymentsLoaded) {
             return InitError(_("Failed to load masternode payments cache from") + "\n" + (pathDB / strDBName).string());
         }
+        flatdb2.Cleanup(mnpayments);
 
         strDBName = "governance.dat";
         uiInterface.InitMessage(_("Loading governance cache..."));
         CFlatDB<CGovernanceManager> flatdb3(strDBName, "magicGovernanceCache");
-        if(!flatdb3.Load(governance)) {
+        if(!cacheLoadThreads.fGovernanceLoaded) {
             return InitError(_("Failed to load governance cache from") + "\n" + (pathDB / strDBName).string());
         }
+        flatdb3.Cleanup(governance);
         governance.InitOnLoad();
     } else {
+        // they were read along with the masternode cache, but are of no use without it
+        mnpayments.Clear();
+        governance.Clear();
         uiInterface.InitMessage(_("Masternode cache is empty, skipping payments and governance cache..."));
     }
 
     strDBName = "netfulfilled.dat";
     uiInterface.InitMessage(_("Loading fulfilled requests cache..."));
     CFlatDB<CNetFulfilledRequestManager> flatdb4(strDBName, "magicFulfilledCache");
-    if(!flatdb4.Load(netfulfilledman)) {
+    if(!cacheLoadThreads.fFulfilledLoaded) {
         return InitError(_("Failed to load fulfilled requests cache from") + "\n" + (pathDB / strDBName).string());
     }
+    flatdb4.Cleanup(netfulfilledman);
+
+    // changes to the payments and governance caches are journaled, the files are only rewritten once in a while
+    scheduler.scheduleEvery(&CompactFlatDBCaches, FLATDB_JOURNAL_COMPACT_INTERVAL);
 
     // ********************************************************* Step 11c: update block tip in Spice modules
 
@@ -2023,6 +2154,17 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
         threadGroup.create_thread(boost::bind(&ThreadCheckPrivateSendClient, boost::ref(*g_connman)));
 #endif // ENABLE_WALLET
 
+    if (!fLiteMode) {
+        int nMnSigThreads = std::min((int)GetArg("-mnsigthreads", DEFAULT_MASTERNODE_SIGCHECK_THREADS), MAX_MASTERNODE_SIGCHECK_THREADS);
+        LogPrintf("Using %d threads for masternode signature verification\n", std::max(nMnSigThreads, 0));
+        if (nMnSigThreads > 0) {
+            mnsigqueue.Enable();
+            threadGroup.create_thread(boost::bind(&CMasternodeSigQueue::Thread, &mnsigqueue, boost::ref(*g_connman)));
+            for (int i = 0; i < nMnSigThreads - 1; i++)
+                threadGroup.create_thread(boost::bind(&CMasternodeSigQueue::WorkerThread, &mnsigqueue));
+        }
+    }
+
     // ********************************************************* Step 12: start node
 
     if (!CheckDiskSpace())
@@ -2067,6 +2209,8 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     connOptions.uiInterface = &uiInterface;
     connOptions.nSendBufferMaxSize = 1000*GetArg("-maxsendbuffer", DEFAULT_MAXSENDBUFFER);
     connOptions.nReceiveFloodSize = 1000*GetArg("-maxreceivebuffer", DEFAULT_MAXRECEIVEBUFFER);
+    connOptions.socketEventsMode = socketEventsMode;
+    connOptions.nMessageHandlerThreads = GetArg("-msghandthreads", DEFAULT_MSGHAND_THREADS);
 
     if (!connman.Start(scheduler, strNodeError, connOptions))
         return InitError(strNodeError);
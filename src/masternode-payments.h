@@ -7,6 +7,7 @@
 
 #include "util.h"
 #include "core_io.h"
+#include "flat-database.h"
 #include "key.h"
 #include "masternode.h"
 #include "net_processing.h"
@@ -28,7 +29,7 @@ static const int MIN_MASTERNODE_PAYMENT_PROTO_VERSION_2 = 70208;
 
 extern CCriticalSection cs_vecPayees;
 extern CCriticalSection cs_mapMasternodeBlocks;
-extern CCriticalSection cs_mapMasternodePayeeVotes;
+extern CCriticalSection cs_mapMasternodePaymentVotes;
 
 extern CMasternodePayments mnpayments;
 
@@ -147,6 +148,8 @@ public:
         return ss.GetHash();
     }
 
+    std::string GetSignatureMessage() const;
+    uint256 GetSignatureHash() const;
     bool Sign();
     bool CheckSignature(const CPubKey& pubKeyMasternode, int nValidationHeight, int &nDos);
 
@@ -164,9 +167,16 @@ public:
 // Keeps track of who should get paid for which blocks
 //
 
-class CMasternodePayments
+class CMasternodePayments : public CFlatDBJournaledCache
 {
 private:
+    // Changes logged to the mnpayments.dat journal
+    enum JournalRecordType {
+        JOURNAL_CLEAR = 0,
+        JOURNAL_PAYMENT_VOTE = 1,
+        JOURNAL_ERASE_PAYMENT_VOTE = 2
+    };
+
     // masternode count times nStorageCoeff payments blocks should be stored ...
     const float nStorageCoeff;
     // ... but at least nMinBlocksToStore (payments blocks)
@@ -187,14 +197,17 @@ public:
 
     template <typename Stream, typename Operation>
     inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        LOCK2(cs_mapMasternodeBlocks, cs_mapMasternodePaymentVotes);
         READWRITE(mapMasternodePaymentVotes);
         READWRITE(mapMasternodeBlocks);
     }
 
     void Clear();
+    bool ApplyJournalRecord(CDataStream& ssRecord) override;
 
     bool AddPaymentVote(const CMasternodePaymentVote& vote);
     bool HasVerifiedPaymentVote(uint256 hashIn);
+    bool HasPaymentVote(const uint256& hashIn);
     bool ProcessBlock(int nBlockHeight, CConnman& connman);
     void CheckPreviousBlockVotes(int nPrevBlockHeight);
 
@@ -0,0 +1,176 @@
+// Copyright (c) 2014-2017 The Dune Spice developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "masternode-sigqueue.h"
+#include "masternode.h"
+#include "masternode-payments.h"
+#include "masternodeman.h"
+#include "protocol.h"
+#include "util.h"
+
+#include <boost/thread.hpp>
+
+CMasternodeSigQueue mnsigqueue;
+
+static const size_t MAX_BATCH_SIZE = 1000;
+
+bool CMasternodeSigQueue::IsQueuedCommand(const std::string& strCommand)
+{
+    return strCommand == NetMsgType::MNPING ||
+        strCommand == NetMsgType::MNANNOUNCE ||
+        strCommand == NetMsgType::MASTERNODEPAYMENTVOTE;
+}
+
+bool CMasternodeSigQueue::ShouldDelay(NodeId nodeid, const std::string& strCommand)
+{
+    if(!fEnabled) return false;
+
+    boost::unique_lock<boost::mutex> lock(mutex);
+    // masternode messages join the earlier ones of the peer here once there is room
+    if(IsQueuedCommand(strCommand)) return nMessages >= MAX_PENDING_MESSAGES;
+    // other messages wait until the earlier masternode messages are processed
+    return mapPeerMessages.count(nodeid) > 0;
+}
+
+bool CMasternodeSigQueue::Push(NodeId nodeid, const std::string& strCommand, const CDataStream& vRecv)
+{
+    if(!fEnabled || !IsQueuedCommand(strCommand)) return false;
+
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        // the message handler doesn't take a masternode message from a peer
+        // while the queue is full, see ShouldDelay()
+        dequePending.push_back(std::make_pair(nodeid, message_t(strCommand, vRecv)));
+        ++nMessages;
+        ++mapPeerMessages[nodeid];
+    }
+    condPending.notify_one();
+
+    return true;
+}
+
+void CMasternodeSigQueue::PopVerified(NodeId nodeid, std::vector<message_t>& vMessagesRet)
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+
+    std::map<NodeId, std::vector<message_t> >::iterator it = mapVerified.find(nodeid);
+    if(it == mapVerified.end()) return;
+
+    vMessagesRet.swap(it->second);
+    mapVerified.erase(it);
+    nMessages -= vMessagesRet.size();
+
+    std::map<NodeId, size_t>::iterator itPeer = mapPeerMessages.find(nodeid);
+    assert(itPeer != mapPeerMessages.end() && itPeer->second >= vMessagesRet.size());
+    itPeer->second -= vMessagesRet.size();
+    if(itPeer->second == 0) {
+        mapPeerMessages.erase(itPeer);
+    }
+}
+
+void CMasternodeSigQueue::RemovePeer(NodeId nodeid)
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+
+    std::map<NodeId, std::vector<message_t> >::iterator itVerified = mapVerified.find(nodeid);
+    if(itVerified != mapVerified.end()) {
+        nMessages -= itVerified->second.size();
+        mapVerified.erase(itVerified);
+    }
+    std::deque<std::pair<NodeId, message_t> >::iterator it = dequePending.begin();
+    while(it != dequePending.end()) {
+        if(it->first == nodeid) {
+            it = dequePending.erase(it);
+            --nMessages;
+        } else {
+            ++it;
+        }
+    }
+    // the dispatcher might be working on some of its messages right now
+    setRemovedPeers.insert(nodeid);
+    mapPeerMessages.erase(nodeid);
+}
+
+void CMasternodeSigQueue::AddSigChecks(const message_t& message, std::vector<CHashSigCheck>& vChecksRet)
+{
+    // work on a copy, the message handler is going to read the original again
+    CDataStream vRecv(message.second);
+
+    // messages seen before are turned away without checking their
+    // signatures, don't recover their keys either
+    try {
+        if(message.first == NetMsgType::MNPING) {
+            CMasternodePing mnp;
+            vRecv >> mnp;
+            if(mnodeman.HasSeenMasternodePing(mnp.GetHash())) return;
+            vChecksRet.push_back(CHashSigCheck(mnp.GetSignatureHash(), mnp.vchSig));
+        } else if(message.first == NetMsgType::MNANNOUNCE) {
+            CMasternodeBroadcast mnb;
+            vRecv >> mnb;
+            if(mnodeman.HasSeenMasternodeBroadcast(mnb.GetHash())) return;
+            vChecksRet.push_back(CHashSigCheck(mnb.GetSignatureHash(), mnb.vchSig));
+            if(mnb.lastPing != CMasternodePing()) {
+                vChecksRet.push_back(CHashSigCheck(mnb.lastPing.GetSignatureHash(), mnb.lastPing.vchSig));
+            }
+        } else if(message.first == NetMsgType::MASTERNODEPAYMENTVOTE) {
+            CMasternodePaymentVote vote;
+            vRecv >> vote;
+            if(mnpayments.HasPaymentVote(vote.GetHash())) return;
+            vChecksRet.push_back(CHashSigCheck(vote.GetSignatureHash(), vote.vchSig));
+        }
+    } catch (const std::exception& e) {
+        // malformed messages are reported when they are processed for real
+        LogPrint("masternode", "CMasternodeSigQueue::AddSigChecks -- %s: %s\n", message.first, e.what());
+    }
+}
+
+void CMasternodeSigQueue::Thread(CConnman& connman)
+{
+    RenameThread("spice-mnsig");
+
+    std::deque<std::pair<NodeId, message_t> > dequeBatch;
+    std::vector<CHashSigCheck> vChecks;
+
+    while(true) {
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            while(dequePending.empty()) {
+                condPending.wait(lock);
+            }
+            size_t nBatchSize = std::min(dequePending.size(), MAX_BATCH_SIZE);
+            dequeBatch.insert(dequeBatch.end(), dequePending.begin(), dequePending.begin() + nBatchSize);
+            dequePending.erase(dequePending.begin(), dequePending.begin() + nBatchSize);
+            setRemovedPeers.clear();
+        }
+
+        boost::this_thread::interruption_point();
+
+        vChecks.clear();
+        for(const auto& pair : dequeBatch) {
+            AddSigChecks(pair.second, vChecks);
+        }
+
+        {
+            CCheckQueueControl<CHashSigCheck> control(&checkqueue);
+            control.Add(vChecks);
+            control.Wait();
+        }
+
+        LogPrint("masternode", "CMasternodeSigQueue::Thread -- checked %d signatures of %d messages\n", vChecks.size(), dequeBatch.size());
+
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            for(auto& pair : dequeBatch) {
+                if(setRemovedPeers.count(pair.first)) {
+                    --nMessages;
+                    continue;
+                }
+                mapVerified[pair.first].push_back(std::move(pair.second));
+            }
+        }
+        dequeBatch.clear();
+
+        connman.WakeMessageHandler();
+    }
+}
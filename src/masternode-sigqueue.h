@@ -0,0 +1,99 @@
+// Copyright (c) 2014-2017 The Dune Spice developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef MASTERNODE_SIGQUEUE_H
+#define MASTERNODE_SIGQUEUE_H
+
+#include "checkqueue.h"
+#include "messagesigner.h"
+#include "net.h"
+#include "streams.h"
+
+#include <deque>
+#include <map>
+#include <set>
+#include <string>
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+class CMasternodeSigQueue;
+
+static const int DEFAULT_MASTERNODE_SIGCHECK_THREADS = 2;
+static const int MAX_MASTERNODE_SIGCHECK_THREADS = 16;
+
+extern CMasternodeSigQueue mnsigqueue;
+
+/**
+ * Moves signature checks of masternode pings, announcements and payment votes
+ * off the message handler thread.
+ *
+ * The message handler parks such messages here instead of processing them.
+ * A dispatcher thread takes them in batches and recovers the signing keys on
+ * a CCheckQueue shared with the worker threads, filling the CHashSigner cache.
+ * The messages are then handed back to the message handler for the peer that
+ * sent them, where the usual CMasternodeMan / CMasternodePayments code path
+ * runs and finds its signature checks already done. Messages that were seen
+ * before are passed through without checking their signatures again.
+ *
+ * A peer's messages are processed in the order they were received: while it
+ * has messages held here, its other messages wait (see ShouldDelay()), and
+ * so do its masternode messages while the queue is full.
+ */
+class CMasternodeSigQueue
+{
+public:
+    typedef std::pair<std::string, CDataStream> message_t;
+
+    /// Most messages held at once, from being parked until they are popped for processing
+    static const size_t MAX_PENDING_MESSAGES = 20000;
+    /// Most signatures checked for a message, an mnb carries its own and its ping's
+    static const size_t MAX_SIGS_PER_MESSAGE = 2;
+
+    static_assert(MAX_PENDING_MESSAGES * MAX_SIGS_PER_MESSAGE <= CHashSigner::RECOVERED_KEYS_CACHE_SIZE,
+                  "the keys recovered for the messages held must not be evicted before they are used");
+
+private:
+    boost::mutex mutex;
+    boost::condition_variable condPending;
+
+    // Messages waiting for their signatures to be checked, in arrival order
+    std::deque<std::pair<NodeId, message_t> > dequePending;
+    // Messages with checked signatures, waiting to be processed for their peer
+    std::map<NodeId, std::vector<message_t> > mapVerified;
+    // Peers removed while the current batch was being checked
+    std::set<NodeId> setRemovedPeers;
+    // Messages pending, in the current batch or verified
+    size_t nMessages;
+    // The same, per peer
+    std::map<NodeId, size_t> mapPeerMessages;
+
+    CCheckQueue<CHashSigCheck> checkqueue;
+    bool fEnabled;
+
+    static bool IsQueuedCommand(const std::string& strCommand);
+    static void AddSigChecks(const message_t& message, std::vector<CHashSigCheck>& vChecksRet);
+
+public:
+    CMasternodeSigQueue() : nMessages(0), checkqueue(128), fEnabled(false) {}
+
+    /// Start accepting messages, must be called before the threads below are started
+    void Enable() { fEnabled = true; }
+
+    /// Whether the next message of this peer has to stay in its receive queue for now
+    bool ShouldDelay(NodeId nodeid, const std::string& strCommand);
+    /// Park a message for signature checking, returns false if it isn't one whose signatures are checked here
+    bool Push(NodeId nodeid, const std::string& strCommand, const CDataStream& vRecv);
+    /// Take the messages of this peer whose signatures were checked
+    void PopVerified(NodeId nodeid, std::vector<message_t>& vMessagesRet);
+    /// Forget all messages of a disconnected peer
+    void RemovePeer(NodeId nodeid);
+
+    /// Dispatcher thread
+    void Thread(CConnman& connman);
+    /// Worker thread
+    void WorkerThread() { checkqueue.Thread(); }
+};
+
+#endif
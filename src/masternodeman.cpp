@@ -63,6 +63,7 @@ CMasternodeMan::CMasternodeMan()
   fMasternodesRemoved(false),
   vecDirtyGovernanceObjectHashes(),
   nLastWatchdogVoteTime(0),
+  mapRankCache(MAX_RANK_CACHE_SIZE),
   mapSeenMasternodeBroadcast(),
   mapSeenMasternodePing(),
   nDsqCount(0)
@@ -77,6 +78,7 @@ bool CMasternodeMan::Add(CMasternode &mn)
     LogPrint("masternode", "CMasternodeMan::Add -- Adding new Masternode: addr=%s, %i now\n", mn.addr.ToString(), size() + 1);
     mapMasternodes[mn.vin.prevout] = mn;
     fMasternodesAdded = true;
+    ClearRankCache();
     return true;
 }
 
@@ -191,6 +193,7 @@ void CMasternodeMan::CheckAndRemove(CConnman& connman)
                 it->second.FlagGovernanceItemsAsDirty();
                 mapMasternodes.erase(it++);
                 fMasternodesRemoved = true;
+                ClearRankCache();
             } else {
                 bool fAsk = (nAskForMnbRecovery > 0) &&
                             masternodeSync.IsSynced() &&
@@ -345,6 +348,7 @@ void CMasternodeMan::Clear()
 {
     LOCK(cs);
     mapMasternodes.clear();
+    ClearRankCache();
     mAskedUsForMasternodeList.clear();
     mWeAskedForMasternodeList.clear();
     mWeAskedForMasternodeListEntry.clear();
@@ -482,6 +486,18 @@ bool CMasternodeMan::Has(const COutPoint& outpoint)
     return mapMasternodes.find(outpoint) != mapMasternodes.end();
 }
 
+bool CMasternodeMan::HasSeenMasternodeBroadcast(const uint256& hash)
+{
+    LOCK(cs);
+    return mapSeenMasternodeBroadcast.count(hash) > 0;
+}
+
+bool CMasternodeMan::HasSeenMasternodePing(const uint256& hash)
+{
+    LOCK(cs);
+    return mapSeenMasternodePing.count(hash) > 0;
+}
+
 //
 // Deterministically select the oldest/best masternode to pay on the network
 //
@@ -609,9 +625,9 @@ masternode_info_t CMasternodeMan::FindRandomNotInVec(const std::vector<COutPoint
     return masternode_info_t();
 }
 
-bool CMasternodeMan::GetMasternodeScores(const uint256& nBlockHash, CMasternodeMan::score_pair_vec_t& vecMasternodeScoresRet, int nMinProtocol)
+bool CMasternodeMan::GetMasternodeScores(const uint256& nBlockHash, CMasternodeMan::rank_cache_entry_ptr& pScoresRet, int nMinProtocol)
 {
-    vecMasternodeScoresRet.clear();
+    pScoresRet.reset();
 
     if (!masternodeSync.IsMasternodeListSynced())
         return false;
@@ -621,15 +637,30 @@ bool CMasternodeMan::GetMasternodeScores(const uint256& nBlockHash, CMasternodeM
     if (mapMasternodes.empty())
         return false;
 
+    std::pair<uint256, int> key = std::make_pair(nBlockHash, nMinProtocol);
+    if (mapRankCache.GetAndTouch(key, pScoresRet))
+        return !pScoresRet->vecScores.empty();
+
+    std::shared_ptr<rank_cache_entry_t> pScores = std::make_shared<rank_cache_entry_t>();
+
     // calculate scores
     for (auto& mnpair : mapMasternodes) {
         if (mnpair.second.nProtocolVersion >= nMinProtocol) {
-            vecMasternodeScoresRet.push_back(std::make_pair(mnpair.second.CalculateScore(nBlockHash), &mnpair.second));
+            pScores->vecScores.push_back(std::make_pair(mnpair.second.CalculateScore(nBlockHash), &mnpair.second));
         }
     }
 
-    sort(vecMasternodeScoresRet.rbegin(), vecMasternodeScoresRet.rend(), CompareScoreMN());
-    return !vecMasternodeScoresRet.empty();
+    sort(pScores->vecScores.rbegin(), pScores->vecScores.rend(), CompareScoreMN());
+
+    int nRank = 0;
+    pScores->mapRanks.reserve(pScores->vecScores.size());
+    for (auto& scorePair : pScores->vecScores) {
+        pScores->mapRanks.emplace(scorePair.second->vin.prevout, ++nRank);
+    }
+
+    pScoresRet = pScores;
+    mapRankCache.Insert(key, pScoresRet);
+    return !pScoresRet->vecScores.empty();
 }
 
 bool CMasternodeMan::GetMasternodeRank(const COutPoint& outpoint, int& nRankRet, int nBlockHeight, int nMinProtocol)
@@ -648,20 +679,16 @@ bool CMasternodeMan::GetMasternodeRank(const COutPoint& outpoint, int& nRankRet,
 
     LOCK(cs);
 
-    score_pair_vec_t vecMasternodeScores;
-    if (!GetMasternodeScores(nBlockHash, vecMasternodeScores, nMinProtocol))
+    rank_cache_entry_ptr pScores;
+    if (!GetMasternodeScores(nBlockHash, pScores, nMinProtocol))
         return false;
 
-    int nRank = 0;
-    for (auto& scorePair : vecMasternodeScores) {
-        nRank++;
-        if(scorePair.second->vin.prevout == outpoint) {
-            nRankRet = nRank;
-            return true;
-        }
-    }
+    auto it = pScores->mapRanks.find(outpoint);
+    if (it == pScores->mapRanks.end())
+        return false;
 
-    return false;
+    nRankRet = it->second;
+    return true;
 }
 
 bool CMasternodeMan::GetMasternodeRanks(CMasternodeMan::rank_pair_vec_t& vecMasternodeRanksRet, int nBlockHeight, int nMinProtocol)
@@ -680,12 +707,12 @@ bool CMasternodeMan::GetMasternodeRanks(CMasternodeMan::rank_pair_vec_t& vecMast
 
     LOCK(cs);
 
-    score_pair_vec_t vecMasternodeScores;
-    if (!GetMasternodeScores(nBlockHash, vecMasternodeScores, nMinProtocol))
+    rank_cache_entry_ptr pScores;
+    if (!GetMasternodeScores(nBlockHash, pScores, nMinProtocol))
         return false;
 
     int nRank = 0;
-    for (auto& scorePair : vecMasternodeScores) {
+    for (auto& scorePair : pScores->vecScores) {
         nRank++;
         vecMasternodeRanksRet.push_back(std::make_pair(nRank, *scorePair.second));
     }
@@ -1341,10 +1368,15 @@ void CMasternodeMan::UpdateMasternodeList(CMasternodeBroadcast mnb, CConnman& co
         }
     } else {
         CMasternodeBroadcast mnbOld = mapSeenMasternodeBroadcast[CMasternodeBroadcast(*pmn).GetHash()].second;
+        int nProtocolVersionOld = pmn->nProtocolVersion;
         if(pmn->UpdateFromNewBroadcast(mnb, connman)) {
             masternodeSync.BumpAssetLastTime("CMasternodeMan::UpdateMasternodeList - seen");
             mapSeenMasternodeBroadcast.erase(mnbOld.GetHash());
         }
+        // protocol version decides which rankings this masternode takes part in
+        if(pmn->nProtocolVersion != nProtocolVersionOld) {
+            ClearRankCache();
+        }
     }
 }
 
@@ -1403,7 +1435,13 @@ bool CMasternodeMan::CheckMnbAndUpdateMasternodeList(CNode* pfrom, CMasternodeBr
         CMasternode* pmn = Find(mnb.vin.prevout);
         if(pmn) {
             CMasternodeBroadcast mnbOld = mapSeenMasternodeBroadcast[CMasternodeBroadcast(*pmn).GetHash()].second;
-            if(!mnb.Update(pmn, nDos, connman)) {
+            int nProtocolVersionOld = pmn->nProtocolVersion;
+            bool fUpdated = mnb.Update(pmn, nDos, connman);
+            // protocol version decides which rankings this masternode takes part in
+            if(pmn->nProtocolVersion != nProtocolVersionOld) {
+                ClearRankCache();
+            }
+            if(!fUpdated) {
                 LogPrint("masternode", "CMasternodeMan::CheckMnbAndUpdateMasternodeList -- Update() failed, masternode=%s\n", mnb.vin.prevout.ToStringShort());
                 return false;
             }
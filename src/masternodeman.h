@@ -5,9 +5,14 @@
 #ifndef MASTERNODEMAN_H
 #define MASTERNODEMAN_H
 
+#include "cachemap.h"
+#include "coins.h"
 #include "masternode.h"
 #include "sync.h"
 
+#include <memory>
+#include <unordered_map>
+
 using namespace std;
 
 class CMasternodeMan;
@@ -41,6 +46,14 @@ private:
     static const int MNB_RECOVERY_WAIT_SECONDS      = 60;
     static const int MNB_RECOVERY_RETRY_SECONDS     = 3 * 60 * 60;
 
+    static const int MAX_RANK_CACHE_SIZE            = 16;
+
+    /// Scores for one block hash sorted from highest to lowest, plus the rank of every listed outpoint
+    struct rank_cache_entry_t {
+        score_pair_vec_t vecScores;
+        std::unordered_map<COutPoint, int, SaltedOutpointHasher> mapRanks;
+    };
+    typedef std::shared_ptr<const rank_cache_entry_t> rank_cache_entry_ptr;
 
     // critical section to protect the inner data structures
     mutable CCriticalSection cs;
@@ -74,11 +87,17 @@ private:
 
     int64_t nLastWatchdogVoteTime;
 
+    // Sorted scores of recently ranked blocks, keyed by block hash and minimal protocol version,
+    // the least recently used entry is dropped first.
+    // Entries point into mapMasternodes, so any change to the list must call ClearRankCache().
+    CacheMap<std::pair<uint256, int>, rank_cache_entry_ptr> mapRankCache;
+
     friend class CMasternodeSync;
     /// Find an entry
     CMasternode* Find(const COutPoint& outpoint);
 
-    bool GetMasternodeScores(const uint256& nBlockHash, score_pair_vec_t& vecMasternodeScoresRet, int nMinProtocol = 0);
+    bool GetMasternodeScores(const uint256& nBlockHash, rank_cache_entry_ptr& pScoresRet, int nMinProtocol = 0);
+    void ClearRankCache() { mapRankCache.Clear(); }
 
 public:
     // Keep track of all broadcasts I've seen
@@ -119,6 +138,9 @@ public:
         if(ser_action.ForRead() && (strVersion != SERIALIZATION_VERSION_STRING)) {
             Clear();
         }
+        if(ser_action.ForRead()) {
+            ClearRankCache();
+        }
     }
 
     CMasternodeMan();
@@ -160,6 +182,8 @@ public:
     /// Versions of Find that are safe to use from outside the class
     bool Get(const COutPoint& outpoint, CMasternode& masternodeRet);
     bool Has(const COutPoint& outpoint);
+    bool HasSeenMasternodeBroadcast(const uint256& hash);
+    bool HasSeenMasternodePing(const uint256& hash);
 
     bool GetMasternodeInfo(const COutPoint& outpoint, masternode_info_t& mnInfoRet);
     bool GetMasternodeInfo(const CPubKey& pubKeyMasternode, masternode_info_t& mnInfoRet);
@@ -3,12 +3,27 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "base58.h"
+#include "cachemap.h"
 #include "hash.h"
+#include "sync.h"
 #include "validation.h" // For strMessageMagic
 #include "messagesigner.h"
 #include "tinyformat.h"
 #include "utilstrencodings.h"
 
+namespace {
+
+/** Keys recovered by CHashSigner::PrecomputeRecovery, keyed by the hash of (hash, signature) */
+CCriticalSection cs_mapRecoveredKeys;
+CacheMap<uint256, CKeyID> mapRecoveredKeys(CHashSigner::RECOVERED_KEYS_CACHE_SIZE);
+
+uint256 GetRecoveryCacheKey(const uint256& hash, const std::vector<unsigned char>& vchSig)
+{
+    return Hash(hash.begin(), hash.end(), vchSig.begin(), vchSig.end());
+}
+
+} // anon namespace
+
 bool CMessageSigner::GetKeysFromSecret(const std::string strSecret, CKey& keyRet, CPubKey& pubkeyRet)
 {
     CBitcoinSecret vchSecret;
@@ -31,12 +46,17 @@ bool CMessageSigner::SignMessage(const std::string strMessage, std::vector<unsig
 }
 
 bool CMessageSigner::VerifyMessage(const CPubKey pubkey, const std::vector<unsigned char>& vchSig, const std::string strMessage, std::string& strErrorRet)
+{
+    return CHashSigner::VerifyHash(GetMessageHash(strMessage), pubkey, vchSig, strErrorRet);
+}
+
+uint256 CMessageSigner::GetMessageHash(const std::string& strMessage)
 {
     CHashWriter ss(SER_GETHASH, 0);
     ss << strMessageMagic;
     ss << strMessage;
 
-    return CHashSigner::VerifyHash(ss.GetHash(), pubkey, vchSig, strErrorRet);
+    return ss.GetHash();
 }
 
 bool CHashSigner::SignHash(const uint256& hash, const CKey key, std::vector<unsigned char>& vchSigRet)
@@ -46,18 +66,42 @@ bool CHashSigner::SignHash(const uint256& hash, const CKey key, std::vector<unsi
 
 bool CHashSigner::VerifyHash(const uint256& hash, const CPubKey pubkey, const std::vector<unsigned char>& vchSig, std::string& strErrorRet)
 {
-    CPubKey pubkeyFromSig;
-    if(!pubkeyFromSig.RecoverCompact(hash, vchSig)) {
-        strErrorRet = "Error recovering public key.";
-        return false;
+    CKeyID keyIDFromSig;
+    bool fRecovered = false;
+    {
+        LOCK(cs_mapRecoveredKeys);
+        uint256 cacheKey = GetRecoveryCacheKey(hash, vchSig);
+        if(mapRecoveredKeys.Get(cacheKey, keyIDFromSig)) {
+            mapRecoveredKeys.Erase(cacheKey);
+            fRecovered = true;
+        }
     }
 
-    if(pubkeyFromSig.GetID() != pubkey.GetID()) {
+    if(!fRecovered) {
+        CPubKey pubkeyFromSig;
+        if(!pubkeyFromSig.RecoverCompact(hash, vchSig)) {
+            strErrorRet = "Error recovering public key.";
+            return false;
+        }
+        keyIDFromSig = pubkeyFromSig.GetID();
+    }
+
+    if(keyIDFromSig != pubkey.GetID()) {
         strErrorRet = strprintf("Keys don't match: pubkey=%s, pubkeyFromSig=%s, hash=%s, vchSig=%s",
-                    pubkey.GetID().ToString(), pubkeyFromSig.GetID().ToString(), hash.ToString(),
+                    pubkey.GetID().ToString(), keyIDFromSig.ToString(), hash.ToString(),
                     EncodeBase64(&vchSig[0], vchSig.size()));
         return false;
     }
 
     return true;
 }
+
+void CHashSigner::PrecomputeRecovery(const uint256& hash, const std::vector<unsigned char>& vchSig)
+{
+    CPubKey pubkeyFromSig;
+    // failures are left for VerifyHash() to report
+    if(!pubkeyFromSig.RecoverCompact(hash, vchSig)) return;
+
+    LOCK(cs_mapRecoveredKeys);
+    mapRecoveredKeys.Insert(GetRecoveryCacheKey(hash, vchSig), pubkeyFromSig.GetID());
+}
@@ -18,6 +18,8 @@ public:
     static bool SignMessage(const std::string strMessage, std::vector<unsigned char>& vchSigRet, const CKey key);
     /// Verify the message signature, returns true if succcessful
     static bool VerifyMessage(const CPubKey pubkey, const std::vector<unsigned char>& vchSig, const std::string strMessage, std::string& strErrorRet);
+    /// Get the hash which SignMessage signs for the message
+    static uint256 GetMessageHash(const std::string& strMessage);
 };
 
 /** Helper class for signing hashes and checking their signatures
@@ -25,10 +27,42 @@ public:
 class CHashSigner
 {
 public:
+    /// Most recovered keys kept for VerifyHash(), callers of PrecomputeRecovery() must not have more in flight
+    static const uint32_t RECOVERED_KEYS_CACHE_SIZE = 40000;
+
     /// Sign the hash, returns true if successful
     static bool SignHash(const uint256& hash, const CKey key, std::vector<unsigned char>& vchSigRet);
     /// Verify the hash signature, returns true if succcessful
     static bool VerifyHash(const uint256& hash, const CPubKey pubkey, const std::vector<unsigned char>& vchSig, std::string& strErrorRet);
+    /// Recover the signing key ahead of time, so the next VerifyHash() for this hash and signature is cheap
+    static void PrecomputeRecovery(const uint256& hash, const std::vector<unsigned char>& vchSig);
+};
+
+/** CCheckQueue job recovering the key of a hash signature into the CHashSigner cache.
+ *  Bad signatures are not reported here but by the VerifyHash() call that follows.
+ */
+class CHashSigCheck
+{
+private:
+    uint256 hash;
+    std::vector<unsigned char> vchSig;
+
+public:
+    CHashSigCheck() {}
+    CHashSigCheck(const uint256& hashIn, const std::vector<unsigned char>& vchSigIn) :
+        hash(hashIn), vchSig(vchSigIn) {}
+
+    bool operator()()
+    {
+        CHashSigner::PrecomputeRecovery(hash, vchSig);
+        return true;
+    }
+
+    void swap(CHashSigCheck& check)
+    {
+        std::swap(hash, check.hash);
+        vchSig.swap(check.vchSig);
+    }
 };
 
 #endif
@@ -7,8 +7,17 @@
 #define BITCOIN_MINER_H
 
 #include "primitives/block.h"
+#include "txmempool.h"
+#include "validationinterface.h"
 
 #include <stdint.h>
+#include <memory>
+
+#include "boost/multi_index_container.hpp"
+#include "boost/multi_index/ordered_index.hpp"
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
 
 class CBlockIndex;
 class CChainParams;
@@ -30,6 +39,254 @@ struct CBlockTemplate
     std::vector<int64_t> vTxSigOps;
 };
 
+// Container for tracking updates to ancestor feerate as we include (parent)
+// transactions in a block
+struct CTxMemPoolModifiedEntry {
+    CTxMemPoolModifiedEntry(CTxMemPool::txiter entry)
+    {
+        iter = entry;
+        nSizeWithAncestors = entry->GetSizeWithAncestors();
+        nModFeesWithAncestors = entry->GetModFeesWithAncestors();
+        nSigOpCountWithAncestors = entry->GetSigOpCountWithAncestors();
+    }
+
+    CTxMemPool::txiter iter;
+    uint64_t nSizeWithAncestors;
+    CAmount nModFeesWithAncestors;
+    unsigned int nSigOpCountWithAncestors;
+};
+
+/** Comparator for CTxMemPool::txiter objects.
+ *  It simply compares the internal memory address of the CTxMemPoolEntry object
+ *  pointed to. This means it has no meaning, and is only useful for using them
+ *  as key in other indexes.
+ */
+struct CompareCTxMemPoolIter {
+    bool operator()(const CTxMemPool::txiter& a, const CTxMemPool::txiter& b) const
+    {
+        return &(*a) < &(*b);
+    }
+};
+
+struct modifiedentry_iter {
+    typedef CTxMemPool::txiter result_type;
+    result_type operator() (const CTxMemPoolModifiedEntry &entry) const
+    {
+        return entry.iter;
+    }
+};
+
+// This matches the calculation in CompareTxMemPoolEntryByAncestorFee,
+// except operating on CTxMemPoolModifiedEntry.
+struct CompareModifiedEntry {
+    bool operator()(const CTxMemPoolModifiedEntry &a, const CTxMemPoolModifiedEntry &b) const
+    {
+        double f1 = (double)a.nModFeesWithAncestors * b.nSizeWithAncestors;
+        double f2 = (double)b.nModFeesWithAncestors * a.nSizeWithAncestors;
+        if (f1 == f2) {
+            return a.iter->GetTx().GetHash() < b.iter->GetTx().GetHash();
+        }
+        return f1 > f2;
+    }
+};
+
+// A comparator that sorts transactions based on number of ancestors.
+// This is sufficient to sort an ancestor package in an order that is valid
+// to appear in a block.
+struct CompareTxIterByAncestorCount {
+    bool operator()(const CTxMemPool::txiter &a, const CTxMemPool::txiter &b) const
+    {
+        if (a->GetCountWithAncestors() != b->GetCountWithAncestors())
+            return a->GetCountWithAncestors() < b->GetCountWithAncestors();
+        return CTxMemPool::CompareIteratorByHash()(a, b);
+    }
+};
+
+typedef boost::multi_index_container<
+    CTxMemPoolModifiedEntry,
+    boost::multi_index::indexed_by<
+        boost::multi_index::ordered_unique<
+            modifiedentry_iter,
+            CompareCTxMemPoolIter
+        >,
+        // sorted by modified ancestor fee rate
+        boost::multi_index::ordered_non_unique<
+            boost::multi_index::identity<CTxMemPoolModifiedEntry>,
+            CompareModifiedEntry
+        >
+    >
+> indexed_modified_transaction_set;
+
+typedef indexed_modified_transaction_set::nth_index<0>::type::iterator modtxiter;
+typedef indexed_modified_transaction_set::nth_index<1>::type::iterator modtxscoreiter;
+
+struct update_for_parent_inclusion
+{
+    update_for_parent_inclusion(CTxMemPool::txiter it) : iter(it) {}
+
+    void operator() (CTxMemPoolModifiedEntry &e)
+    {
+        e.nModFeesWithAncestors -= iter->GetModifiedFee();
+        e.nSizeWithAncestors -= iter->GetTxSize();
+        e.nSigOpCountWithAncestors -= iter->GetSigOpCount();
+    }
+
+    CTxMemPool::txiter iter;
+};
+
+/**
+ * Generate a new block, without valid proof-of-work.
+ *
+ * Transactions are selected by the feerate of their in-mempool ancestor
+ * package, which the mempool keeps up to date in its ancestor score index as
+ * transactions arrive and leave, so building a template walks that index
+ * instead of sorting the whole mempool.
+ */
+class BlockAssembler
+{
+private:
+    // The constructed block template
+    std::unique_ptr<CBlockTemplate> pblocktemplate;
+    // A convenience pointer that always refers to the CBlock in pblocktemplate
+    CBlock* pblock;
+
+    // Configuration parameters for the block size
+    unsigned int nBlockMaxSize, nBlockMinSize, nBlockPrioritySize;
+    unsigned int nBlockMaxSigOps;
+    bool fPrintPriority;
+
+    // Information on the current status of the block
+    uint64_t nBlockSize;
+    uint64_t nBlockTx;
+    unsigned int nBlockSigOps;
+    CAmount nFees;
+    CTxMemPool::setEntries inBlock;
+
+    // Chain context for the block
+    int nHeight;
+    int64_t nLockTimeCutoff;
+    const CChainParams& chainparams;
+    CTxMemPool& pool;
+
+    // Variables used for addPriorityTxs
+    int lastFewTxs;
+    bool blockFinished;
+
+public:
+    BlockAssembler(const CChainParams& chainparams, CTxMemPool& pool);
+    /** Construct a new block template with coinbase to scriptPubKeyIn */
+    CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn);
+    /** Select the mempool transactions of a block at nHeight, the template has an empty coinbase */
+    CBlockTemplate* SelectTransactions(int nHeight, int64_t nLockTimeCutoff);
+
+private:
+    // utility functions
+    /** Clear the block's state and prepare for assembling a new block */
+    void resetBlock();
+    /** Add a tx to the block */
+    void AddToBlock(CTxMemPool::txiter iter);
+
+    // Methods for how to add transactions to a block.
+    /** Add transactions based on tx "priority" */
+    void addPriorityTxs();
+    /** Add transactions based on feerate including unconfirmed ancestors */
+    void addPackageTxs();
+
+    // helper function for addPriorityTxs
+    /** Test if tx will still "fit" in the block */
+    bool TestForBlock(CTxMemPool::txiter iter);
+    /** Test if tx still has unconfirmed parents not yet in block */
+    bool isStillDependent(CTxMemPool::txiter iter);
+
+    // helper functions for addPackageTxs()
+    /** Remove confirmed (inBlock) entries from given set */
+    void onlyUnconfirmed(CTxMemPool::setEntries& testSet);
+    /** Test if a new package would "fit" in the block */
+    bool TestPackage(uint64_t packageSize, unsigned int packageSigOps);
+    /** Test if a set of transactions are all final */
+    bool TestPackageFinality(const CTxMemPool::setEntries& package);
+    /** Return true if given transaction from mapTx has already been evaluated,
+      * or if the transaction's cached data in mapTx is incorrect. */
+    bool SkipMapTxEntry(CTxMemPool::txiter it, indexed_modified_transaction_set &mapModifiedTx, CTxMemPool::setEntries &failedTx);
+    /** Sort the package in an order that is valid to appear in a block */
+    void SortForBlock(const CTxMemPool::setEntries& package, std::vector<CTxMemPool::txiter>& sortedEntries);
+    /** Add descendants of given transactions to mapModifiedTx with ancestor
+      * state updated assuming given transactions are inBlock. */
+    void UpdatePackagesForAdded(const CTxMemPool::setEntries& alreadyAdded, indexed_modified_transaction_set &mapModifiedTx);
+};
+
+/**
+ * Block templates for getblocktemplate, keyed by the tip they build on and
+ * the mempool's transactions updated counter.
+ *
+ * Once somebody asked for a template, a background thread builds a new one
+ * as soon as the tip changes and, at most every MIN_REBUILD_INTERVAL
+ * seconds, when the mempool changed, so getblocktemplate usually only has to
+ * copy the latest one. Long polling clients are woken up when the tip
+ * changes or when a template pays FEE_CHANGE_PERCENT more fees than the last
+ * one they were woken up for.
+ */
+class CBlockTemplateCache : public CValidationInterface
+{
+private:
+    //! Don't rebuild the template for an unchanged tip more often than this (in seconds)
+    static const int64_t MIN_REBUILD_INTERVAL = 5;
+    //! Fee increase (in percent) that makes a template worth waking long polling clients for
+    static const int FEE_CHANGE_PERCENT = 5;
+
+    CBlockTemplateCache(const CBlockTemplateCache&);
+    CBlockTemplateCache& operator=(const CBlockTemplateCache&);
+
+    const CChainParams& chainparams;
+
+    boost::mutex mutex;
+    boost::condition_variable condWork;
+    boost::condition_variable condChanged;
+
+    std::shared_ptr<const CBlockTemplate> ptemplate;
+    unsigned int nTemplateTransactionsUpdated;
+    int64_t nTemplateTime;
+    // best block as of the last UpdatedBlockTip (or Get)
+    uint256 hashTip;
+    bool fInitialDownload;
+    // the template long polling clients were last woken up for
+    uint256 hashLongPollTip;
+    unsigned int nLongPollTransactionsUpdated;
+    CAmount nLongPollFees;
+    bool fBuilding;
+    bool fActive; // somebody asked for a template, keep it up to date
+    bool fStop;
+
+    boost::thread thread;
+
+    void ThreadBuild();
+    bool IsFresh(const uint256& hashBest, int64_t nNow) const;
+    bool Build(boost::unique_lock<boost::mutex>& lock, std::string& strError);
+
+protected:
+    void UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockIndex *pindexFork, bool fInitialDownload) override;
+
+public:
+    explicit CBlockTemplateCache(const CChainParams& chainparamsIn);
+    virtual ~CBlockTemplateCache();
+
+    /**
+     * The template for the current tip, built by the caller only if the
+     * cached one is stale. Must not be called with cs_main held, and
+     * throws std::runtime_error if a new template can't be created.
+     */
+    std::shared_ptr<const CBlockTemplate> Get(unsigned int& nTransactionsUpdatedRet);
+    /**
+     * Wait until the tip is no longer hashWatched or a better template than
+     * the one built at nTransactionsUpdated is available. Returns false if
+     * deadline passed first.
+     */
+    bool WaitForChange(const uint256& hashWatched, unsigned int nTransactionsUpdated, const boost::system_time& deadline);
+};
+
+/** Global template cache for getblocktemplate */
+extern CBlockTemplateCache* pblocktemplatecache;
+
 /** Run the miner threads */
 void GenerateBitcoins(bool fGenerate, int nThreads, const CChainParams& chainparams, CConnman& connman);
 /** Generate a new block, without valid proof-of-work */
@@ -31,6 +31,11 @@
 #include <string.h>
 #else
 #include <fcntl.h>
+#include <sys/uio.h>
+#endif
+
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
 #endif
 
 #ifdef USE_UPNP
@@ -49,6 +54,15 @@
 // We add a random period time (0 to 1 seconds) to feeler connections to prevent synchronization.
 #define FEELER_SLEEP_WINDOW 1
 
+// How long ThreadSocketHandler waits for socket events before polling pnode->vSend again (in ms)
+#define SOCKET_EVENTS_TIMEOUT 50
+
+// Maximum number of events taken from the kernel in one epoll_wait() call
+#define MAX_EPOLL_EVENTS 1024
+
+// Maximum number of queued messages handed to the kernel in one sendmsg() call
+#define MAX_SEND_IOVECS 64
+
 #if !defined(HAVE_MSG_NOSIGNAL) && !defined(MSG_NOSIGNAL)
 #define MSG_NOSIGNAL 0
 #endif
@@ -81,7 +95,7 @@ static bool vfLimited[NET_MAX] = {};
 static CNode* pnodeLocalHost = NULL;
 std::string strSubVersion;
 
-std::map<CInv, CDataStream> mapRelay;
+std::map<CInv, CSerializedNetMsg> mapRelay;
 std::deque<pair<int64_t, CInv> > vRelayExpiration;
 CCriticalSection cs_mapRelay;
 limitedmap<uint256, int64_t> mapAlreadyAskedFor(MAX_INV_SZ);
@@ -383,7 +397,7 @@ CNode* CConnman::ConnectNode(CAddress addrConnect, const char *pszDest, bool fCo
     if (pszDest ? ConnectSocketByName(addrConnect, hSocket, pszDest, Params().GetDefaultPort(), nConnectTimeout, &proxyConnectionFailed) :
                   ConnectSocket(addrConnect, hSocket, nConnectTimeout, &proxyConnectionFailed))
     {
-        if (!IsSelectableSocket(hSocket)) {
+        if (socketEventsMode == SOCKETEVENTS_SELECT && !IsSelectableSocket(hSocket)) {
             LogPrintf("Cannot create connection: non-selectable socket created (fd >= FD_SETSIZE ?)\n");
             CloseSocket(hSocket);
             return NULL;
@@ -425,6 +439,7 @@ CNode* CConnman::ConnectNode(CAddress addrConnect, const char *pszDest, bool fCo
         }
 
         GetNodeSignals().InitializeNode(pnode, *this);
+        RegisterEvents(hSocket, pnode, true);
         LOCK(cs_vNodes);
         vNodes.push_back(pnode);
 
@@ -650,6 +665,7 @@ void CNode::copyStats(CNodeStats &stats)
     X(mapSendBytesPerMsgCmd);
     X(nRecvBytes);
     X(mapRecvBytesPerMsgCmd);
+    X(mapProcessTimePerMsgCmd);
     X(fWhitelisted);
 
     // It is common for nodes with good ping times to suddenly become lagged,
@@ -809,24 +825,49 @@ int CNetMessage::readData(const char *pch, unsigned int nBytes)
 // requires LOCK(cs_vSend)
 size_t CConnman::SocketSendData(CNode *pnode)
 {
-    std::deque<CSerializeData>::iterator it = pnode->vSendMsg.begin();
+    std::deque<CSerializedNetMsg>::iterator it = pnode->vSendMsg.begin();
     size_t nSentSize = 0;
 
     while (it != pnode->vSendMsg.end()) {
-        const CSerializeData &data = *it;
+        const CSerializeData &data = **it;
         assert(data.size() > pnode->nSendOffset);
+#ifdef WIN32
         int nBytes = send(pnode->hSocket, &data[pnode->nSendOffset], data.size() - pnode->nSendOffset, MSG_NOSIGNAL | MSG_DONTWAIT);
+#else
+        // Gather as many queued messages as possible into a single syscall
+        struct iovec iov[MAX_SEND_IOVECS];
+        iov[0].iov_base = (void*)&data[pnode->nSendOffset];
+        iov[0].iov_len = data.size() - pnode->nSendOffset;
+        int nIov = 1;
+        for (std::deque<CSerializedNetMsg>::iterator itNext = it + 1; itNext != pnode->vSendMsg.end() && nIov < MAX_SEND_IOVECS; ++itNext, ++nIov) {
+            iov[nIov].iov_base = (void*)(*itNext)->data();
+            iov[nIov].iov_len = (*itNext)->size();
+        }
+        struct msghdr msg = {};
+        msg.msg_iov = iov;
+        msg.msg_iovlen = nIov;
+        ssize_t nBytes = sendmsg(pnode->hSocket, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+#endif
         if (nBytes > 0) {
             pnode->nLastSend = GetSystemTimeInSeconds();
             pnode->nSendBytes += nBytes;
-            pnode->nSendOffset += nBytes;
             nSentSize += nBytes;
-            if (pnode->nSendOffset == data.size()) {
+            // Advance over every message that was sent completely
+            size_t nRemaining = nBytes;
+            while (nRemaining > 0) {
+                size_t nMsgSize = (*it)->size();
+                size_t nLeft = nMsgSize - pnode->nSendOffset;
+                if (nRemaining < nLeft) {
+                    pnode->nSendOffset += nRemaining;
+                    break;
+                }
+                nRemaining -= nLeft;
                 pnode->nSendOffset = 0;
-                pnode->nSendSize -= data.size();
-                pnode->fPauseSend = pnode->nSendSize > nSendBufferMaxSize;
+                pnode->nSendSize -= nMsgSize;
                 it++;
-            } else {
+            }
+            pnode->fPauseSend = pnode->nSendSize > nSendBufferMaxSize;
+            if (pnode->nSendOffset != 0) {
                 // could not send full message; stop sending more
                 break;
             }
@@ -1053,7 +1094,7 @@ void CConnman::AcceptConnection(const ListenSocket& hListenSocket) {
         return;
     }
 
-    if (!IsSelectableSocket(hSocket))
+    if (socketEventsMode == SOCKETEVENTS_SELECT && !IsSelectableSocket(hSocket))
     {
         LogPrintf("connection from %s dropped: non-selectable socket\n", addr.ToString());
         CloseSocket(hSocket);
@@ -1099,6 +1140,7 @@ void CConnman::AcceptConnection(const ListenSocket& hListenSocket) {
 
     LogPrint("net", "connection from %s accepted\n", addr.ToString());
 
+    RegisterEvents(hSocket, pnode, true);
     {
         LOCK(cs_vNodes);
         vNodes.push_back(pnode);
@@ -1108,6 +1150,7 @@ void CConnman::AcceptConnection(const ListenSocket& hListenSocket) {
 void CConnman::ThreadSocketHandler()
 {
     unsigned int nPrevNodeCount = 0;
+    bool fHaveWork = false;
     while (!interruptNet)
     {
         //
@@ -1132,6 +1175,8 @@ void CConnman::ThreadSocketHandler()
                     pnode->grantMasternodeOutbound.Release();
 
                     // close socket and cleanup
+                    if (pnode->hSocket != INVALID_SOCKET)
+                        UnregisterEvents(pnode->hSocket);
                     pnode->CloseSocketDisconnect();
 
                     // hold in disconnected pool until all refs are released
@@ -1181,97 +1226,19 @@ void CConnman::ThreadSocketHandler()
         }
 
         //
-        // Find which sockets have data to receive
+        // Find which sockets are ready and accept new connections
         //
-        struct timeval timeout;
-        timeout.tv_sec  = 0;
-        timeout.tv_usec = 50000; // frequency to poll pnode->vSend
-
-        fd_set fdsetRecv;
-        fd_set fdsetSend;
-        fd_set fdsetError;
-        FD_ZERO(&fdsetRecv);
-        FD_ZERO(&fdsetSend);
-        FD_ZERO(&fdsetError);
-        SOCKET hSocketMax = 0;
-        bool have_fds = false;
-
-        BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket) {
-            FD_SET(hListenSocket.socket, &fdsetRecv);
-            hSocketMax = std::max(hSocketMax, hListenSocket.socket);
-            have_fds = true;
-        }
-
-        {
-            LOCK(cs_vNodes);
-            BOOST_FOREACH(CNode* pnode, vNodes)
-            {
-                if (pnode->hSocket == INVALID_SOCKET)
-                    continue;
-                FD_SET(pnode->hSocket, &fdsetError);
-                hSocketMax = std::max(hSocketMax, pnode->hSocket);
-                have_fds = true;
-
-                // Implement the following logic:
-                // * If there is data to send, select() for sending data. As this only
-                //   happens when optimistic write failed, we choose to first drain the
-                //   write buffer in this case before receiving more. This avoids
-                //   needlessly queueing received data, if the remote peer is not themselves
-                //   receiving data. This means properly utilizing TCP flow control signalling.
-                // * Otherwise, if there is space left in the receive buffer, select() for
-                //   receiving data.
-                // * Hand off all complete messages to the processor, to be handled without
-                //   blocking here.
-                {
-                    TRY_LOCK(pnode->cs_vSend, lockSend);
-                    if (lockSend) {
-                        if (!pnode->vSendMsg.empty()) {
-                            FD_SET(pnode->hSocket, &fdsetSend);
-                            continue;
-                        }
-                    }
-                }
-                {
-                    if (!pnode->fPauseRecv)
-                        FD_SET(pnode->hSocket, &fdsetRecv);
-                }
-            }
-        }
-
-        int nSelect = select(have_fds ? hSocketMax + 1 : 0,
-                             &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
+        if (socketEventsMode == SOCKETEVENTS_EPOLL)
+            SocketEventsEpoll(fHaveWork);
+        else
+            SocketEventsSelect();
         if (interruptNet)
             return;
 
-        if (nSelect == SOCKET_ERROR)
-        {
-            if (have_fds)
-            {
-                int nErr = WSAGetLastError();
-                LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
-                for (unsigned int i = 0; i <= hSocketMax; i++)
-                    FD_SET(i, &fdsetRecv);
-            }
-            FD_ZERO(&fdsetSend);
-            FD_ZERO(&fdsetError);
-            if (!interruptNet.sleep_for(std::chrono::milliseconds(timeout.tv_usec/1000)))
-                return;
-        }
-
-        //
-        // Accept new connections
-        //
-        BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket)
-        {
-            if (hListenSocket.socket != INVALID_SOCKET && FD_ISSET(hListenSocket.socket, &fdsetRecv))
-            {
-                AcceptConnection(hListenSocket);
-            }
-        }
-
         //
         // Service each socket
         //
+        fHaveWork = false;
         std::vector<CNode*> vNodesCopy = CopyNodeVector();
         BOOST_FOREACH(CNode* pnode, vNodesCopy)
         {
@@ -1283,13 +1250,25 @@ void CConnman::ThreadSocketHandler()
             //
             if (pnode->hSocket == INVALID_SOCKET)
                 continue;
-            if (FD_ISSET(pnode->hSocket, &fdsetRecv) || FD_ISSET(pnode->hSocket, &fdsetError))
+
+            // Drain the send buffer before receiving more, see SocketEventsSelect()
+            bool fHaveSendData = false;
+            if (pnode->fSocketRecvReady || pnode->fSocketSendReady)
+            {
+                TRY_LOCK(pnode->cs_vSend, lockSend);
+                if (lockSend)
+                    fHaveSendData = !pnode->vSendMsg.empty();
+            }
+            if (pnode->fSocketRecvReady && !fHaveSendData && !pnode->fPauseRecv)
             {
                 {
                     {
                         // typical socket buffer is 8K-64K
                         char pchBuf[0x10000];
                         int nBytes = recv(pnode->hSocket, pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
+                        // a short read means the socket was drained, epoll reports when more data arrives
+                        if (nBytes < (int)sizeof(pchBuf))
+                            pnode->fSocketRecvReady = false;
                         if (nBytes > 0)
                         {
                             bool notify = false;
@@ -1310,7 +1289,7 @@ void CConnman::ThreadSocketHandler()
                                     pnode->nProcessQueueSize += nSizeAdded;
                                     pnode->fPauseRecv = pnode->nProcessQueueSize > nReceiveFloodSize;
                                 }
-                                WakeMessageHandler();
+                                WakeMessageHandler(pnode->GetId());
                             }
                         }
                         else if (nBytes == 0)
@@ -1340,7 +1319,7 @@ void CConnman::ThreadSocketHandler()
             //
             if (pnode->hSocket == INVALID_SOCKET)
                 continue;
-            if (FD_ISSET(pnode->hSocket, &fdsetSend))
+            if (pnode->fSocketSendReady && fHaveSendData)
             {
                 TRY_LOCK(pnode->cs_vSend, lockSend);
                 if (lockSend) {
@@ -1348,9 +1327,16 @@ void CConnman::ThreadSocketHandler()
                     if (nBytes) {
                         RecordBytesSent(nBytes);
                     }
+                    // the socket buffer is full, epoll reports when it has room again
+                    if (!pnode->vSendMsg.empty())
+                        pnode->fSocketSendReady = false;
                 }
             }
 
+            // A full read left data in the socket, don't block in epoll_wait
+            if (pnode->fSocketRecvReady && pnode->hSocket != INVALID_SOCKET && !pnode->fPauseRecv)
+                fHaveWork = true;
+
             //
             // Inactivity checking
             //
@@ -1383,13 +1369,243 @@ void CConnman::ThreadSocketHandler()
     }
 }
 
+void CNode::RecordProcessTime(const std::string& strCommand, int64_t nTimeMicros)
+{
+    // like mapRecvBytesPerMsgCmd, only valid commands get their own entry
+    mapMsgCmdSize::iterator i = mapProcessTimePerMsgCmd.find(strCommand);
+    if (i == mapProcessTimePerMsgCmd.end())
+        i = mapProcessTimePerMsgCmd.find(NET_MESSAGE_COMMAND_OTHER);
+    assert(i != mapProcessTimePerMsgCmd.end());
+    i->second += nTimeMicros;
+}
+
+void CConnman::SocketEventsSelect()
+{
+    struct timeval timeout;
+    timeout.tv_sec  = 0;
+    timeout.tv_usec = SOCKET_EVENTS_TIMEOUT * 1000; // frequency to poll pnode->vSend
+
+    fd_set fdsetRecv;
+    fd_set fdsetSend;
+    fd_set fdsetError;
+    FD_ZERO(&fdsetRecv);
+    FD_ZERO(&fdsetSend);
+    FD_ZERO(&fdsetError);
+    SOCKET hSocketMax = 0;
+    bool have_fds = false;
+
+    BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket) {
+        FD_SET(hListenSocket.socket, &fdsetRecv);
+        hSocketMax = std::max(hSocketMax, hListenSocket.socket);
+        have_fds = true;
+    }
+
+    {
+        LOCK(cs_vNodes);
+        BOOST_FOREACH(CNode* pnode, vNodes)
+        {
+            if (pnode->hSocket == INVALID_SOCKET)
+                continue;
+            FD_SET(pnode->hSocket, &fdsetError);
+            hSocketMax = std::max(hSocketMax, pnode->hSocket);
+            have_fds = true;
+
+            // Implement the following logic:
+            // * If there is data to send, select() for sending data. As this only
+            //   happens when optimistic write failed, we choose to first drain the
+            //   write buffer in this case before receiving more. This avoids
+            //   needlessly queueing received data, if the remote peer is not themselves
+            //   receiving data. This means properly utilizing TCP flow control signalling.
+            // * Otherwise, if there is space left in the receive buffer, select() for
+            //   receiving data.
+            // * Hand off all complete messages to the processor, to be handled without
+            //   blocking here.
+            {
+                TRY_LOCK(pnode->cs_vSend, lockSend);
+                if (lockSend) {
+                    if (!pnode->vSendMsg.empty()) {
+                        FD_SET(pnode->hSocket, &fdsetSend);
+                        continue;
+                    }
+                }
+            }
+            {
+                if (!pnode->fPauseRecv)
+                    FD_SET(pnode->hSocket, &fdsetRecv);
+            }
+        }
+    }
+
+    int nSelect = select(have_fds ? hSocketMax + 1 : 0,
+                         &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
+    if (interruptNet)
+        return;
+
+    if (nSelect == SOCKET_ERROR)
+    {
+        if (have_fds)
+        {
+            int nErr = WSAGetLastError();
+            LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
+            for (unsigned int i = 0; i <= hSocketMax; i++)
+                FD_SET(i, &fdsetRecv);
+        }
+        FD_ZERO(&fdsetSend);
+        FD_ZERO(&fdsetError);
+        if (!interruptNet.sleep_for(std::chrono::milliseconds(SOCKET_EVENTS_TIMEOUT)))
+            return;
+    }
+
+    //
+    // Accept new connections
+    //
+    BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket)
+    {
+        if (hListenSocket.socket != INVALID_SOCKET && FD_ISSET(hListenSocket.socket, &fdsetRecv))
+        {
+            AcceptConnection(hListenSocket);
+        }
+    }
+
+    {
+        LOCK(cs_vNodes);
+        BOOST_FOREACH(CNode* pnode, vNodes)
+        {
+            if (pnode->hSocket == INVALID_SOCKET)
+                continue;
+            pnode->fSocketRecvReady = FD_ISSET(pnode->hSocket, &fdsetRecv) || FD_ISSET(pnode->hSocket, &fdsetError);
+            pnode->fSocketSendReady = FD_ISSET(pnode->hSocket, &fdsetSend);
+        }
+    }
+}
+
+void CConnman::SocketEventsEpoll(bool fHaveWork)
+{
+#ifdef HAVE_SYS_EPOLL_H
+    // Node sockets are registered edge-triggered with the node as event data,
+    // so only the sockets epoll reports are touched here. A node stays ready
+    // until ThreadSocketHandler drained its socket, don't block if one of them
+    // can be serviced right away.
+    struct epoll_event events[MAX_EPOLL_EVENTS];
+    int nEvents = epoll_wait(epollfd, events, MAX_EPOLL_EVENTS, fHaveWork ? 0 : SOCKET_EVENTS_TIMEOUT);
+    if (interruptNet)
+        return;
+
+    if (nEvents == SOCKET_ERROR)
+    {
+        int nErr = WSAGetLastError();
+        if (nErr != WSAEINTR) {
+            LogPrintf("socket epoll_wait error %s\n", NetworkErrorString(nErr));
+            if (!interruptNet.sleep_for(std::chrono::milliseconds(SOCKET_EVENTS_TIMEOUT)))
+                return;
+        }
+        nEvents = 0;
+    }
+
+    for (int i = 0; i < nEvents; i++) {
+        bool fListenSocket = false;
+        BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket) {
+            if (events[i].data.ptr == &hListenSocket) {
+                AcceptConnection(hListenSocket);
+                fListenSocket = true;
+                break;
+            }
+        }
+        if (fListenSocket)
+            continue;
+
+        // Nodes are only deleted by ThreadSocketHandler after they were unregistered
+        CNode* pnode = static_cast<CNode*>(events[i].data.ptr);
+        // errors and hangups are picked up by the next recv()
+        if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLERR | EPOLLHUP))
+            pnode->fSocketRecvReady = true;
+        if (events[i].events & EPOLLOUT)
+            pnode->fSocketSendReady = true;
+    }
+#else
+    assert(false); // ParseSocketEventsMode() refuses epoll when it's not available
+#endif
+}
+
+void CConnman::RegisterEvents(SOCKET hSocket, void* pdata, bool fEdgeTriggered)
+{
+#ifdef HAVE_SYS_EPOLL_H
+    if (socketEventsMode != SOCKETEVENTS_EPOLL)
+        return;
+
+    struct epoll_event event;
+    event.data.ptr = pdata;
+    event.events = fEdgeTriggered ? (EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET) : EPOLLIN;
+    if (epoll_ctl(epollfd, EPOLL_CTL_ADD, hSocket, &event) == SOCKET_ERROR)
+        LogPrintf("epoll_ctl failed for socket %d: %s\n", hSocket, NetworkErrorString(WSAGetLastError()));
+#endif
+}
+
+void CConnman::UnregisterEvents(SOCKET hSocket)
+{
+#ifdef HAVE_SYS_EPOLL_H
+    if (socketEventsMode != SOCKETEVENTS_EPOLL)
+        return;
+
+    // Closing the socket would unregister it too, but events for the node must
+    // not be reported after it was handed to vNodesDisconnected
+    struct epoll_event event;
+    if (epoll_ctl(epollfd, EPOLL_CTL_DEL, hSocket, &event) == SOCKET_ERROR)
+        LogPrintf("epoll_ctl failed for socket %d: %s\n", hSocket, NetworkErrorString(WSAGetLastError()));
+#endif
+}
+
+bool ParseSocketEventsMode(const std::string& strMode, SocketEventsMode& modeRet)
+{
+    if (strMode == "select") {
+        modeRet = SOCKETEVENTS_SELECT;
+        return true;
+    }
+#ifdef HAVE_SYS_EPOLL_H
+    if (strMode == "epoll") {
+        modeRet = SOCKETEVENTS_EPOLL;
+        return true;
+    }
+#endif
+    return false;
+}
+
+std::string GetSocketEventsModeName(SocketEventsMode mode)
+{
+    switch (mode) {
+        case SOCKETEVENTS_SELECT: return "select";
+        case SOCKETEVENTS_EPOLL: return "epoll";
+    }
+    return "unknown";
+}
+
+std::string GetSupportedSocketEventsModes()
+{
+#ifdef HAVE_SYS_EPOLL_H
+    return "select, epoll";
+#else
+    return "select";
+#endif
+}
+
 void CConnman::WakeMessageHandler()
 {
     {
         std::lock_guard<std::mutex> lock(mutexMsgProc);
-        fMsgProcWake = true;
+        vMsgProcWake.assign(vMsgProcWake.size(), true);
+    }
+    condMsgProc.notify_all();
+}
+
+void CConnman::WakeMessageHandler(NodeId nodeid)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutexMsgProc);
+        if (vMsgProcWake.empty())
+            return;
+        vMsgProcWake[nodeid % vMsgProcWake.size()] = true;
     }
-    condMsgProc.notify_one();
+    condMsgProc.notify_all();
 }
 
 
@@ -1915,7 +2131,7 @@ bool CConnman::OpenNetworkConnection(const CAddress& addrConnect, CSemaphoreGran
     return true;
 }
 
-void CConnman::ThreadMessageHandler()
+void CConnman::ThreadMessageHandler(int nShard)
 {
     SetThreadPriority(THREAD_PRIORITY_BELOW_NORMAL);
     while (!flagInterruptMsgProc)
@@ -1926,6 +2142,9 @@ void CConnman::ThreadMessageHandler()
 
         BOOST_FOREACH(CNode* pnode, vNodesCopy)
         {
+            // all messages of a peer are handled by the same thread, in order
+            if (pnode->GetId() % nMessageHandlerThreads != nShard)
+                continue;
             if (pnode->fDisconnect)
                 continue;
 
@@ -1949,9 +2168,9 @@ void CConnman::ThreadMessageHandler()
 
         std::unique_lock<std::mutex> lock(mutexMsgProc);
         if (!fMoreWork) {
-            condMsgProc.wait_until(lock, std::chrono::steady_clock::now() + std::chrono::milliseconds(100), [this] { return fMsgProcWake; });
+            condMsgProc.wait_until(lock, std::chrono::steady_clock::now() + std::chrono::milliseconds(100), [this, nShard] { return vMsgProcWake[nShard]; });
         }
-        fMsgProcWake = false;
+        vMsgProcWake[nShard] = false;
     }
 }
 
@@ -2145,6 +2364,9 @@ CConnman::CConnman()
     nBestHeight = 0;
     clientInterface = NULL;
     flagInterruptMsgProc = false;
+    nMessageHandlerThreads = 1;
+    socketEventsMode = SOCKETEVENTS_SELECT;
+    epollfd = -1;
 }
 
 NodeId CConnman::GetNewNodeId()
@@ -2170,6 +2392,21 @@ bool CConnman::Start(CScheduler& scheduler, std::string& strNodeError, Options c
     nSendBufferMaxSize = connOptions.nSendBufferMaxSize;
     nReceiveFloodSize = connOptions.nReceiveFloodSize;
 
+    socketEventsMode = connOptions.socketEventsMode;
+#ifdef HAVE_SYS_EPOLL_H
+    if (socketEventsMode == SOCKETEVENTS_EPOLL) {
+        epollfd = epoll_create1(EPOLL_CLOEXEC);
+        if (epollfd == -1) {
+            strNodeError = strprintf(_("Failed to create epoll instance: %s"), NetworkErrorString(WSAGetLastError()));
+            return false;
+        }
+        BOOST_FOREACH(ListenSocket& hListenSocket, vhListenSocket) {
+            RegisterEvents(hListenSocket.socket, &hListenSocket, false);
+        }
+    }
+#endif
+    LogPrintf("Using %s for socket events\n", GetSocketEventsModeName(socketEventsMode));
+
     SetBestHeight(connOptions.nBestHeight);
 
     clientInterface = connOptions.uiInterface;
@@ -2232,9 +2469,10 @@ bool CConnman::Start(CScheduler& scheduler, std::string& strNodeError, Options c
     interruptNet.reset();
     flagInterruptMsgProc = false;
 
+    nMessageHandlerThreads = std::max(1, std::min(connOptions.nMessageHandlerThreads, MAX_MSGHAND_THREADS));
     {
         std::unique_lock<std::mutex> lock(mutexMsgProc);
-        fMsgProcWake = false;
+        vMsgProcWake.assign(nMessageHandlerThreads, false);
     }
 
     // Send and receive from sockets, accept connections
@@ -2254,8 +2492,10 @@ bool CConnman::Start(CScheduler& scheduler, std::string& strNodeError, Options c
     // Initiate masternode connections
     threadMnbRequestConnections = std::thread(&TraceThread<std::function<void()> >, "mnbcon", std::function<void()>(std::bind(&CConnman::ThreadMnbRequestConnections, this)));
 
-    // Process messages
-    threadMessageHandler = std::thread(&TraceThread<std::function<void()> >, "msghand", std::function<void()>(std::bind(&CConnman::ThreadMessageHandler, this)));
+    // Process messages, every thread takes care of its own share of the peers
+    LogPrintf("Using %d threads for message processing\n", nMessageHandlerThreads);
+    for (int i = 0; i < nMessageHandlerThreads; i++)
+        threadMessageHandlers.push_back(std::thread(&TraceThread<std::function<void()> >, "msghand", std::function<void()>(std::bind(&CConnman::ThreadMessageHandler, this, i))));
 
     // Dump network addresses
     scheduler.scheduleEvery(boost::bind(&CConnman::DumpData, this), DUMP_ADDRESSES_INTERVAL);
@@ -2304,8 +2544,11 @@ void CConnman::Interrupt()
 
 void CConnman::Stop()
 {
-    if (threadMessageHandler.joinable())
-        threadMessageHandler.join();
+    BOOST_FOREACH(std::thread& threadMessageHandler, threadMessageHandlers) {
+        if (threadMessageHandler.joinable())
+            threadMessageHandler.join();
+    }
+    threadMessageHandlers.clear();
     if (threadMnbRequestConnections.joinable())
         threadMnbRequestConnections.join();
     if (threadOpenConnections.joinable())
@@ -2346,6 +2589,12 @@ void CConnman::Stop()
     vNodes.clear();
     vNodesDisconnected.clear();
     vhListenSocket.clear();
+#ifdef HAVE_SYS_EPOLL_H
+    if (epollfd != -1) {
+        close(epollfd);
+        epollfd = -1;
+    }
+#endif
     delete semOutbound;
     semOutbound = NULL;
     delete semMasternodeOutbound;
@@ -2496,6 +2745,7 @@ void CConnman::RelayTransaction(const CTransaction& tx, const CDataStream& ss)
     int nInv = static_cast<bool>(CPrivateSend::GetDSTX(hash)) ? MSG_DSTX :
                 (instantsend.HasTxLockRequest(hash) ? MSG_TXLOCK_REQUEST : MSG_TX);
     CInv inv(nInv, hash);
+    CSerializedNetMsg msg = MakeMessage(PROTOCOL_VERSION, inv.GetCommand(), ss);
     {
         LOCK(cs_mapRelay);
         // Expire old relay messages
@@ -2506,7 +2756,7 @@ void CConnman::RelayTransaction(const CTransaction& tx, const CDataStream& ss)
         }
 
         // Save original serialized message so newer versions are preserved
-        mapRelay.insert(std::make_pair(inv, ss));
+        mapRelay.insert(std::make_pair(inv, msg));
         vRelayExpiration.push_back(std::make_pair(GetTime() + 15 * 60, inv));
     }
     LOCK(cs_vNodes);
@@ -2715,14 +2965,19 @@ CNode::CNode(NodeId idIn, ServiceFlags nLocalServicesIn, int nMyStartingHeightIn
     nLocalServices = nLocalServicesIn;
     fPauseRecv = false;
     fPauseSend = false;
+    fSocketRecvReady = false;
+    fSocketSendReady = false;
     nProcessQueueSize = 0;
 
     GetRandBytes((unsigned char*)&nLocalHostNonce, sizeof(nLocalHostNonce));
     nMyStartingHeight = nMyStartingHeightIn;
 
-    BOOST_FOREACH(const std::string &msg, getAllNetMessageTypes())
+    BOOST_FOREACH(const std::string &msg, getAllNetMessageTypes()) {
         mapRecvBytesPerMsgCmd[msg] = 0;
+        mapProcessTimePerMsgCmd[msg] = 0;
+    }
     mapRecvBytesPerMsgCmd[NET_MESSAGE_COMMAND_OTHER] = 0;
+    mapProcessTimePerMsgCmd[NET_MESSAGE_COMMAND_OTHER] = 0;
 
     if(fNetworkNode || fInbound)
         AddRef();
@@ -2818,6 +3073,18 @@ CDataStream CConnman::BeginMessage(CNode* pnode, int nVersion, int flags, const
     return {SER_NETWORK, (nVersion ? nVersion : pnode->GetSendVersion()) | flags, CMessageHeader(Params().MessageStart(), sCommand.c_str(), 0) };
 }
 
+CDataStream CConnman::BeginMessage(int nVersion, const std::string& sCommand)
+{
+    return {SER_NETWORK, nVersion, CMessageHeader(Params().MessageStart(), sCommand.c_str(), 0) };
+}
+
+CSerializedNetMsg CConnman::GetMessageData(CDataStream& strm)
+{
+    std::shared_ptr<CSerializeData> data = std::make_shared<CSerializeData>();
+    strm.GetAndClear(*data);
+    return data;
+}
+
 void CConnman::EndMessage(CDataStream& strm)
 {
     // Set the size
@@ -2835,8 +3102,16 @@ void CConnman::PushMessage(CNode* pnode, CDataStream& strm, const std::string& s
     if(strm.empty())
         return;
 
-    unsigned int nSize = strm.size() - CMessageHeader::HEADER_SIZE;
-    LogPrint("net", "sending %s (%d bytes) peer=%d\n",  SanitizeString(sCommand.c_str()), nSize, pnode->id);
+    PushMessage(pnode, GetMessageData(strm), sCommand);
+}
+
+void CConnman::PushMessage(CNode* pnode, const CSerializedNetMsg& msg, const std::string& sCommand)
+{
+    if(!msg || msg->empty())
+        return;
+
+    size_t nMessageSize = msg->size();
+    LogPrint("net", "sending %s (%d bytes) peer=%d\n",  SanitizeString(sCommand.c_str()), nMessageSize - CMessageHeader::HEADER_SIZE, pnode->id);
 
     size_t nBytesSent = 0;
     {
@@ -2845,11 +3120,11 @@ void CConnman::PushMessage(CNode* pnode, CDataStream& strm, const std::string& s
             return;
         }
         bool optimisticSend(pnode->vSendMsg.empty());
-        pnode->vSendMsg.emplace_back(strm.begin(), strm.end());
+        pnode->vSendMsg.push_back(msg);
 
         //log total amount of bytes per command
-        pnode->mapSendBytesPerMsgCmd[sCommand] += strm.size();
-        pnode->nSendSize += strm.size();
+        pnode->mapSendBytesPerMsgCmd[sCommand] += nMessageSize;
+        pnode->nSendSize += nMessageSize;
 
         if (pnode->nSendSize > nSendBufferMaxSize)
             pnode->fPauseSend = true;
@@ -85,6 +85,23 @@ static const bool DEFAULT_BLOCKSONLY = false;
 static const bool DEFAULT_FORCEDNSSEED = false;
 static const size_t DEFAULT_MAXRECEIVEBUFFER = 5 * 1000;
 static const size_t DEFAULT_MAXSENDBUFFER    = 1 * 1000;
+/** -msghandthreads default */
+static const int DEFAULT_MSGHAND_THREADS = 1;
+/** Maximum number of message handler threads */
+static const int MAX_MSGHAND_THREADS = 16;
+
+/** Mechanisms ThreadSocketHandler can use to wait for socket events */
+enum SocketEventsMode {
+    SOCKETEVENTS_SELECT = 0,
+    SOCKETEVENTS_EPOLL = 1,
+};
+
+/** -socketevents default */
+#ifdef HAVE_SYS_EPOLL_H
+static const SocketEventsMode DEFAULT_SOCKETEVENTS = SOCKETEVENTS_EPOLL;
+#else
+static const SocketEventsMode DEFAULT_SOCKETEVENTS = SOCKETEVENTS_SELECT;
+#endif
 
 static const ServiceFlags REQUIRED_SERVICES = NODE_NETWORK;
 
@@ -93,6 +110,9 @@ static const unsigned int DEFAULT_MISBEHAVING_BANTIME = 60 * 60 * 24;  // Defaul
 
 typedef int NodeId;
 
+/** A fully serialized network message (header and payload), shared between all peers it is sent to */
+typedef std::shared_ptr<const CSerializeData> CSerializedNetMsg;
+
 struct AddedNodeInfo
 {
     std::string strAddedNode;
@@ -127,6 +147,8 @@ public:
         CClientUIInterface* uiInterface = nullptr;
         unsigned int nSendBufferMaxSize = 0;
         unsigned int nReceiveFloodSize = 0;
+        SocketEventsMode socketEventsMode = SOCKETEVENTS_SELECT;
+        int nMessageHandlerThreads = 1;
     };
     CConnman();
     ~CConnman();
@@ -183,6 +205,21 @@ public:
         PushMessage(pnode, msg, sCommand);
     }
 
+    /**
+     * Serialize a message once so it can be queued for many peers without
+     * copying it, see PushMessage(CNode*, const CSerializedNetMsg&, ...).
+     * Only use this for messages whose encoding does not depend on the
+     * protocol version negotiated with each peer.
+     */
+    template <typename... Args>
+    CSerializedNetMsg MakeMessage(int nVersion, const std::string& sCommand, Args&&... args)
+    {
+        auto msg(BeginMessage(nVersion, sCommand));
+        ::SerializeMany(msg, msg.nType, msg.nVersion, std::forward<Args>(args)...);
+        EndMessage(msg);
+        return GetMessageData(msg);
+    }
+
     template <typename... Args>
     void PushMessageWithFlag(CNode* pnode, int flag, const std::string& sCommand, Args&&... args)
     {
@@ -201,6 +238,9 @@ public:
         PushMessageWithVersionAndFlag(pnode, 0, 0, sCommand, std::forward<Args>(args)...);
     }
 
+    /// Queue a message serialized by MakeMessage, the buffer is shared and not copied
+    void PushMessage(CNode* pnode, const CSerializedNetMsg& msg, const std::string& sCommand);
+
     template<typename Condition, typename Callable>
     bool ForEachNodeContinueIf(const Condition& cond, Callable&& func)
     {
@@ -387,6 +427,8 @@ public:
 
 
     unsigned int GetReceiveFloodSize() const;
+
+    void WakeMessageHandler();
 private:
     struct ListenSocket {
         SOCKET socket;
@@ -398,14 +440,17 @@ private:
     void ThreadOpenAddedConnections();
     void ProcessOneShot();
     void ThreadOpenConnections();
-    void ThreadMessageHandler();
+    void ThreadMessageHandler(int nShard);
+    void WakeMessageHandler(NodeId nodeid);
     void AcceptConnection(const ListenSocket& hListenSocket);
     void ThreadSocketHandler();
+    void SocketEventsSelect();
+    void SocketEventsEpoll(bool fHaveWork);
+    void RegisterEvents(SOCKET hSocket, void* pdata, bool fEdgeTriggered);
+    void UnregisterEvents(SOCKET hSocket);
     void ThreadDNSAddressSeed();
     void ThreadMnbRequestConnections();
 
-    void WakeMessageHandler();
-
     CNode* FindNode(const CNetAddr& ip);
     CNode* FindNode(const CSubNet& subNet);
     CNode* FindNode(const std::string& addrName);
@@ -430,8 +475,10 @@ private:
     void DumpBanlist();
 
     CDataStream BeginMessage(CNode* node, int nVersion, int flags, const std::string& sCommand);
+    CDataStream BeginMessage(int nVersion, const std::string& sCommand);
     void PushMessage(CNode* pnode, CDataStream& strm, const std::string& sCommand);
     void EndMessage(CDataStream& strm);
+    static CSerializedNetMsg GetMessageData(CDataStream& strm);
 
     // Network stats
     void RecordBytesRecv(uint64_t bytes);
@@ -490,8 +537,11 @@ private:
     std::atomic<int> nBestHeight;
     CClientUIInterface* clientInterface;
 
-    /** flag for waking the message processor. */
-    bool fMsgProcWake;
+    /** Number of message handler threads, peers are assigned to them by id. */
+    int nMessageHandlerThreads;
+
+    /** flags for waking the message processors, one per thread. */
+    std::vector<bool> vMsgProcWake;
 
     std::condition_variable condMsgProc;
     std::mutex mutexMsgProc;
@@ -499,17 +549,24 @@ private:
 
     CThreadInterrupt interruptNet;
 
+    SocketEventsMode socketEventsMode;
+    // epoll instance all sockets are registered with when using SOCKETEVENTS_EPOLL
+    int epollfd;
+
     std::thread threadDNSAddressSeed;
     std::thread threadSocketHandler;
     std::thread threadOpenAddedConnections;
     std::thread threadOpenConnections;
     std::thread threadMnbRequestConnections;
-    std::thread threadMessageHandler;
+    std::vector<std::thread> threadMessageHandlers;
 };
 extern std::unique_ptr<CConnman> g_connman;
 void Discover(boost::thread_group& threadGroup);
 void MapPort(bool fUseUPnP);
 unsigned short GetListenPort();
+bool ParseSocketEventsMode(const std::string& strMode, SocketEventsMode& modeRet);
+std::string GetSocketEventsModeName(SocketEventsMode mode);
+std::string GetSupportedSocketEventsModes();
 bool BindListenPort(const CService &bindAddr, std::string& strError, bool fWhitelisted = false);
 
 struct CombinerAll
@@ -571,7 +628,8 @@ extern bool fDiscover;
 extern bool fListen;
 extern bool fRelayTxes;
 
-extern std::map<CInv, CDataStream> mapRelay;
+/** Recently relayed transactions, serialized once and shared by every getdata reply */
+extern std::map<CInv, CSerializedNetMsg> mapRelay;
 extern std::deque<std::pair<int64_t, CInv> > vRelayExpiration;
 extern CCriticalSection cs_mapRelay;
 extern limitedmap<uint256, int64_t> mapAlreadyAskedFor;
@@ -607,6 +665,7 @@ public:
     mapMsgCmdSize mapSendBytesPerMsgCmd;
     uint64_t nRecvBytes;
     mapMsgCmdSize mapRecvBytesPerMsgCmd;
+    mapMsgCmdSize mapProcessTimePerMsgCmd;
     bool fWhitelisted;
     double dPingTime;
     double dPingWait;
@@ -669,7 +728,7 @@ public:
     size_t nSendSize; // total size of all vSendMsg entries
     size_t nSendOffset; // offset inside the first vSendMsg already sent
     uint64_t nSendBytes;
-    std::deque<CSerializeData> vSendMsg;
+    std::deque<CSerializedNetMsg> vSendMsg;
     CCriticalSection cs_vSend;
 
     CCriticalSection cs_vProcessMsg;
@@ -719,16 +778,24 @@ public:
 
     std::atomic_bool fPauseRecv;
     std::atomic_bool fPauseSend;
+    // Socket can be read from/written to, only used by ThreadSocketHandler.
+    // With epoll these stay set until the socket was drained.
+    bool fSocketRecvReady;
+    bool fSocketSendReady;
 protected:
 
     mapMsgCmdSize mapSendBytesPerMsgCmd;
     mapMsgCmdSize mapRecvBytesPerMsgCmd;
+    // Time spent in ProcessMessage, in microseconds
+    mapMsgCmdSize mapProcessTimePerMsgCmd;
 
 public:
     uint256 hashContinue;
     int nStartingHeight;
 
     // flood relay
+    // vAddrToSend and addrKnown are also written while other peers' messages are processed
+    CCriticalSection cs_addrToSend;
     std::vector<CAddress> vAddrToSend;
     CRollingBloomFilter addrKnown;
     bool fGetAddr;
@@ -807,6 +874,7 @@ public:
     }
 
     bool ReceiveMsgBytes(const char *pch, unsigned int nBytes, bool& complete);
+    void RecordProcessTime(const std::string& strCommand, int64_t nTimeMicros);
 
     void SetRecvVersion(int nVersionIn)
     {
@@ -837,6 +905,7 @@ public:
 
     void AddAddressKnown(const CAddress& addr)
     {
+        LOCK(cs_addrToSend);
         addrKnown.insert(addr.GetKey());
     }
 
@@ -845,6 +914,7 @@ public:
         // Known checking here is only to save space from duplicates.
         // SendMessages will filter it again for knowns that were added
         // after addresses were pushed.
+        LOCK(cs_addrToSend);
         if (addr.IsValid() && !addrKnown.contains(addr.GetKey())) {
             if (vAddrToSend.size() >= MAX_ADDR_TO_SEND) {
                 vAddrToSend[insecure_rand() % vAddrToSend.size()] = addr;
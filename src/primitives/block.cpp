@@ -10,9 +10,41 @@
 #include "utilstrencodings.h"
 #include "crypto/common.h"
 
+CBlockHeader& CBlockHeader::operator=(const CBlockHeader& other)
+{
+    nVersion = other.nVersion;
+    hashPrevBlock = other.hashPrevBlock;
+    hashMerkleRoot = other.hashMerkleRoot;
+    nTime = other.nTime;
+    nBits = other.nBits;
+    nNonce = other.nNonce;
+    ResetCachedHash();
+    if (other.fHashCached.load(std::memory_order_acquire) && memcmp(other.vchHashedHeader, BEGIN(nVersion), HEADER_SIZE) == 0)
+        SetCachedHash(other.hashCached);
+    return *this;
+}
+
 uint256 CBlockHeader::GetHash() const
 {
-    return HashX11(BEGIN(nVersion), END(nNonce));
+    if (fHashCached.load(std::memory_order_acquire) && memcmp(vchHashedHeader, BEGIN(nVersion), HEADER_SIZE) == 0)
+        return hashCached;
+
+    uint256 hash = HashX11(BEGIN(nVersion), END(nNonce));
+    SetCachedHash(hash);
+    return hash;
+}
+
+void CBlockHeader::SetCachedHash(const uint256& hash) const
+{
+    static_assert(sizeof(nVersion) + sizeof(hashPrevBlock) + sizeof(hashMerkleRoot) + sizeof(nTime) + sizeof(nBits) + sizeof(nNonce) == HEADER_SIZE,
+                  "unexpected block header size");
+    // only the first thread to get here writes the cache, a header that
+    // changed since is hashed again on every call until it's reset
+    if (fHashCaching.exchange(true))
+        return;
+    memcpy(vchHashedHeader, BEGIN(nVersion), HEADER_SIZE);
+    hashCached = hash;
+    fHashCached.store(true, std::memory_order_release);
 }
 
 std::string CBlock::ToString() const
@@ -27,7 +59,7 @@ std::string CBlock::ToString() const
         vtx.size());
     for (unsigned int i = 0; i < vtx.size(); i++)
     {
-        s << "  " << vtx[i].ToString() << "\n";
+        s << "  " << vtx[i]->ToString() << "\n";
     }
     return s.str();
 }
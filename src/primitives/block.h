@@ -10,6 +10,8 @@
 #include "serialize.h"
 #include "uint256.h"
 
+#include <atomic>
+
 /** Nodes collect new transactions into a block, hash them into a hash tree,
  * and scan through nonce values to make the block's hash satisfy proof-of-work
  * requirements.  When they solve the proof-of-work, they broadcast the block
@@ -28,11 +30,38 @@ public:
     uint32_t nBits;
     uint32_t nNonce;
 
+private:
+    // memory only: the header fields are public and mutated in place, so the
+    // cached hash is only valid while they still match the bytes it was computed from.
+    // Shared blocks are hashed from several threads: the cache is written by the
+    // one thread that claims fHashCaching and is only read once fHashCached is set,
+    // it isn't written again until the owner resets the header.
+    static const size_t HEADER_SIZE = 80;
+    mutable std::atomic<bool> fHashCaching;
+    mutable std::atomic<bool> fHashCached;
+    mutable uint256 hashCached;
+    mutable unsigned char vchHashedHeader[HEADER_SIZE];
+
+    void SetCachedHash(const uint256& hash) const;
+    void ResetCachedHash()
+    {
+        fHashCached = false;
+        fHashCaching = false;
+    }
+
+public:
     CBlockHeader()
     {
         SetNull();
     }
 
+    CBlockHeader(const CBlockHeader& other)
+    {
+        *this = other;
+    }
+
+    CBlockHeader& operator=(const CBlockHeader& other);
+
     ADD_SERIALIZE_METHODS;
 
     template <typename Stream, typename Operation>
@@ -44,6 +73,8 @@ public:
         READWRITE(nTime);
         READWRITE(nBits);
         READWRITE(nNonce);
+        if (ser_action.ForRead())
+            ResetCachedHash();
     }
 
     void SetNull()
@@ -54,6 +85,7 @@ public:
         nTime = 0;
         nBits = 0;
         nNonce = 0;
+        ResetCachedHash();
     }
 
     bool IsNull() const
@@ -74,12 +106,13 @@ class CBlock : public CBlockHeader
 {
 public:
     // network and disk
-    std::vector<CTransaction> vtx;
+    std::vector<CTransactionRef> vtx;
 
     // memory only
     mutable CTxOut txoutMasternode; // masternode payment
     mutable std::vector<CTxOut> voutSuperblock; // superblock payment
     mutable bool fChecked;
+    mutable bool fMerkleRootChecked; // set by whoever already verified hashMerkleRoot against vtx
 
     CBlock()
     {
@@ -107,6 +140,7 @@ public:
         txoutMasternode = CTxOut();
         voutSuperblock.clear();
         fChecked = false;
+        fMerkleRootChecked = false;
     }
 
     CBlockHeader GetBlockHeader() const
@@ -216,22 +216,22 @@ private:
     int nConfirmedHeight;
 
 public:
-    CTransaction tx;
+    CTransactionRef tx;
     CTxIn vin;
     std::vector<unsigned char> vchSig;
     int64_t sigTime;
 
     CDarksendBroadcastTx() :
         nConfirmedHeight(-1),
-        tx(),
+        tx(MakeTransactionRef()),
         vin(),
         vchSig(),
         sigTime(0)
         {}
 
-    CDarksendBroadcastTx(CTransaction tx, COutPoint outpoint, int64_t sigTime) :
+    CDarksendBroadcastTx(const CTransactionRef& _tx, COutPoint outpoint, int64_t sigTime) :
         nConfirmedHeight(-1),
-        tx(tx),
+        tx(_tx),
         vin(CTxIn(outpoint)),
         vchSig(),
         sigTime(sigTime)
@@ -249,7 +249,7 @@ public:
 
     friend bool operator==(const CDarksendBroadcastTx& a, const CDarksendBroadcastTx& b)
     {
-        return a.tx == b.tx;
+        return *a.tx == *b.tx;
     }
     friend bool operator!=(const CDarksendBroadcastTx& a, const CDarksendBroadcastTx& b)
     {
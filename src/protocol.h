@@ -218,6 +218,32 @@ extern const char *REJECT;
  * @see https://bitcoin.org/en/developer-reference#sendheaders
  */
 extern const char *SENDHEADERS;
+/**
+ * Contains a 1-byte bool and 8-byte LE version number.
+ * Indicates that a node is willing to provide blocks via "cmpctblock" messages.
+ * May indicate that a node prefers to receive new block announcements via a
+ * "cmpctblock" message rather than an "inv", depending on message contents.
+ * Negotiated with "sendcmpct" as described by BIP 152, see SHORT_IDS_BLOCKS_VERSION
+ */
+extern const char *SENDCMPCT;
+/**
+ * Contains a CBlockHeaderAndShortTxIDs object - providing a header and
+ * list of "short txids".
+ * Only sent to peers that sent "sendcmpct", as described by BIP 152
+ */
+extern const char *CMPCTBLOCK;
+/**
+ * Contains a BlockTransactionsRequest
+ * Peer should respond with "blocktxn" message.
+ * Only sent to peers that sent "sendcmpct", as described by BIP 152
+ */
+extern const char *GETBLOCKTXN;
+/**
+ * Contains a BlockTransactions.
+ * Sent in response to a "getblocktxn" message.
+ * Only sent to peers that sent "sendcmpct", as described by BIP 152
+ */
+extern const char *BLOCKTXN;
 
 // Spice message types
 // NOTE: do NOT declare non-implmented here, we don't want them to be exposed to the outside
@@ -363,6 +389,12 @@ enum {
     MSG_GOVERNANCE_OBJECT,
     MSG_GOVERNANCE_OBJECT_VOTE,
     MSG_MASTERNODE_VERIFY,
+    // Nodes may request a MSG_CMPCT_BLOCK in a getdata from peers that sent
+    // "sendcmpct", however, MSG_CMPCT_BLOCK should not appear in any invs except
+    // as a part of getdata.
+    // BIP152 uses 4 on the wire, which is MSG_TXLOCK_REQUEST here, so compact
+    // blocks take the next free value after the Spice types instead.
+    MSG_CMPCT_BLOCK = 20, //!< Defined in BIP152, wire value differs from Bitcoin
 };
 
 #endif // BITCOIN_PROTOCOL_H
@@ -514,11 +514,13 @@ UniValue getblocktemplate(const UniValue& params, bool fHelp)
         && CSuperblock::IsValidBlockHeight(chainActive.Height() + 1))
             throw JSONRPCError(RPC_CLIENT_IN_INITIAL_DOWNLOAD, "Dune Spice is syncing with network...");
 
-    static unsigned int nTransactionsUpdatedLast;
+    if (!pblocktemplatecache)
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Block templates are not available");
 
     if (!lpval.isNull())
     {
-        // Wait to respond until either the best block changes, OR a minute has passed and there are more transactions
+        // Wait to respond until either the best block changes, a template with significantly
+        // more fees is ready, OR a minute has passed and there are more transactions
         uint256 hashWatchedChain;
         boost::system_time checktxtime;
         unsigned int nTransactionsUpdatedLastLP;
@@ -535,7 +537,7 @@ UniValue getblocktemplate(const UniValue& params, bool fHelp)
         {
             // NOTE: Spec does not specify behaviour for non-string longpollid, but this makes testing easier
             hashWatchedChain = chainActive.Tip()->GetBlockHash();
-            nTransactionsUpdatedLastLP = nTransactionsUpdatedLast;
+            nTransactionsUpdatedLastLP = mempool.GetTransactionsUpdated();
         }
 
         // Release the wallet and main lock while waiting
@@ -543,16 +545,14 @@ UniValue getblocktemplate(const UniValue& params, bool fHelp)
         {
             checktxtime = boost::get_system_time() + boost::posix_time::minutes(1);
 
-            boost::unique_lock<boost::mutex> lock(csBestBlock);
-            while (chainActive.Tip()->GetBlockHash() == hashWatchedChain && IsRPCRunning())
+            while (IsRPCRunning())
             {
-                if (!cvBlockChange.timed_wait(lock, checktxtime))
-                {
-                    // Timeout: Check transactions for update
-                    if (mempool.GetTransactionsUpdated() != nTransactionsUpdatedLastLP)
-                        break;
-                    checktxtime += boost::posix_time::seconds(10);
-                }
+                if (pblocktemplatecache->WaitForChange(hashWatchedChain, nTransactionsUpdatedLastLP, checktxtime))
+                    break;
+                // Timeout: Check transactions for update
+                if (mempool.GetTransactionsUpdated() != nTransactionsUpdatedLastLP)
+                    break;
+                checktxtime += boost::posix_time::seconds(10);
             }
         }
         ENTER_CRITICAL_SECTION(cs_main);
@@ -562,35 +562,24 @@ UniValue getblocktemplate(const UniValue& params, bool fHelp)
         // TODO: Maybe recheck connections/IBD and (if something wrong) send an expires-immediately template to stop miners?
     }
 
-    // Update block
-    static CBlockIndex* pindexPrev;
-    static int64_t nStart;
-    static CBlockTemplate* pblocktemplate;
-    if (pindexPrev != chainActive.Tip() ||
-        (mempool.GetTransactionsUpdated() != nTransactionsUpdatedLast && GetTime() - nStart > 5))
-    {
-        // Clear pindexPrev so future calls make a new block, despite any failures from here on
-        pindexPrev = NULL;
-
-        // Store the chainActive.Tip() used before CreateNewBlock, to avoid races
-        nTransactionsUpdatedLast = mempool.GetTransactionsUpdated();
-        CBlockIndex* pindexPrevNew = chainActive.Tip();
-        nStart = GetTime();
-
-        // Create new block
-        if(pblocktemplate)
-        {
-            delete pblocktemplate;
-            pblocktemplate = NULL;
-        }
-        CScript scriptDummy = CScript() << OP_TRUE;
-        pblocktemplate = CreateNewBlock(Params(), scriptDummy);
-        if (!pblocktemplate)
-            throw JSONRPCError(RPC_OUT_OF_MEMORY, "Out of memory");
-
-        // Need to update only after we know CreateNewBlock succeeded
-        pindexPrev = pindexPrevNew;
+    // Get the latest template, the cache builds one without cs_main held if it is stale
+    unsigned int nTransactionsUpdatedLast;
+    std::shared_ptr<const CBlockTemplate> pcachedtemplate;
+    LEAVE_CRITICAL_SECTION(cs_main);
+    try {
+        pcachedtemplate = pblocktemplatecache->Get(nTransactionsUpdatedLast);
+    } catch (...) {
+        ENTER_CRITICAL_SECTION(cs_main);
+        throw;
     }
+    ENTER_CRITICAL_SECTION(cs_main);
+
+    // The tip may have moved meanwhile, describe the template relative to the block it builds on
+    BlockMap::iterator mi = mapBlockIndex.find(pcachedtemplate->block.hashPrevBlock);
+    if (mi == mapBlockIndex.end())
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Block template builds on an unknown block");
+    CBlockIndex* pindexPrev = mi->second;
+    std::unique_ptr<CBlockTemplate> pblocktemplate(new CBlockTemplate(*pcachedtemplate));
     CBlock* pblock = &pblocktemplate->block; // pointer for convenience
     const Consensus::Params& consensusParams = Params().GetConsensus();
 
@@ -603,7 +592,8 @@ UniValue getblocktemplate(const UniValue& params, bool fHelp)
     UniValue transactions(UniValue::VARR);
     map<uint256, int64_t> setTxIndex;
     int i = 0;
-    BOOST_FOREACH (const CTransaction& tx, pblock->vtx) {
+    BOOST_FOREACH (const CTransactionRef& ptx, pblock->vtx) {
+        const CTransaction& tx = *ptx;
         uint256 txHash = tx.GetHash();
         setTxIndex[txHash] = i++;
 
@@ -702,8 +692,8 @@ UniValue getblocktemplate(const UniValue& params, bool fHelp)
     result.push_back(Pair("previousblockhash", pblock->hashPrevBlock.GetHex()));
     result.push_back(Pair("transactions", transactions));
     result.push_back(Pair("coinbaseaux", aux));
-    result.push_back(Pair("coinbasevalue", (int64_t)pblock->vtx[0].GetValueOut()));
-    result.push_back(Pair("longpollid", chainActive.Tip()->GetBlockHash().GetHex() + i64tostr(nTransactionsUpdatedLast)));
+    result.push_back(Pair("coinbasevalue", (int64_t)pblock->vtx[0]->GetValueOut()));
+    result.push_back(Pair("longpollid", pindexPrev->GetBlockHash().GetHex() + i64tostr(nTransactionsUpdatedLast)));
     result.push_back(Pair("target", hashTarget.GetHex()));
     result.push_back(Pair("mintime", (int64_t)pindexPrev->GetMedianTimePast()+1));
     result.push_back(Pair("mutable", aMutable));
@@ -589,6 +589,171 @@ bool timestampSort(std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta> a,
     return a.second.time < b.second.time;
 }
 
+//! Number of index entries read from the database at once when returning a page
+static const size_t ADDRESS_PAGE_READ_SIZE = 1000;
+
+//! Read "limit" from params, returns false if the results aren't paginated
+bool getPageLimitFromParams(const UniValue& params, size_t& nLimit)
+{
+    if (!params[0].isObject())
+        return false;
+    UniValue limitValue = find_value(params[0].get_obj(), "limit");
+    if (limitValue.isNull())
+        return false;
+    if (!limitValue.isNum() || limitValue.get_int() <= 0)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Limit is expected to be a positive number");
+    nLimit = limitValue.get_int();
+    return true;
+}
+
+//! A cursor is the position in the list of addresses and the index key of the first result of the next page
+template<typename Key>
+std::string encodePageCursor(size_t nAddress, const Key& key)
+{
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << (uint32_t)nAddress << key;
+    return HexStr(ss.begin(), ss.end());
+}
+
+//! Read "cursor" from params, returns false if there is none
+template<typename Key>
+bool getPageCursorFromParams(const UniValue& params, const std::vector<std::pair<uint160, int> >& addresses, size_t& nAddress, Key& key)
+{
+    UniValue cursorValue = find_value(params[0].get_obj(), "cursor");
+    if (cursorValue.isNull())
+        return false;
+    if (!cursorValue.isStr() || !IsHex(cursorValue.get_str()))
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid cursor");
+
+    std::vector<unsigned char> data(ParseHex(cursorValue.get_str()));
+    CDataStream ss(data, SER_NETWORK, PROTOCOL_VERSION);
+    uint32_t n;
+    try {
+        ss >> n >> key;
+    } catch (const std::exception&) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid cursor");
+    }
+    if (n >= addresses.size() || key.type != (unsigned int)addresses[n].second || key.hashBytes != addresses[n].first)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Cursor doesn't belong to these addresses");
+    nAddress = n;
+    return true;
+}
+
+UniValue addressDeltaToJSON(const std::pair<CAddressIndexKey, CAmount>& entry)
+{
+    std::string address;
+    if (!getAddressFromIndex(entry.first.type, entry.first.hashBytes, address)) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unknown address type");
+    }
+
+    UniValue delta(UniValue::VOBJ);
+    delta.push_back(Pair("satoshis", entry.second));
+    delta.push_back(Pair("txid", entry.first.txhash.GetHex()));
+    delta.push_back(Pair("index", (int)entry.first.index));
+    delta.push_back(Pair("blockindex", (int)entry.first.txindex));
+    delta.push_back(Pair("height", entry.first.blockHeight));
+    delta.push_back(Pair("address", address));
+    return delta;
+}
+
+UniValue addressUnspentToJSON(const std::pair<CAddressUnspentKey, CAddressUnspentValue>& entry)
+{
+    std::string address;
+    if (!getAddressFromIndex(entry.first.type, entry.first.hashBytes, address)) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unknown address type");
+    }
+
+    UniValue output(UniValue::VOBJ);
+    output.push_back(Pair("address", address));
+    output.push_back(Pair("txid", entry.first.txhash.GetHex()));
+    output.push_back(Pair("outputIndex", (int)entry.first.index));
+    output.push_back(Pair("script", HexStr(entry.second.script.begin(), entry.second.script.end())));
+    output.push_back(Pair("satoshis", entry.second.satoshis));
+    output.push_back(Pair("height", entry.second.blockHeight));
+    return output;
+}
+
+/**
+ * Append up to nLimit deltas (or txids if fTxids) of the addresses to result,
+ * address by address in index order, starting at the cursor in params. Only
+ * reads the entries that are returned. Returns the cursor of the next page,
+ * or null if this is the last one.
+ */
+UniValue getAddressIndexPage(const UniValue& params, const std::vector<std::pair<uint160, int> >& addresses,
+                             int start, int end, size_t nLimit, bool fTxids, UniValue& result)
+{
+    size_t nAddress = 0;
+    CAddressIndexKey key;
+    bool fCursor = getPageCursorFromParams(params, addresses, nAddress, key);
+    size_t nCount = 0;
+
+    for (; nAddress < addresses.size(); nAddress++) {
+        if (!fCursor)
+            key = CAddressIndexKey(addresses[nAddress].second, addresses[nAddress].first, start, 0, uint256(), 0, false);
+        fCursor = false;
+
+        // The entries of a transaction are next to each other
+        uint256 txhashLast;
+        while (true) {
+            std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+            if (!GetAddressIndexPage(key, end, ADDRESS_PAGE_READ_SIZE + 1, addressIndex)) {
+                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+            }
+            for (size_t i = 0; i < addressIndex.size() && i < ADDRESS_PAGE_READ_SIZE; i++) {
+                if (fTxids && addressIndex[i].first.txhash == txhashLast)
+                    continue;
+                if (nCount == nLimit)
+                    return encodePageCursor(nAddress, addressIndex[i].first);
+                nCount++;
+                txhashLast = addressIndex[i].first.txhash;
+                if (fTxids)
+                    result.push_back(addressIndex[i].first.txhash.GetHex());
+                else
+                    result.push_back(addressDeltaToJSON(addressIndex[i]));
+            }
+            if (addressIndex.size() <= ADDRESS_PAGE_READ_SIZE)
+                break;
+            key = addressIndex.back().first;
+        }
+    }
+
+    return NullUniValue;
+}
+
+/** Like getAddressIndexPage for the unspent outputs of the addresses, in index (not height) order */
+UniValue getAddressUnspentPage(const UniValue& params, const std::vector<std::pair<uint160, int> >& addresses,
+                               size_t nLimit, UniValue& result)
+{
+    size_t nAddress = 0;
+    CAddressUnspentKey key;
+    bool fCursor = getPageCursorFromParams(params, addresses, nAddress, key);
+    size_t nCount = 0;
+
+    for (; nAddress < addresses.size(); nAddress++) {
+        if (!fCursor)
+            key = CAddressUnspentKey(addresses[nAddress].second, addresses[nAddress].first, uint256(), 0);
+        fCursor = false;
+
+        while (true) {
+            std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
+            if (!GetAddressUnspentPage(key, ADDRESS_PAGE_READ_SIZE + 1, unspentOutputs)) {
+                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+            }
+            for (size_t i = 0; i < unspentOutputs.size() && i < ADDRESS_PAGE_READ_SIZE; i++) {
+                if (nCount == nLimit)
+                    return encodePageCursor(nAddress, unspentOutputs[i].first);
+                nCount++;
+                result.push_back(addressUnspentToJSON(unspentOutputs[i]));
+            }
+            if (unspentOutputs.size() <= ADDRESS_PAGE_READ_SIZE)
+                break;
+            key = unspentOutputs.back().first;
+        }
+    }
+
+    return NullUniValue;
+}
+
 UniValue getaddressmempool(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() != 1)
@@ -673,6 +838,8 @@ UniValue getaddressutxos(const UniValue& params, bool fHelp)
             "      \"address\"  (string) The base58check encoded address\n"
             "      ,...\n"
             "    ]\n"
+            "  \"limit\" (number, optional) Return at most this many outputs, in index order, and the cursor of the next page\n"
+            "  \"cursor\" (string, optional) The cursor returned with the previous page\n"
             "}\n"
             "\nResult\n"
             "[\n"
@@ -685,6 +852,11 @@ UniValue getaddressutxos(const UniValue& params, bool fHelp)
             "    \"height\"  (number) The block height\n"
             "  }\n"
             "]\n"
+            "\nResult (with limit)\n"
+            "{\n"
+            "  \"utxos\"  (array) The outputs as above\n"
+            "  \"cursor\"  (string) The cursor of the next page, null if this is the last one\n"
+            "}\n"
             "\nExamples:\n"
             + HelpExampleCli("getaddressutxos", "'{\"addresses\": [\"XwnLY9Tf7Zsef8gMGL2fhWA9ZmMjt4KPwg\"]}'")
             + HelpExampleRpc("getaddressutxos", "{\"addresses\": [\"XwnLY9Tf7Zsef8gMGL2fhWA9ZmMjt4KPwg\"]}")
@@ -696,6 +868,16 @@ UniValue getaddressutxos(const UniValue& params, bool fHelp)
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
     }
 
+    size_t nLimit;
+    if (getPageLimitFromParams(params, nLimit)) {
+        UniValue utxos(UniValue::VARR);
+        UniValue cursor = getAddressUnspentPage(params, addresses, nLimit, utxos);
+        UniValue result(UniValue::VOBJ);
+        result.push_back(Pair("utxos", utxos));
+        result.push_back(Pair("cursor", cursor));
+        return result;
+    }
+
     std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
 
     for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
@@ -709,19 +891,7 @@ UniValue getaddressutxos(const UniValue& params, bool fHelp)
     UniValue result(UniValue::VARR);
 
     for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=unspentOutputs.begin(); it!=unspentOutputs.end(); it++) {
-        UniValue output(UniValue::VOBJ);
-        std::string address;
-        if (!getAddressFromIndex(it->first.type, it->first.hashBytes, address)) {
-            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unknown address type");
-        }
-
-        output.push_back(Pair("address", address));
-        output.push_back(Pair("txid", it->first.txhash.GetHex()));
-        output.push_back(Pair("outputIndex", (int)it->first.index));
-        output.push_back(Pair("script", HexStr(it->second.script.begin(), it->second.script.end())));
-        output.push_back(Pair("satoshis", it->second.satoshis));
-        output.push_back(Pair("height", it->second.blockHeight));
-        result.push_back(output);
+        result.push_back(addressUnspentToJSON(*it));
     }
 
     return result;
@@ -742,6 +912,8 @@ UniValue getaddressdeltas(const UniValue& params, bool fHelp)
             "    ]\n"
             "  \"start\" (number) The start block height\n"
             "  \"end\" (number) The end block height\n"
+            "  \"limit\" (number, optional) Return at most this many deltas and the cursor of the next page\n"
+            "  \"cursor\" (string, optional) The cursor returned with the previous page\n"
             "}\n"
             "\nResult:\n"
             "[\n"
@@ -754,6 +926,11 @@ UniValue getaddressdeltas(const UniValue& params, bool fHelp)
             "    \"address\"  (string) The base58check encoded address\n"
             "  }\n"
             "]\n"
+            "\nResult (with limit):\n"
+            "{\n"
+            "  \"deltas\"  (array) The deltas as above\n"
+            "  \"cursor\"  (string) The cursor of the next page, null if this is the last one\n"
+            "}\n"
             "\nExamples:\n"
             + HelpExampleCli("getaddressdeltas", "'{\"addresses\": [\"XwnLY9Tf7Zsef8gMGL2fhWA9ZmMjt4KPwg\"]}'")
             + HelpExampleRpc("getaddressdeltas", "{\"addresses\": [\"XwnLY9Tf7Zsef8gMGL2fhWA9ZmMjt4KPwg\"]}")
@@ -780,6 +957,16 @@ UniValue getaddressdeltas(const UniValue& params, bool fHelp)
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
     }
 
+    size_t nLimit;
+    if (getPageLimitFromParams(params, nLimit)) {
+        UniValue deltas(UniValue::VARR);
+        UniValue cursor = getAddressIndexPage(params, addresses, start, end, nLimit, false, deltas);
+        UniValue result(UniValue::VOBJ);
+        result.push_back(Pair("deltas", deltas));
+        result.push_back(Pair("cursor", cursor));
+        return result;
+    }
+
     std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
 
     for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
@@ -797,19 +984,7 @@ UniValue getaddressdeltas(const UniValue& params, bool fHelp)
     UniValue result(UniValue::VARR);
 
     for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=addressIndex.begin(); it!=addressIndex.end(); it++) {
-        std::string address;
-        if (!getAddressFromIndex(it->first.type, it->first.hashBytes, address)) {
-            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unknown address type");
-        }
-
-        UniValue delta(UniValue::VOBJ);
-        delta.push_back(Pair("satoshis", it->second));
-        delta.push_back(Pair("txid", it->first.txhash.GetHex()));
-        delta.push_back(Pair("index", (int)it->first.index));
-        delta.push_back(Pair("blockindex", (int)it->first.txindex));
-        delta.push_back(Pair("height", it->first.blockHeight));
-        delta.push_back(Pair("address", address));
-        result.push_back(delta);
+        result.push_back(addressDeltaToJSON(*it));
     }
 
     return result;
@@ -827,12 +1002,16 @@ UniValue getaddressbalance(const UniValue& params, bool fHelp)
             "    [\n"
             "      \"address\"  (string) The base58check encoded address\n"
             "      ,...\n"
-            "    ]\n"
+            "    ],\n"
+            "  \"mempool\" (boolean, optional, default=false) Also return the balance change of mempool transactions\n"
             "}\n"
             "\nResult:\n"
             "{\n"
             "  \"balance\"  (string) The current balance in duffs\n"
             "  \"received\"  (string) The total number of duffs received (including change)\n"
+            "  \"txcount\"  (numeric) The number of transactions of each address, summed\n"
+            "  \"height\"  (numeric) The height of the last block with a transaction of the addresses\n"
+            "  \"unconfirmed\"  (string) The balance change in duffs of mempool transactions, only with mempool\n"
             "}\n"
             "\nExamples:\n"
             + HelpExampleCli("getaddressbalance", "'{\"addresses\": [\"XwnLY9Tf7Zsef8gMGL2fhWA9ZmMjt4KPwg\"]}'")
@@ -845,27 +1024,47 @@ UniValue getaddressbalance(const UniValue& params, bool fHelp)
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
     }
 
-    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
-
-    for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
-        if (!GetAddressIndex((*it).first, (*it).second, addressIndex)) {
-            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+    bool fMempool = false;
+    if (params[0].isObject()) {
+        UniValue mempoolValue = find_value(params[0].get_obj(), "mempool");
+        if (mempoolValue.isBool()) {
+            fMempool = mempoolValue.get_bool();
         }
     }
 
     CAmount balance = 0;
     CAmount received = 0;
+    int64_t txCount = 0;
+    int height = 0;
 
-    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=addressIndex.begin(); it!=addressIndex.end(); it++) {
-        if (it->second > 0) {
-            received += it->second;
+    for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
+        CAddressBalanceValue addressBalance;
+        if (!GetAddressBalance((*it).first, (*it).second, addressBalance)) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
         }
-        balance += it->second;
+        balance += addressBalance.balance;
+        received += addressBalance.received;
+        txCount += addressBalance.txCount;
+        height = std::max(height, addressBalance.lastHeight);
     }
 
     UniValue result(UniValue::VOBJ);
     result.push_back(Pair("balance", balance));
     result.push_back(Pair("received", received));
+    result.push_back(Pair("txcount", txCount));
+    result.push_back(Pair("height", height));
+
+    if (fMempool) {
+        std::vector<std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta> > indexes;
+        if (!mempool.getAddressIndex(addresses, indexes)) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+        }
+        CAmount unconfirmed = 0;
+        for (std::vector<std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta> >::const_iterator it = indexes.begin(); it != indexes.end(); it++) {
+            unconfirmed += it->second.amount;
+        }
+        result.push_back(Pair("unconfirmed", unconfirmed));
+    }
 
     return result;
 
@@ -886,12 +1085,19 @@ UniValue getaddresstxids(const UniValue& params, bool fHelp)
             "    ]\n"
             "  \"start\" (number) The start block height\n"
             "  \"end\" (number) The end block height\n"
+            "  \"limit\" (number, optional) Return at most this many txids, address by address, and the cursor of the next page\n"
+            "  \"cursor\" (string, optional) The cursor returned with the previous page\n"
             "}\n"
             "\nResult:\n"
             "[\n"
             "  \"transactionid\"  (string) The transaction id\n"
             "  ,...\n"
             "]\n"
+            "\nResult (with limit):\n"
+            "{\n"
+            "  \"txids\"  (array) The transaction ids as above\n"
+            "  \"cursor\"  (string) The cursor of the next page, null if this is the last one\n"
+            "}\n"
             "\nExamples:\n"
             + HelpExampleCli("getaddresstxids", "'{\"addresses\": [\"XwnLY9Tf7Zsef8gMGL2fhWA9ZmMjt4KPwg\"]}'")
             + HelpExampleRpc("getaddresstxids", "{\"addresses\": [\"XwnLY9Tf7Zsef8gMGL2fhWA9ZmMjt4KPwg\"]}")
@@ -914,6 +1120,16 @@ UniValue getaddresstxids(const UniValue& params, bool fHelp)
         }
     }
 
+    size_t nLimit;
+    if (getPageLimitFromParams(params, nLimit)) {
+        UniValue txids(UniValue::VARR);
+        UniValue cursor = getAddressIndexPage(params, addresses, start, end, nLimit, true, txids);
+        UniValue result(UniValue::VOBJ);
+        result.push_back(Pair("txids", txids));
+        result.push_back(Pair("cursor", cursor));
+        return result;
+    }
+
     std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
 
     for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
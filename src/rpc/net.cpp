@@ -109,6 +109,10 @@ UniValue getpeerinfo(const UniValue& params, bool fHelp)
             "       \"addr\": n,             (numeric) The total bytes received aggregated by message type\n"
             "       ...\n"
             "    }\n"
+            "    \"proctime_per_msg\": {\n"
+            "       \"addr\": n,             (numeric) The total time in microseconds spent processing messages, aggregated by message type\n"
+            "       ...\n"
+            "    }\n"
             "  }\n"
             "  ,...\n"
             "]\n"
@@ -180,6 +184,13 @@ UniValue getpeerinfo(const UniValue& params, bool fHelp)
         }
         obj.push_back(Pair("bytesrecv_per_msg", recvPerMsgCmd));
 
+        UniValue procTimePerMsgCmd(UniValue::VOBJ);
+        BOOST_FOREACH(const mapMsgCmdSize::value_type &i, stats.mapProcessTimePerMsgCmd) {
+            if (i.second > 0)
+                procTimePerMsgCmd.push_back(Pair(i.first, i.second));
+        }
+        obj.push_back(Pair("proctime_per_msg", procTimePerMsgCmd));
+
         ret.push_back(obj);
     }
 
@@ -15,8 +15,6 @@ class CSporkManager;
 
 CSporkManager sporkManager;
 
-std::map<uint256, CSporkMessage> mapSporks;
-
 void CSporkManager::ProcessSpork(CNode* pfrom, std::string& strCommand, CDataStream& vRecv, CConnman& connman)
 {
     if(fLiteMode) return; // disable all Spice specific functionality
@@ -36,15 +34,19 @@ void CSporkManager::ProcessSpork(CNode* pfrom, std::string& strCommand, CDataStr
             strLogMsg = strprintf("SPORK -- hash: %s id: %d value: %10d bestHeight: %d peer=%d", hash.ToString(), spork.nSporkID, spork.nValue, chainActive.Height(), pfrom->id);
         }
 
-        if(mapSporksActive.count(spork.nSporkID)) {
-            if (mapSporksActive[spork.nSporkID].nTimeSigned >= spork.nTimeSigned) {
-                LogPrint("spork", "%s seen\n", strLogMsg);
-                return;
+        {
+            LOCK(cs);
+            std::map<int, CSporkMessage>::iterator it = mapSporksActive.find(spork.nSporkID);
+            if(it != mapSporksActive.end()) {
+                if (it->second.nTimeSigned >= spork.nTimeSigned) {
+                    LogPrint("spork", "%s seen\n", strLogMsg);
+                    return;
+                } else {
+                    LogPrintf("%s updated\n", strLogMsg);
+                }
             } else {
-                LogPrintf("%s updated\n", strLogMsg);
+                LogPrintf("%s new\n", strLogMsg);
             }
-        } else {
-            LogPrintf("%s new\n", strLogMsg);
         }
 
         if(!spork.CheckSignature()) {
@@ -53,8 +55,14 @@ void CSporkManager::ProcessSpork(CNode* pfrom, std::string& strCommand, CDataStr
             return;
         }
 
-        mapSporks[hash] = spork;
-        mapSporksActive[spork.nSporkID] = spork;
+        {
+            LOCK(cs);
+            // another peer may have relayed a newer one while the signature was checked
+            std::map<int, CSporkMessage>::iterator it = mapSporksActive.find(spork.nSporkID);
+            if(it != mapSporksActive.end() && it->second.nTimeSigned >= spork.nTimeSigned) return;
+            mapSporks[hash] = spork;
+            mapSporksActive[spork.nSporkID] = spork;
+        }
         spork.Relay(connman);
 
         //does a task if needed
@@ -62,6 +70,7 @@ void CSporkManager::ProcessSpork(CNode* pfrom, std::string& strCommand, CDataStr
 
     } else if (strCommand == NetMsgType::GETSPORKS) {
 
+        LOCK(cs);
         std::map<int, CSporkMessage>::iterator it = mapSporksActive.begin();
 
         while(it != mapSporksActive.end()) {
@@ -108,6 +117,7 @@ bool CSporkManager::UpdateSpork(int nSporkID, int64_t nValue, CConnman& connman)
 
     if(spork.Sign(strMasterPrivKey)) {
         spork.Relay(connman);
+        LOCK(cs);
         mapSporks[spork.GetHash()] = spork;
         mapSporksActive[nSporkID] = spork;
         return true;
@@ -116,14 +126,35 @@ bool CSporkManager::UpdateSpork(int nSporkID, int64_t nValue, CConnman& connman)
     return false;
 }
 
+bool CSporkManager::HaveSpork(const uint256& hash) const
+{
+    LOCK(cs);
+    return mapSporks.count(hash);
+}
+
+bool CSporkManager::GetSporkByHash(const uint256& hash, CSporkMessage& sporkRet) const
+{
+    LOCK(cs);
+    std::map<uint256, CSporkMessage>::const_iterator it = mapSporks.find(hash);
+    if (it == mapSporks.end())
+        return false;
+    sporkRet = it->second;
+    return true;
+}
+
 // grab the spork, otherwise say it's off
 bool CSporkManager::IsSporkActive(int nSporkID)
 {
     int64_t r = -1;
+    bool fActive;
+    {
+        LOCK(cs);
+        std::map<int, CSporkMessage>::iterator it = mapSporksActive.find(nSporkID);
+        fActive = it != mapSporksActive.end();
+        if(fActive) r = it->second.nValue;
+    }
 
-    if(mapSporksActive.count(nSporkID)){
-        r = mapSporksActive[nSporkID].nValue;
-    } else {
+    if(!fActive) {
         switch (nSporkID) {
             case SPORK_2_INSTANTSEND_ENABLED:               r = SPORK_2_INSTANTSEND_ENABLED_DEFAULT; break;
             case SPORK_3_INSTANTSEND_BLOCK_FILTERING:       r = SPORK_3_INSTANTSEND_BLOCK_FILTERING_DEFAULT; break;
@@ -147,8 +178,12 @@ bool CSporkManager::IsSporkActive(int nSporkID)
 // grab the value of the spork on the network, or the default
 int64_t CSporkManager::GetSporkValue(int nSporkID)
 {
-    if (mapSporksActive.count(nSporkID))
-        return mapSporksActive[nSporkID].nValue;
+    {
+        LOCK(cs);
+        std::map<int, CSporkMessage>::iterator it = mapSporksActive.find(nSporkID);
+        if (it != mapSporksActive.end())
+            return it->second.nValue;
+    }
 
     switch (nSporkID) {
         case SPORK_2_INSTANTSEND_ENABLED:               return SPORK_2_INSTANTSEND_ENABLED_DEFAULT;
@@ -7,6 +7,7 @@
 
 #include "hash.h"
 #include "net.h"
+#include "sync.h"
 #include "utilstrencodings.h"
 
 class CSporkMessage;
@@ -39,7 +40,6 @@ static const int64_t SPORK_12_RECONSIDER_BLOCKS_DEFAULT                 = 0;
 static const int64_t SPORK_13_OLD_SUPERBLOCK_FLAG_DEFAULT               = 4070908800ULL;// OFF
 static const int64_t SPORK_14_REQUIRE_SENTINEL_FLAG_DEFAULT             = 4070908800ULL;// OFF
 
-extern std::map<uint256, CSporkMessage> mapSporks;
 extern CSporkManager sporkManager;
 
 //
@@ -98,8 +98,12 @@ public:
 class CSporkManager
 {
 private:
+    // critical section to protect mapSporks and mapSporksActive, which are
+    // read and written by concurrent message handler threads
+    mutable CCriticalSection cs;
     std::vector<unsigned char> vchSig;
     std::string strMasterPrivKey;
+    std::map<uint256, CSporkMessage> mapSporks;
     std::map<int, CSporkMessage> mapSporksActive;
 
 public:
@@ -110,6 +114,9 @@ public:
     void ExecuteSpork(int nSporkID, int nValue);
     bool UpdateSpork(int nSporkID, int64_t nValue, CConnman& connman);
 
+    bool HaveSpork(const uint256& hash) const;
+    bool GetSporkByHash(const uint256& hash, CSporkMessage& sporkRet) const;
+
     bool IsSporkActive(int nSporkID);
     int64_t GetSporkValue(int nSporkID);
     int GetSporkIDByName(std::string strName);
@@ -304,7 +304,12 @@ public:
     }
 
     void GetAndClear(CSerializeData &data) {
-        data.insert(data.end(), begin(), end());
+        if (data.empty() && nReadPos == 0) {
+            // nothing to append to, hand over the buffer instead of copying it
+            data.swap(vch);
+        } else {
+            data.insert(data.end(), begin(), end());
+        }
         clear();
     }
 
@@ -466,6 +471,61 @@ public:
     }
 };
 
+/** Read-only stream over memory owned by someone else, e.g. a memory mapped file.
+ *
+ * Unlike CDataStream nothing is copied, the caller must keep the memory alive
+ * while the reader is in use.
+ */
+class CMemoryReader
+{
+private:
+    CMemoryReader(const CMemoryReader&);
+    CMemoryReader& operator=(const CMemoryReader&);
+
+    int nType;
+    int nVersion;
+
+    const char* pbegin;
+    const char* pend;
+
+public:
+    CMemoryReader(const char* pbeginIn, const char* pendIn, int nTypeIn, int nVersionIn) :
+        nType(nTypeIn), nVersion(nVersionIn), pbegin(pbeginIn), pend(pendIn) {}
+
+    //
+    // Stream subset
+    //
+    int GetType()                { return nType; }
+    int GetVersion()             { return nVersion; }
+    size_t size() const          { return pend - pbegin; }
+    bool empty() const           { return pbegin == pend; }
+
+    CMemoryReader& read(char* pch, size_t nSize)
+    {
+        if (nSize > size())
+            throw std::ios_base::failure("CMemoryReader::read: end of data");
+        memcpy(pch, pbegin, nSize);
+        pbegin += nSize;
+        return (*this);
+    }
+
+    CMemoryReader& ignore(size_t nSize)
+    {
+        if (nSize > size())
+            throw std::ios_base::failure("CMemoryReader::ignore: end of data");
+        pbegin += nSize;
+        return (*this);
+    }
+
+    template<typename T>
+    CMemoryReader& operator>>(T& obj)
+    {
+        // Unserialize from this stream
+        ::Unserialize(*this, obj, nType, nVersion);
+        return (*this);
+    }
+};
+
 /** Non-refcounted RAII wrapper around a FILE* that implements a ring buffer to
  *  deserialize from. It guarantees the ability to rewind a given number of bytes.
  *
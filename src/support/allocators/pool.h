@@ -0,0 +1,193 @@
+// Copyright (c) 2014-2017 The Dune Spice developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_SUPPORT_ALLOCATORS_POOL_H
+#define BITCOIN_SUPPORT_ALLOCATORS_POOL_H
+
+#include <cassert>
+#include <cstddef>
+#include <new>
+#include <vector>
+
+/**
+ * Memory resource for the nodes of node based containers, which make many
+ * allocations of the same few sizes.
+ *
+ * Blocks of up to MAX_BLOCK_SIZE_BYTES are carved from large chunks and
+ * kept in a free list per size (in units of ALIGN_BYTES) when they are
+ * released, so a block is reused by the next allocation of the same size
+ * without going through malloc. Larger allocations, such as the bucket
+ * arrays of big hash maps, are passed on to operator new.
+ *
+ * Chunks are only freed when the resource is destroyed, released blocks are
+ * kept for reuse. BytesInUse() counts the blocks handed out and not released
+ * yet, so the usage reported for the containers falls again as they shrink.
+ * It isn't thread safe: the containers sharing a resource must be guarded by
+ * the same lock.
+ */
+template <std::size_t MAX_BLOCK_SIZE_BYTES, std::size_t ALIGN_BYTES>
+class PoolResource
+{
+private:
+    /** A released block, linking to the next free block of the same size */
+    struct ListNode {
+        ListNode* pNext;
+    };
+
+    static_assert(ALIGN_BYTES > 0 && (ALIGN_BYTES & (ALIGN_BYTES - 1)) == 0, "ALIGN_BYTES must be a power of two");
+    static_assert(ALIGN_BYTES >= sizeof(ListNode) && ALIGN_BYTES % alignof(ListNode) == 0, "free blocks must be able to hold a ListNode");
+    static_assert(MAX_BLOCK_SIZE_BYTES > 0 && MAX_BLOCK_SIZE_BYTES % ALIGN_BYTES == 0, "MAX_BLOCK_SIZE_BYTES must be a multiple of ALIGN_BYTES");
+
+    static const std::size_t NUM_FREE_LISTS = MAX_BLOCK_SIZE_BYTES / ALIGN_BYTES + 1;
+
+    const std::size_t nChunkSizeBytes;
+    std::vector<void*> vChunks;
+    ListNode* vFreeLists[NUM_FREE_LISTS];
+    char* pAvailableBegin;
+    char* pAvailableEnd;
+    std::size_t nBytesInUse;
+
+    /** Size of a block in units of ALIGN_BYTES, its free list */
+    static std::size_t NumAlignUnits(std::size_t nBytes)
+    {
+        return nBytes == 0 ? 1 : (nBytes + ALIGN_BYTES - 1) / ALIGN_BYTES;
+    }
+
+    static bool IsPoolable(std::size_t nBytes, std::size_t nAlignment)
+    {
+        return nBytes <= MAX_BLOCK_SIZE_BYTES && nAlignment <= ALIGN_BYTES;
+    }
+
+    void PushFree(void* p, std::size_t nUnits)
+    {
+        ListNode* pNode = new (p) ListNode;
+        pNode->pNext = vFreeLists[nUnits];
+        vFreeLists[nUnits] = pNode;
+    }
+
+    void AllocateChunk()
+    {
+        // The rest of the current chunk is smaller than the block that
+        // didn't fit, so it fits a free list
+        if (pAvailableBegin != pAvailableEnd)
+            PushFree(pAvailableBegin, (pAvailableEnd - pAvailableBegin) / ALIGN_BYTES);
+
+        void* pChunk = ::operator new(nChunkSizeBytes);
+        vChunks.push_back(pChunk);
+        pAvailableBegin = static_cast<char*>(pChunk);
+        pAvailableEnd = pAvailableBegin + nChunkSizeBytes;
+    }
+
+    PoolResource(const PoolResource&);
+    PoolResource& operator=(const PoolResource&);
+
+public:
+    explicit PoolResource(std::size_t nChunkSizeBytesIn = 256 * 1024)
+        : nChunkSizeBytes(nChunkSizeBytesIn / ALIGN_BYTES * ALIGN_BYTES),
+          pAvailableBegin(NULL),
+          pAvailableEnd(NULL),
+          nBytesInUse(0)
+    {
+        assert(nChunkSizeBytes >= MAX_BLOCK_SIZE_BYTES);
+        for (std::size_t i = 0; i < NUM_FREE_LISTS; i++)
+            vFreeLists[i] = NULL;
+    }
+
+    ~PoolResource()
+    {
+        for (std::size_t i = 0; i < vChunks.size(); i++)
+            ::operator delete(vChunks[i]);
+    }
+
+    void* Allocate(std::size_t nBytes, std::size_t nAlignment)
+    {
+        if (!IsPoolable(nBytes, nAlignment))
+            return ::operator new(nBytes);
+
+        const std::size_t nUnits = NumAlignUnits(nBytes);
+        nBytesInUse += nUnits * ALIGN_BYTES;
+        if (vFreeLists[nUnits] != NULL) {
+            ListNode* pNode = vFreeLists[nUnits];
+            vFreeLists[nUnits] = pNode->pNext;
+            pNode->~ListNode();
+            return pNode;
+        }
+        if ((std::size_t)(pAvailableEnd - pAvailableBegin) < nUnits * ALIGN_BYTES)
+            AllocateChunk();
+        void* p = pAvailableBegin;
+        pAvailableBegin += nUnits * ALIGN_BYTES;
+        return p;
+    }
+
+    void Deallocate(void* p, std::size_t nBytes, std::size_t nAlignment)
+    {
+        if (!IsPoolable(nBytes, nAlignment)) {
+            ::operator delete(p);
+            return;
+        }
+        const std::size_t nUnits = NumAlignUnits(nBytes);
+        assert(nBytesInUse >= nUnits * ALIGN_BYTES);
+        nBytesInUse -= nUnits * ALIGN_BYTES;
+        PushFree(p, nUnits);
+    }
+
+    std::size_t ChunkSizeBytes() const { return nChunkSizeBytes; }
+    std::size_t NumAllocatedChunks() const { return vChunks.size(); }
+    /** Bytes of the blocks carved from the chunks that haven't been released */
+    std::size_t BytesInUse() const { return nBytesInUse; }
+};
+
+/**
+ * Allocator that takes its memory from a PoolResource. The containers using
+ * it must be constructed with the allocator, and the resource must outlive
+ * them.
+ */
+template <typename T, std::size_t MAX_BLOCK_SIZE_BYTES, std::size_t ALIGN_BYTES>
+class PoolAllocator
+{
+public:
+    typedef T value_type;
+    typedef PoolResource<MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES> ResourceType;
+
+    template <typename U>
+    struct rebind {
+        typedef PoolAllocator<U, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES> other;
+    };
+
+    PoolAllocator(ResourceType* resourceIn) throw() : resource(resourceIn) {}
+
+    template <typename U>
+    PoolAllocator(const PoolAllocator<U, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>& other) throw() : resource(other.GetResource())
+    {
+    }
+
+    T* allocate(std::size_t n)
+    {
+        return static_cast<T*>(resource->Allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T* p, std::size_t n) throw()
+    {
+        resource->Deallocate(p, n * sizeof(T), alignof(T));
+    }
+
+    ResourceType* GetResource() const throw() { return resource; }
+
+private:
+    ResourceType* resource;
+};
+
+template <typename T, typename U, std::size_t MAX_BLOCK_SIZE_BYTES, std::size_t ALIGN_BYTES>
+bool operator==(const PoolAllocator<T, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>& a, const PoolAllocator<U, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>& b) throw()
+{
+    return a.GetResource() == b.GetResource();
+}
+
+template <typename T, typename U, std::size_t MAX_BLOCK_SIZE_BYTES, std::size_t ALIGN_BYTES>
+bool operator!=(const PoolAllocator<T, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>& a, const PoolAllocator<U, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>& b) throw()
+{
+    return !(a == b);
+}
+
+#endif // BITCOIN_SUPPORT_ALLOCATORS_POOL_H
@@ -0,0 +1,253 @@
+// Copyright (c) 2014-2017 The Dune Spice developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "arith_uint256.h"
+#include "base58.h"
+#include "rpc/server.h"
+#include "txdb.h"
+#include "validation.h"
+
+#include "test/test_dash.h"
+
+#include <limits>
+#include <set>
+#include <stdexcept>
+
+#include <boost/test/unit_test.hpp>
+
+#include <univalue.h>
+
+extern UniValue CallRPC(std::string args);
+
+BOOST_FIXTURE_TEST_SUITE(addressindex_paging_tests, TestingSetup)
+
+static const uint160 addr1 = uint160(std::vector<unsigned char>(20, 1));
+static const uint160 addr2 = uint160(std::vector<unsigned char>(20, 2));
+
+static uint256 TxHash(int n)
+{
+    return ArithToUint256(arith_uint256(n + 1));
+}
+
+static std::string AddressString(const uint160& hash)
+{
+    return CBitcoinAddress(CKeyID(hash)).ToString();
+}
+
+static CScript GetScriptForKeyID(const uint160& hash)
+{
+    return CScript() << OP_DUP << OP_HASH160 << ToByteVector(hash) << OP_EQUALVERIFY << OP_CHECKSIG;
+}
+
+// One entry per transaction at heights 1 to nCount
+static void WriteAddressEntries(const uint160& hash, int nCount)
+{
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vEntries;
+    for (int i = 0; i < nCount; i++)
+        vEntries.push_back(std::make_pair(CAddressIndexKey(1, hash, i + 1, 0, TxHash(i), 0, false), 1000 + i));
+    BOOST_CHECK(pblocktree->WriteAddressIndex(vEntries));
+}
+
+static void WriteUnspentOutputs(const uint160& hash, int nCount)
+{
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vUnspent;
+    for (int i = 0; i < nCount; i++)
+        vUnspent.push_back(std::make_pair(CAddressUnspentKey(1, hash, TxHash(i), 0), CAddressUnspentValue(1000 + i, GetScriptForKeyID(hash), i + 1)));
+    BOOST_CHECK(pblocktree->UpdateAddressUnspentIndex(vUnspent));
+}
+
+static UniValue CallPaged(const std::string& strMethod, const std::vector<std::string>& vAddresses, const std::string& strLimit, const UniValue& cursor = NullUniValue)
+{
+    std::string strParams = "{\"addresses\":[";
+    for (size_t i = 0; i < vAddresses.size(); i++)
+        strParams += (i > 0 ? ",\"" : "\"") + vAddresses[i] + "\"";
+    strParams += "],\"limit\":" + strLimit;
+    if (!cursor.isNull())
+        strParams += ",\"cursor\":\"" + cursor.get_str() + "\"";
+    strParams += "}";
+    return CallRPC(strMethod + " " + strParams);
+}
+
+BOOST_AUTO_TEST_CASE(addressindex_read_page)
+{
+    WriteAddressEntries(addr1, 10);
+    WriteAddressEntries(addr2, 3);
+
+    CAddressIndexKey keyStart(1, addr1, 0, 0, uint256(), 0, false);
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vPage;
+    BOOST_CHECK(pblocktree->ReadAddressIndexPage(keyStart, 0, 4, vPage));
+    BOOST_CHECK_EQUAL(vPage.size(), 4);
+    for (size_t i = 0; i < vPage.size(); i++) {
+        BOOST_CHECK_EQUAL(vPage[i].first.blockHeight, (int)i + 1);
+        BOOST_CHECK(vPage[i].first.txhash == TxHash(i));
+        BOOST_CHECK_EQUAL(vPage[i].second, 1000 + (CAmount)i);
+    }
+
+    // A page starts at its first key, the last page stops at the address' last entry
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vNext;
+    BOOST_CHECK(pblocktree->ReadAddressIndexPage(vPage.back().first, 0, 100, vNext));
+    BOOST_CHECK_EQUAL(vNext.size(), 7);
+    BOOST_CHECK_EQUAL(vNext.front().first.blockHeight, 4);
+    BOOST_CHECK(vNext.back().first.txhash == TxHash(9));
+
+    // A start key that isn't in the index starts at the entry after it
+    vNext.clear();
+    BOOST_CHECK(pblocktree->ReadAddressIndexPage(CAddressIndexKey(1, addr1, 5, 1, uint256(), 0, false), 0, 2, vNext));
+    BOOST_CHECK_EQUAL(vNext.size(), 2);
+    BOOST_CHECK_EQUAL(vNext.front().first.blockHeight, 6);
+
+    // end limits the heights
+    vNext.clear();
+    BOOST_CHECK(pblocktree->ReadAddressIndexPage(keyStart, 6, 100, vNext));
+    BOOST_CHECK_EQUAL(vNext.size(), 6);
+
+    vNext.clear();
+    BOOST_CHECK(pblocktree->ReadAddressIndexPage(keyStart, 0, 0, vNext));
+    BOOST_CHECK(vNext.empty());
+    BOOST_CHECK(pblocktree->ReadAddressIndexPage(keyStart, 0, std::numeric_limits<size_t>::max(), vNext));
+    BOOST_CHECK_EQUAL(vNext.size(), 10);
+
+    // Results are appended
+    BOOST_CHECK(pblocktree->ReadAddressIndexPage(CAddressIndexKey(1, addr2, 0, 0, uint256(), 0, false), 0, 100, vNext));
+    BOOST_CHECK_EQUAL(vNext.size(), 13);
+    BOOST_CHECK(vNext.back().first.hashBytes == addr2);
+}
+
+BOOST_AUTO_TEST_CASE(addressindex_read_unspent_page)
+{
+    WriteUnspentOutputs(addr1, 10);
+    WriteUnspentOutputs(addr2, 3);
+
+    CAddressUnspentKey keyStart(1, addr1, uint256(), 0);
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vPage;
+    BOOST_CHECK(pblocktree->ReadAddressUnspentIndexPage(keyStart, 4, vPage));
+    BOOST_CHECK_EQUAL(vPage.size(), 4);
+    for (size_t i = 0; i < vPage.size(); i++) {
+        BOOST_CHECK(vPage[i].first.txhash == TxHash(i));
+        BOOST_CHECK_EQUAL(vPage[i].second.satoshis, 1000 + (CAmount)i);
+    }
+
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vNext;
+    BOOST_CHECK(pblocktree->ReadAddressUnspentIndexPage(vPage.back().first, 100, vNext));
+    BOOST_CHECK_EQUAL(vNext.size(), 7);
+    BOOST_CHECK(vNext.front().first.txhash == TxHash(3));
+
+    // An output that was spent since starts the page at the next one
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vSpent;
+    vSpent.push_back(std::make_pair(CAddressUnspentKey(1, addr1, TxHash(5), 0), CAddressUnspentValue()));
+    BOOST_CHECK(pblocktree->UpdateAddressUnspentIndex(vSpent));
+    vNext.clear();
+    BOOST_CHECK(pblocktree->ReadAddressUnspentIndexPage(vSpent[0].first, 2, vNext));
+    BOOST_CHECK_EQUAL(vNext.size(), 2);
+    BOOST_CHECK(vNext.front().first.txhash == TxHash(6));
+
+    vNext.clear();
+    BOOST_CHECK(pblocktree->ReadAddressUnspentIndexPage(keyStart, 0, vNext));
+    BOOST_CHECK(vNext.empty());
+    BOOST_CHECK(pblocktree->ReadAddressUnspentIndexPage(keyStart, std::numeric_limits<size_t>::max(), vNext));
+    BOOST_CHECK_EQUAL(vNext.size(), 9);
+}
+
+BOOST_AUTO_TEST_CASE(addressindex_rpc_txids_page)
+{
+    fAddressIndex = true;
+
+    // 1001 transactions, the entries 999 to 1001 belong to the same one so it
+    // crosses the boundary of the 1000 entries read at once
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vEntries;
+    for (int i = 0; i < 1001; i++) {
+        for (int n = 0; n < (i == 999 ? 3 : 1); n++)
+            vEntries.push_back(std::make_pair(CAddressIndexKey(1, addr1, i + 1, 0, TxHash(i), n, false), 1000));
+    }
+    BOOST_CHECK_EQUAL(vEntries.size(), 1003);
+    BOOST_CHECK(pblocktree->WriteAddressIndex(vEntries));
+    WriteAddressEntries(addr2, 3);
+
+    std::vector<std::string> vAddresses(1, AddressString(addr1));
+    UniValue result = CallPaged("getaddresstxids", vAddresses, "2147483647");
+    BOOST_CHECK(find_value(result, "cursor").isNull());
+    const UniValue& txidsAll = find_value(result, "txids");
+    BOOST_CHECK_EQUAL(txidsAll.size(), 1001);
+    for (size_t i = 0; i < txidsAll.size(); i++)
+        BOOST_CHECK_EQUAL(txidsAll[i].get_str(), TxHash(i).GetHex());
+
+    // The transaction on the read boundary is returned once, in the first page
+    result = CallPaged("getaddresstxids", vAddresses, "1000");
+    BOOST_CHECK_EQUAL(find_value(result, "txids").size(), 1000);
+    BOOST_CHECK_EQUAL(find_value(result, "txids")[999].get_str(), TxHash(999).GetHex());
+    result = CallPaged("getaddresstxids", vAddresses, "1000", find_value(result, "cursor"));
+    BOOST_CHECK_EQUAL(find_value(result, "txids").size(), 1);
+    BOOST_CHECK_EQUAL(find_value(result, "txids")[0].get_str(), TxHash(1000).GetHex());
+    BOOST_CHECK(find_value(result, "cursor").isNull());
+
+    // Pages that end right before and right after it, over both addresses
+    vAddresses.push_back(AddressString(addr2));
+    for (const char* pszLimit : {"999", "300", "7"}) {
+        std::vector<std::string> vTxids;
+        UniValue cursor;
+        do {
+            result = CallPaged("getaddresstxids", vAddresses, pszLimit, cursor);
+            const UniValue& txids = find_value(result, "txids");
+            BOOST_CHECK(txids.size() <= (size_t)atoi(pszLimit));
+            for (size_t i = 0; i < txids.size(); i++)
+                vTxids.push_back(txids[i].get_str());
+            cursor = find_value(result, "cursor");
+        } while (!cursor.isNull());
+        BOOST_CHECK_EQUAL(vTxids.size(), 1004);
+        BOOST_CHECK_EQUAL(std::set<std::string>(vTxids.begin(), vTxids.begin() + 1001).size(), 1001);
+        BOOST_CHECK_EQUAL(vTxids[999], TxHash(999).GetHex());
+        BOOST_CHECK_EQUAL(vTxids[1001], TxHash(0).GetHex());
+    }
+
+    fAddressIndex = false;
+}
+
+BOOST_AUTO_TEST_CASE(addressindex_rpc_cursor)
+{
+    fAddressIndex = true;
+    WriteAddressEntries(addr1, 5);
+    WriteUnspentOutputs(addr1, 5);
+    WriteUnspentOutputs(addr2, 2);
+
+    std::vector<std::string> vAddresses(1, AddressString(addr1));
+    UniValue result = CallPaged("getaddressdeltas", vAddresses, "2");
+    BOOST_CHECK_EQUAL(find_value(result, "deltas").size(), 2);
+    UniValue cursor = find_value(result, "cursor");
+    BOOST_CHECK(cursor.isStr());
+
+    // The entry the cursor points to was erased meanwhile, e.g. by a reorg
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vErase;
+    vErase.push_back(std::make_pair(CAddressIndexKey(1, addr1, 3, 0, TxHash(2), 0, false), 1002));
+    BOOST_CHECK(pblocktree->EraseAddressIndex(vErase));
+    result = CallPaged("getaddressdeltas", vAddresses, "2", cursor);
+    BOOST_CHECK_EQUAL(find_value(result, "deltas").size(), 2);
+    BOOST_CHECK_EQUAL(find_value(find_value(result, "deltas")[0], "height").get_int(), 4);
+    BOOST_CHECK(find_value(result, "cursor").isNull());
+
+    // Cursors of other addresses or that don't decode are refused
+    std::vector<std::string> vOther(1, AddressString(addr2));
+    BOOST_CHECK_THROW(CallPaged("getaddressdeltas", vOther, "2", cursor), std::runtime_error);
+    BOOST_CHECK_THROW(CallPaged("getaddressdeltas", vAddresses, "2", UniValue("zz")), std::runtime_error);
+    BOOST_CHECK_THROW(CallPaged("getaddressdeltas", vAddresses, "2", UniValue("00")), std::runtime_error);
+
+    BOOST_CHECK_THROW(CallPaged("getaddresstxids", vAddresses, "0"), std::runtime_error);
+    BOOST_CHECK_THROW(CallPaged("getaddressutxos", vAddresses, "-1"), std::runtime_error);
+
+    // Unspent outputs continue with the next address
+    vAddresses.push_back(AddressString(addr2));
+    result = CallPaged("getaddressutxos", vAddresses, "4");
+    BOOST_CHECK_EQUAL(find_value(result, "utxos").size(), 4);
+    result = CallPaged("getaddressutxos", vAddresses, "4", find_value(result, "cursor"));
+    const UniValue& utxos = find_value(result, "utxos");
+    BOOST_CHECK_EQUAL(utxos.size(), 3);
+    BOOST_CHECK_EQUAL(find_value(utxos[0], "txid").get_str(), TxHash(4).GetHex());
+    BOOST_CHECK_EQUAL(find_value(utxos[1], "address").get_str(), AddressString(addr2));
+    BOOST_CHECK(find_value(result, "cursor").isNull());
+    result = CallPaged("getaddressutxos", vAddresses, "2147483647");
+    BOOST_CHECK_EQUAL(find_value(result, "utxos").size(), 7);
+
+    fAddressIndex = false;
+}
+
+BOOST_AUTO_TEST_SUITE_END()
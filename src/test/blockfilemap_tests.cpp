@@ -0,0 +1,56 @@
+// Copyright (c) 2014-2017 The Dune Spice developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfilemap.h"
+#include "crypto/common.h"
+#include "validation.h"
+
+#include "test/test_dash.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockfilemap_tests, TestingSetup)
+
+// Append a record of nSize bytes preceded by its size, followed by a 32 byte trailer,
+// of which only nWritten bytes make it to the file
+static CDiskBlockPos AppendRecord(const CDiskBlockPos& posFile, unsigned int nSize, unsigned int nWritten)
+{
+    FILE* file = fopen(GetBlockPosFilename(posFile, "rev").string().c_str(), "ab");
+    BOOST_REQUIRE(file);
+    unsigned char pchSize[4];
+    WriteLE32(pchSize, nSize);
+    fwrite(pchSize, 1, sizeof(pchSize), file);
+    CDiskBlockPos pos(posFile.nFile, ftell(file));
+    std::vector<char> vch(nWritten, 1);
+    fwrite(vch.data(), 1, vch.size(), file);
+    fclose(file);
+    return pos;
+}
+
+BOOST_AUTO_TEST_CASE(blockfilemap_grown_file)
+{
+    boost::filesystem::create_directories(GetDataDir() / "blocks");
+    CBlockFileMapCache cache(4);
+    CDiskBlockPos posFile(900, 0);
+
+    CDiskBlockPos pos1 = AppendRecord(posFile, 100, 100 + 32);
+    CMappedFileRef mapped1 = cache.Get(pos1, "rev", 32);
+    BOOST_REQUIRE(mapped1);
+    BOOST_CHECK_EQUAL(mapped1->size(), 4 + 100 + 32);
+
+    // A record appended after the file was mapped remaps it
+    CDiskBlockPos pos2 = AppendRecord(posFile, 200, 200 + 32);
+    CMappedFileRef mapped2 = cache.Get(pos2, "rev", 32);
+    BOOST_REQUIRE(mapped2);
+    BOOST_CHECK(mapped2->size() >= pos2.nPos + 200 + 32);
+    BOOST_CHECK(cache.Get(pos1, "rev", 32) == mapped2);
+
+    // An incomplete record isn't read from a mapping
+    CDiskBlockPos pos3 = AppendRecord(posFile, 300, 150);
+    BOOST_CHECK(!cache.Get(pos3, "rev", 32));
+    BOOST_CHECK(cache.Get(pos2, "rev", 32));
+    BOOST_CHECK_EQUAL(cache.GetCount(), 1);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,127 @@
+// Copyright (c) 2014-2017 The Dune Spice developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfileparser.h"
+#include "chainparams.h"
+#include "clientversion.h"
+#include "consensus/consensus.h"
+#include "consensus/merkle.h"
+
+#include "test/test_dash.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockfileparser_tests, BasicTestingSetup)
+
+static CBlock MakeBlock(uint32_t nNonce)
+{
+    CBlock block;
+    block.nVersion = 1;
+    block.nTime = 1500000000;
+    block.nNonce = nNonce;
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].scriptSig = CScript() << nNonce;
+    tx.vout.resize(1);
+    tx.vout[0].nValue = 50;
+    block.vtx.push_back(MakeTransactionRef(tx));
+    block.hashMerkleRoot = BlockMerkleRoot(block);
+    return block;
+}
+
+BOOST_AUTO_TEST_CASE(blockfileparser_order)
+{
+    FILE* file = tmpfile();
+    BOOST_REQUIRE(file);
+    CAutoFile fileout(file, SER_DISK, CLIENT_VERSION);
+
+    std::vector<CBlock> vBlocks;
+    std::vector<uint64_t> vPos;
+    for (uint32_t i = 0; i < 50; i++) {
+        CBlock block = MakeBlock(i);
+        if (i == 10)
+            block.hashMerkleRoot = uint256S("0x01");
+        // some junk between the frames has to be skipped
+        fileout << (uint8_t)i;
+        fileout << FLATDATA(Params().MessageStart()) << (unsigned int)fileout.GetSerializeSize(block);
+        vPos.push_back(ftell(file));
+        fileout << block;
+        vBlocks.push_back(block);
+    }
+    // a frame which doesn't hold a block
+    std::vector<unsigned char> vchGarbage(100, 0xff);
+    fileout << FLATDATA(Params().MessageStart()) << (unsigned int)vchGarbage.size() << FLATDATA(vchGarbage);
+    rewind(file);
+
+    CBlockFileParser parser(fileout.release(), Params().MessageStart(), MaxBlockSize(true), 4);
+    std::shared_ptr<CBlockFileParser::block_t> pparsed;
+    for (size_t i = 0; i < vBlocks.size(); i++) {
+        BOOST_REQUIRE(parser.Next(pparsed));
+        BOOST_CHECK_EQUAL(pparsed->nPos, vPos[i]);
+        BOOST_REQUIRE(pparsed->pblock);
+        BOOST_CHECK(pparsed->pblock->GetHash() == vBlocks[i].GetHash());
+        BOOST_CHECK_EQUAL(pparsed->pblock->fMerkleRootChecked, i != 10);
+    }
+    BOOST_REQUIRE(parser.Next(pparsed));
+    BOOST_CHECK(!pparsed->pblock);
+    BOOST_CHECK(!pparsed->strError.empty());
+    BOOST_CHECK(!parser.Next(pparsed));
+}
+
+BOOST_AUTO_TEST_CASE(blockfileparser_rescan)
+{
+    FILE* file = tmpfile();
+    BOOST_REQUIRE(file);
+    CAutoFile fileout(file, SER_DISK, CLIENT_VERSION);
+
+    // A frame around the frame of a block. Read as a block, the compact size
+    // of its transactions starts with the 0xff of nBits and is too large.
+    CBlock blockInner = MakeBlock(1);
+    blockInner.nBits = 0xffffffff;
+    unsigned int nInnerSize = fileout.GetSerializeSize(blockInner);
+    fileout << FLATDATA(Params().MessageStart()) << (unsigned int)(nInnerSize + MESSAGE_START_SIZE + sizeof(unsigned int));
+    fileout << FLATDATA(Params().MessageStart()) << nInnerSize;
+    uint64_t nInnerPos = ftell(file);
+    fileout << blockInner;
+    CBlock blockNext = MakeBlock(2);
+    fileout << FLATDATA(Params().MessageStart()) << (unsigned int)fileout.GetSerializeSize(blockNext);
+    uint64_t nNextPos = ftell(file);
+    fileout << blockNext;
+    rewind(file);
+
+    // The file is scanned again from right after the message start of the
+    // frame that couldn't be deserialized
+    CBlockFileParser parser(fileout.release(), Params().MessageStart(), MaxBlockSize(true), 2);
+    std::shared_ptr<CBlockFileParser::block_t> pparsed;
+    BOOST_REQUIRE(parser.Next(pparsed));
+    BOOST_CHECK(!pparsed->pblock);
+    BOOST_REQUIRE(parser.Next(pparsed));
+    BOOST_CHECK_EQUAL(pparsed->nPos, nInnerPos);
+    BOOST_REQUIRE(pparsed->pblock);
+    BOOST_CHECK(pparsed->pblock->GetHash() == blockInner.GetHash());
+    BOOST_REQUIRE(parser.Next(pparsed));
+    BOOST_CHECK_EQUAL(pparsed->nPos, nNextPos);
+    BOOST_REQUIRE(pparsed->pblock);
+    BOOST_CHECK(pparsed->pblock->GetHash() == blockNext.GetHash());
+    BOOST_CHECK(!parser.Next(pparsed));
+}
+
+BOOST_AUTO_TEST_CASE(blockfileparser_stop)
+{
+    FILE* file = tmpfile();
+    BOOST_REQUIRE(file);
+    CAutoFile fileout(file, SER_DISK, CLIENT_VERSION);
+    for (uint32_t i = 0; i < 10; i++) {
+        CBlock block = MakeBlock(i);
+        fileout << FLATDATA(Params().MessageStart()) << (unsigned int)fileout.GetSerializeSize(block) << block;
+    }
+    rewind(file);
+
+    // destroying the parser before the end of the file stops its threads
+    CBlockFileParser parser(fileout.release(), Params().MessageStart(), MaxBlockSize(true), 2);
+    std::shared_ptr<CBlockFileParser::block_t> pparsed;
+    BOOST_CHECK(parser.Next(pparsed));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,94 @@
+// Copyright (c) 2014-2017 The Dune Spice developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockservecache.h"
+#include "chainparams.h"
+#include "protocol.h"
+#include "streams.h"
+#include "version.h"
+
+#include "test/test_dash.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockservecache_tests, TestingSetup)
+
+static std::shared_ptr<const CBlock> MakeBlock(uint32_t nNonce)
+{
+    std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+    pblock->nVersion = 1;
+    pblock->nTime = 1500000000;
+    pblock->nNonce = nNonce;
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].scriptSig = CScript() << nNonce;
+    tx.vout.resize(1);
+    tx.vout[0].nValue = 50;
+    pblock->vtx.push_back(MakeTransactionRef(tx));
+    return pblock;
+}
+
+BOOST_AUTO_TEST_CASE(blockservecache_message)
+{
+    CBlockServeCache cache(1 << 20);
+    std::shared_ptr<const CBlock> pblock = MakeBlock(1);
+
+    CBlockServeCache::entry_t entry = cache.Insert(pblock, *g_connman);
+    BOOST_CHECK(entry.pblock == pblock);
+
+    // the cached message is a complete "block" message
+    CDataStream ss(entry.msgBlock->begin(), entry.msgBlock->end(), SER_NETWORK, PROTOCOL_VERSION);
+    CMessageHeader hdr(Params().MessageStart());
+    ss >> hdr;
+    BOOST_CHECK(hdr.IsValid(Params().MessageStart()));
+    BOOST_CHECK_EQUAL(hdr.GetCommand(), NetMsgType::BLOCK);
+    BOOST_CHECK_EQUAL(hdr.nMessageSize, ss.size());
+    CBlock block;
+    ss >> block;
+    BOOST_CHECK(block.GetHash() == pblock->GetHash());
+
+    CBlockServeCache::entry_t entry2;
+    BOOST_CHECK(cache.Get(pblock->GetHash(), entry2));
+    BOOST_CHECK(entry2.msgBlock == entry.msgBlock);
+    BOOST_CHECK(!cache.Get(MakeBlock(2)->GetHash(), entry2));
+}
+
+BOOST_AUTO_TEST_CASE(blockservecache_lru)
+{
+    CBlockServeCache cache(1 << 20);
+    std::shared_ptr<const CBlock> pblock1 = MakeBlock(1);
+    std::shared_ptr<const CBlock> pblock2 = MakeBlock(2);
+    std::shared_ptr<const CBlock> pblock3 = MakeBlock(3);
+
+    cache.Insert(pblock1, *g_connman);
+    size_t nEntrySize = cache.GetSize();
+    BOOST_CHECK(nEntrySize > 0);
+    cache.Insert(pblock2, *g_connman);
+    BOOST_CHECK_EQUAL(cache.GetCount(), 2);
+
+    // room for two blocks only, touching block 1 makes block 2 the one to go
+    cache.SetMaxSize(nEntrySize * 2 + nEntrySize / 2);
+    CBlockServeCache::entry_t entry;
+    BOOST_CHECK(cache.Get(pblock1->GetHash(), entry));
+    cache.Insert(pblock3, *g_connman);
+    BOOST_CHECK_EQUAL(cache.GetCount(), 2);
+    BOOST_CHECK(cache.Get(pblock1->GetHash(), entry));
+    BOOST_CHECK(!cache.Get(pblock2->GetHash(), entry));
+    BOOST_CHECK(cache.Get(pblock3->GetHash(), entry));
+
+    // shrinking drops the least recently used ones
+    cache.SetMaxSize(nEntrySize + nEntrySize / 2);
+    BOOST_CHECK_EQUAL(cache.GetCount(), 1);
+    BOOST_CHECK(cache.Get(pblock3->GetHash(), entry));
+
+    // a disabled cache keeps nothing but still serializes
+    cache.SetMaxSize(0);
+    BOOST_CHECK_EQUAL(cache.GetCount(), 0);
+    BOOST_CHECK_EQUAL(cache.GetSize(), 0);
+    entry = cache.Insert(pblock1, *g_connman);
+    BOOST_CHECK(entry.msgBlock && !entry.msgBlock->empty());
+    BOOST_CHECK_EQUAL(cache.GetCount(), 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
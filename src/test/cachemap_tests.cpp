@@ -124,4 +124,42 @@ BOOST_AUTO_TEST_CASE(cachemap_test)
     BOOST_CHECK(Compare(mapTest1, mapTest4));
 }
 
+BOOST_AUTO_TEST_CASE(cachemap_lru_test)
+{
+    CacheMap<int,int> mapTest(3);
+    for(int i = 0; i < 3; ++i) {
+        mapTest.Insert(i, i * 10);
+    }
+
+    // a hit through GetAndTouch makes the item the most recently used one
+    int nVal = 0;
+    BOOST_CHECK(mapTest.GetAndTouch(0, nVal));
+    BOOST_CHECK(nVal == 0);
+    BOOST_CHECK(mapTest.GetItemList().front().key == 0);
+    BOOST_CHECK(!mapTest.GetAndTouch(5, nVal));
+
+    // so the least recently used one is pruned instead
+    mapTest.Insert(3, 30);
+    BOOST_CHECK(mapTest.GetSize() == 3);
+    BOOST_CHECK(mapTest.HasKey(0));
+    BOOST_CHECK(!mapTest.HasKey(1));
+
+    // Get doesn't change the order
+    BOOST_CHECK(mapTest.Get(2, nVal));
+    BOOST_CHECK(nVal == 20);
+    mapTest.Insert(4, 40);
+    BOOST_CHECK(!mapTest.HasKey(2));
+    BOOST_CHECK(mapTest.HasKey(0));
+    BOOST_CHECK(mapTest.HasKey(3));
+
+    // the index stays valid after moving items around
+    BOOST_CHECK(mapTest.GetAndTouch(3, nVal));
+    BOOST_CHECK(nVal == 30);
+    mapTest.Erase(3);
+    BOOST_CHECK(mapTest.GetSize() == 2);
+    BOOST_CHECK(!mapTest.GetAndTouch(3, nVal));
+    BOOST_CHECK(mapTest.GetAndTouch(4, nVal));
+    BOOST_CHECK(nVal == 40);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,116 @@
+// Copyright (c) 2014-2017 The Dune Spice developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "chainparams.h"
+#include "coinsprefetch.h"
+#include "random.h"
+#include "txdb.h"
+#include "validation.h"
+
+#include "test/test_dash.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(coinsprefetch_tests, TestingSetup)
+
+static void WriteCoins(CCoinsViewDB& db, const uint256& txid, unsigned int nOutputs)
+{
+    CCoinsViewCache cache(&db);
+    for (unsigned int i = 0; i < nOutputs; i++) {
+        Coin coin(CTxOut(1000 + i, CScript() << OP_TRUE), 1, false);
+        cache.AddCoin(COutPoint(txid, i), std::move(coin), false);
+    }
+    BOOST_CHECK(cache.Flush());
+}
+
+// A block spending nOutputs outputs of txid, and the output of one of its own transactions
+static CBlock MakeBlock(const uint256& txid, unsigned int nOutputs)
+{
+    CBlock block;
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vout.resize(1);
+    block.vtx.push_back(MakeTransactionRef(coinbase));
+
+    CMutableTransaction tx;
+    for (unsigned int i = 0; i < nOutputs; i++)
+        tx.vin.push_back(CTxIn(COutPoint(txid, i)));
+    tx.vout.resize(1);
+    block.vtx.push_back(MakeTransactionRef(tx));
+
+    CMutableTransaction child;
+    child.vin.push_back(CTxIn(COutPoint(block.vtx[1]->GetHash(), 0)));
+    child.vout.resize(1);
+    block.vtx.push_back(MakeTransactionRef(child));
+    return block;
+}
+
+BOOST_AUTO_TEST_CASE(coinsprefetch_apply)
+{
+    LOCK(cs_main);
+    CCoinsViewDB db(1 << 20, true);
+    uint256 txid = GetRandHash();
+    WriteCoins(db, txid, 20);
+
+    CBlock block = MakeBlock(txid, 20);
+    CCoinsPrefetcher prefetcher(&db, Params().GetConsensus(), 2);
+    prefetcher.Prefetch(block);
+    prefetcher.WaitForIdle();
+
+    CCoinsViewCache cache(&db);
+    BOOST_CHECK_EQUAL(prefetcher.Apply(block.GetHash(), cache), 20);
+    for (unsigned int i = 0; i < 20; i++)
+        BOOST_CHECK(cache.HaveCoinInCache(COutPoint(txid, i)));
+    // the block's own output was never looked up
+    BOOST_CHECK(!cache.HaveCoinInCache(COutPoint(block.vtx[1]->GetHash(), 0)));
+
+    // The block is forgotten once applied
+    BOOST_CHECK_EQUAL(prefetcher.Apply(block.GetHash(), cache), 0);
+}
+
+BOOST_AUTO_TEST_CASE(coinsprefetch_keeps_cache_entries)
+{
+    LOCK(cs_main);
+    CCoinsViewDB db(1 << 20, true);
+    uint256 txid = GetRandHash();
+    WriteCoins(db, txid, 4);
+
+    CBlock block = MakeBlock(txid, 4);
+    CCoinsPrefetcher prefetcher(&db, Params().GetConsensus(), 1);
+    prefetcher.Prefetch(block);
+    prefetcher.WaitForIdle();
+
+    // A coin the cache already spent must stay spent
+    CCoinsViewCache cache(&db);
+    BOOST_CHECK(cache.SpendCoin(COutPoint(txid, 0)));
+    BOOST_CHECK_EQUAL(prefetcher.Apply(block.GetHash(), cache), 3);
+    BOOST_CHECK(!cache.HaveCoin(COutPoint(txid, 0)));
+    BOOST_CHECK(cache.HaveCoinInCache(COutPoint(txid, 1)));
+}
+
+BOOST_AUTO_TEST_CASE(coinsprefetch_discards_after_write)
+{
+    LOCK(cs_main);
+    CCoinsViewDB db(1 << 20, true);
+    uint256 txid = GetRandHash();
+    WriteCoins(db, txid, 4);
+
+    CBlock block = MakeBlock(txid, 4);
+    CCoinsPrefetcher prefetcher(&db, Params().GetConsensus(), 1);
+    prefetcher.Prefetch(block);
+    prefetcher.WaitForIdle();
+
+    // Spend a coin in the database after it was fetched
+    {
+        CCoinsViewCache cacheSpend(&db);
+        BOOST_CHECK(cacheSpend.SpendCoin(COutPoint(txid, 0)));
+        BOOST_CHECK(cacheSpend.Flush());
+    }
+
+    CCoinsViewCache cache(&db);
+    BOOST_CHECK_EQUAL(prefetcher.Apply(block.GetHash(), cache), 0);
+    BOOST_CHECK(!cache.HaveCoin(COutPoint(txid, 0)));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
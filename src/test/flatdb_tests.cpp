@@ -0,0 +1,159 @@
+// Copyright (c) 2014-2017 The Dune Spice developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "flat-database.h"
+
+#include "test/test_dash.h"
+
+#include <map>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(flatdb_tests, TestingSetup)
+
+// A journaled cache of numbers
+class CTestCache : public CFlatDBJournaledCache
+{
+public:
+    std::map<int, int> mapValues;
+
+    void Set(int nKey, int nValue)
+    {
+        mapValues[nKey] = nValue;
+        journal.Append(1, std::make_pair(nKey, nValue));
+    }
+
+    void Erase(int nKey)
+    {
+        mapValues.erase(nKey);
+        journal.Append(2, nKey);
+    }
+
+    bool ApplyJournalRecord(CDataStream& ssRecord) override
+    {
+        unsigned char nType;
+        ssRecord >> nType;
+        if (nType == 1) {
+            std::pair<int, int> pairValue;
+            ssRecord >> pairValue;
+            mapValues[pairValue.first] = pairValue.second;
+            return true;
+        } else if (nType == 2) {
+            int nKey;
+            ssRecord >> nKey;
+            mapValues.erase(nKey);
+            return true;
+        }
+        return false;
+    }
+
+    void Clear() { mapValues.clear(); }
+    void CheckAndRemove() {}
+    std::string ToString() const { return strprintf("Values: %d", (int)mapValues.size()); }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(mapValues);
+    }
+};
+
+BOOST_AUTO_TEST_CASE(flatdb_journal_replay)
+{
+    CFlatDB<CTestCache> flatdb("testcache.dat", "magicTestCache");
+    boost::filesystem::path pathJournal = GetDataDir() / "testcache.journal";
+
+    {
+        CTestCache cache;
+        BOOST_CHECK(flatdb.Load(cache));
+        cache.Set(1, 10);
+        BOOST_CHECK(flatdb.Dump(cache));
+    }
+
+    // Changes after the last full write are only in the journal
+    {
+        CTestCache cache;
+        BOOST_CHECK(flatdb.Load(cache));
+        BOOST_CHECK_EQUAL(cache.mapValues[1], 10);
+        cache.Set(2, 20);
+        cache.Set(3, 30);
+        cache.Erase(1);
+        cache.journal.Close();
+    }
+    uint64_t nJournalSize = boost::filesystem::file_size(pathJournal);
+
+    // A record a crash cut short is dropped
+    FILE* file = fopen(pathJournal.string().c_str(), "ab");
+    BOOST_CHECK(file);
+    const char pchGarbage[] = {8, 0, 0, 0, 1, 2};
+    fwrite(pchGarbage, 1, sizeof(pchGarbage), file);
+    fclose(file);
+
+    {
+        CTestCache cache;
+        BOOST_CHECK(flatdb.Load(cache));
+        BOOST_CHECK_EQUAL(cache.mapValues.size(), 2);
+        BOOST_CHECK_EQUAL(cache.mapValues[2], 20);
+        BOOST_CHECK_EQUAL(cache.mapValues[3], 30);
+        BOOST_CHECK_EQUAL(cache.journal.GetSize(), nJournalSize);
+
+        // Once the journal is larger than the file it is compacted
+        for (int i = 0; i < 100000; i++)
+            cache.Set(4, i);
+        BOOST_CHECK(cache.journal.GetSize() > FLATDB_JOURNAL_MIN_COMPACT_SIZE);
+        BOOST_CHECK(flatdb.Compact(cache));
+        BOOST_CHECK(cache.journal.GetSize() < nJournalSize);
+        cache.Set(5, 50);
+        BOOST_CHECK(flatdb.Dump(cache));
+    }
+
+    // The new journal extends the rewritten file
+    {
+        CTestCache cache;
+        BOOST_CHECK(flatdb.Load(cache));
+        BOOST_CHECK_EQUAL(cache.mapValues.size(), 4);
+        BOOST_CHECK_EQUAL(cache.mapValues[4], 99999);
+        BOOST_CHECK_EQUAL(cache.mapValues[5], 50);
+        cache.journal.Close();
+    }
+}
+
+BOOST_AUTO_TEST_CASE(flatdb_dump_small_journal)
+{
+    CFlatDB<CTestCache> flatdb("testsmalljournal.dat", "magicTestCache");
+    boost::filesystem::path pathDB = GetDataDir() / "testsmalljournal.dat";
+
+    {
+        CTestCache cache;
+        BOOST_CHECK(flatdb.Load(cache));
+        for (int i = 0; i < 100000; i++)
+            cache.Set(i, i);
+        BOOST_CHECK(cache.journal.GetSize() > FLATDB_JOURNAL_MIN_COMPACT_SIZE);
+        BOOST_CHECK(flatdb.Dump(cache));
+    }
+    BOOST_CHECK(boost::filesystem::exists(pathDB));
+    uint64_t nFileSize = boost::filesystem::file_size(pathDB);
+
+    // A small journal is kept on shutdown instead of rewriting the file
+    {
+        CTestCache cache;
+        BOOST_CHECK(flatdb.Load(cache));
+        cache.Set(0, -1);
+        cache.Erase(1);
+        BOOST_CHECK(flatdb.Dump(cache));
+    }
+    BOOST_CHECK_EQUAL(boost::filesystem::file_size(pathDB), nFileSize);
+
+    {
+        CTestCache cache;
+        BOOST_CHECK(flatdb.Load(cache));
+        BOOST_CHECK_EQUAL(cache.mapValues.size(), 99999);
+        BOOST_CHECK_EQUAL(cache.mapValues[0], -1);
+        BOOST_CHECK(!cache.mapValues.count(1));
+        cache.journal.Close();
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
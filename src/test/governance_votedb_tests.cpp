@@ -0,0 +1,102 @@
+// Copyright (c) 2014-2017 The Dune Spice developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "arith_uint256.h"
+#include "governance-votedb.h"
+#include "random.h"
+
+#include "test/test_dash.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(governance_votedb_tests, TestingSetup)
+
+static CGovernanceVote MakeVote(const uint256& nParentHash, int n)
+{
+    CGovernanceVote vote(COutPoint(ArithToUint256(arith_uint256(n + 1)), 0), nParentHash, VOTE_SIGNAL_FUNDING, VOTE_OUTCOME_YES);
+    vote.SetTime(1000 + n);
+    return vote;
+}
+
+BOOST_AUTO_TEST_CASE(votefile_database)
+{
+    uint256 nParentHash = GetRandHash();
+    uint256 nOtherParentHash = GetRandHash();
+
+    CGovernanceObjectVoteFile fileVotes;
+    fileVotes.SetParentHash(nParentHash);
+    std::vector<CGovernanceVote> vecVotes;
+    for(int i = 0; i < 300; ++i) {
+        vecVotes.push_back(MakeVote(nParentHash, i));
+        fileVotes.AddVote(vecVotes.back());
+    }
+    CGovernanceObjectVoteFile fileOther;
+    fileOther.SetParentHash(nOtherParentHash);
+    fileOther.AddVote(MakeVote(nOtherParentHash, 0));
+
+    // Votes no longer held in memory are read from the database
+    BOOST_CHECK_EQUAL(fileVotes.GetVoteCount(), 300);
+    BOOST_CHECK(fileVotes.HasVote(vecVotes[0].GetHash()));
+    CGovernanceVote vote;
+    BOOST_CHECK(fileVotes.GetVote(vecVotes[0].GetHash(), vote));
+    BOOST_CHECK(vote.GetHash() == vecVotes[0].GetHash());
+    BOOST_CHECK_EQUAL(fileVotes.GetVotes().size(), 300);
+    BOOST_CHECK_EQUAL(fileVotes.GetVoteHashes().size(), 300);
+    BOOST_CHECK(!fileOther.HasVote(vecVotes[0].GetHash()));
+
+    // Only the recent votes are serialized
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << fileVotes;
+    CGovernanceObjectVoteFile fileLoaded;
+    ss >> fileLoaded;
+    fileLoaded.SetParentHash(nParentHash);
+    BOOST_CHECK_EQUAL(fileLoaded.GetVoteCount(), 300);
+    BOOST_CHECK(fileLoaded.HasVote(vecVotes[0].GetHash()));
+    BOOST_CHECK_EQUAL(fileLoaded.Migrate().size(), 300);
+
+    std::set<COutPoint> setMasternodes;
+    setMasternodes.insert(vecVotes[0].GetMasternodeOutpoint());
+    setMasternodes.insert(vecVotes[299].GetMasternodeOutpoint());
+    fileVotes.RemoveVotesFromMasternodes(setMasternodes);
+    BOOST_CHECK_EQUAL(fileVotes.GetVoteCount(), 298);
+    BOOST_CHECK(!fileVotes.HasVote(vecVotes[0].GetHash()));
+    BOOST_CHECK(!fileVotes.HasVote(vecVotes[299].GetHash()));
+    BOOST_CHECK(fileVotes.HasVote(vecVotes[1].GetHash()));
+
+    // Votes on objects that are gone are erased
+    std::set<uint256> setParentHashes;
+    setParentHashes.insert(nOtherParentHash);
+    BOOST_CHECK(pgovernancevotedb->EraseOrphanedVotes(setParentHashes));
+    std::vector<uint256> vecHashes;
+    BOOST_CHECK(pgovernancevotedb->ReadVoteHashes(nParentHash, vecHashes));
+    BOOST_CHECK(vecHashes.empty());
+    BOOST_CHECK_EQUAL(fileOther.GetVoteHashes().size(), 1);
+
+    fileOther.RemoveAllVotes();
+    BOOST_CHECK_EQUAL(fileOther.GetVoteCount(), 0);
+    BOOST_CHECK(fileOther.GetVoteHashes().empty());
+}
+
+BOOST_AUTO_TEST_CASE(votefile_migrate)
+{
+    // governance.dat used to hold every vote in memory, in the same format
+    uint256 nParentHash = GetRandHash();
+    std::list<CGovernanceVote> listVotes;
+    for(int i = 0; i < 150; ++i) {
+        listVotes.push_back(MakeVote(nParentHash, i));
+    }
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << (int)listVotes.size() << listVotes;
+
+    CGovernanceObjectVoteFile fileVotes;
+    ss >> fileVotes;
+    fileVotes.SetParentHash(nParentHash);
+    BOOST_CHECK(fileVotes.GetVoteHashes().empty());
+    BOOST_CHECK_EQUAL(fileVotes.Migrate().size(), 150);
+    BOOST_CHECK_EQUAL(fileVotes.GetVoteCount(), 150);
+    BOOST_CHECK_EQUAL(fileVotes.GetVotes().size(), 150);
+    BOOST_CHECK(fileVotes.HasVote(listVotes.back().GetHash()));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
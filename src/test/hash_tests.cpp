@@ -3,12 +3,16 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "hash.h"
+#include "primitives/block.h"
+#include "random.h"
 #include "utilstrencodings.h"
 #include "test/test_dash.h"
 
 #include <vector>
 
+#include <boost/bind.hpp>
 #include <boost/test/unit_test.hpp>
+#include <boost/thread/thread.hpp>
 
 using namespace std;
 
@@ -85,4 +89,67 @@ BOOST_AUTO_TEST_CASE(siphash)
     }*/
 }
 
+BOOST_AUTO_TEST_CASE(block_header_hash_cache)
+{
+    std::vector<CBlockHeader> vHeaders(3);
+    for (size_t i = 0; i < vHeaders.size(); i++) {
+        vHeaders[i].nVersion = 2;
+        vHeaders[i].hashPrevBlock = GetRandHash();
+        vHeaders[i].hashMerkleRoot = GetRandHash();
+        vHeaders[i].nTime = insecure_rand();
+        vHeaders[i].nBits = 0x1e0ffff0;
+        vHeaders[i].nNonce = insecure_rand();
+    }
+
+    std::vector<uint256> vHashes;
+    for (size_t i = 0; i < vHeaders.size(); i++) {
+        vHashes.push_back(vHeaders[i].GetHash());
+        BOOST_CHECK(vHashes[i] == HashX11(BEGIN(vHeaders[i].nVersion), END(vHeaders[i].nNonce)));
+        BOOST_CHECK(vHeaders[i].GetHash() == vHashes[i]);
+    }
+
+    // Mutating any field must not return the stale hash
+    CBlockHeader header = vHeaders[0];
+    BOOST_CHECK(header.GetHash() == vHashes[0]);
+    header.nNonce++;
+    BOOST_CHECK(header.GetHash() != vHashes[0]);
+    BOOST_CHECK(header.GetHash() == HashX11(BEGIN(header.nVersion), END(header.nNonce)));
+    header.nNonce--;
+    BOOST_CHECK(header.GetHash() == vHashes[0]);
+    header.hashMerkleRoot = vHeaders[1].hashMerkleRoot;
+    BOOST_CHECK(header.GetHash() == HashX11(BEGIN(header.nVersion), END(header.nNonce)));
+
+    // A block built from a header keeps its cached hash
+    CBlock block(vHeaders[2]);
+    BOOST_CHECK(block.GetHash() == vHashes[2]);
+    block.SetNull();
+    BOOST_CHECK(block.GetHash() == HashX11(BEGIN(block.nVersion), END(block.nNonce)));
+}
+
+static void HashHeader(const CBlockHeader* pheader, uint256* phashRet)
+{
+    for (int i = 0; i < 100; i++)
+        *phashRet = pheader->GetHash();
+}
+
+BOOST_AUTO_TEST_CASE(block_header_hash_cache_threads)
+{
+    // A header shared between threads is hashed by all of them at once
+    CBlockHeader header;
+    header.nVersion = 2;
+    header.hashPrevBlock = GetRandHash();
+    header.hashMerkleRoot = GetRandHash();
+    header.nBits = 0x1e0ffff0;
+    uint256 hashExpected = HashX11(BEGIN(header.nVersion), END(header.nNonce));
+
+    std::vector<uint256> vHashes(4);
+    boost::thread_group threadGroup;
+    for (size_t i = 0; i < vHashes.size(); i++)
+        threadGroup.create_thread(boost::bind(HashHeader, &header, &vHashes[i]));
+    threadGroup.join_all();
+    for (size_t i = 0; i < vHashes.size(); i++)
+        BOOST_CHECK(vHashes[i] == hashExpected);
+    BOOST_CHECK(header.GetHash() == hashExpected);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,258 @@
+// Copyright (c) 2014-2017 The Dune Spice developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "chainparams.h"
+#include "indexwriter.h"
+#include "random.h"
+#include "txdb.h"
+#include "validation.h"
+
+#include "test/test_dash.h"
+
+#include <boost/test/unit_test.hpp>
+
+// Turns the indexes enabled by a test off again, even if it fails half way
+struct IndexWriterTestingSetup : public TestingSetup {
+    ~IndexWriterTestingSetup()
+    {
+        delete pIndexWriter;
+        pIndexWriter = NULL;
+        fAddressIndex = false;
+        fSpentIndex = false;
+    }
+};
+
+BOOST_FIXTURE_TEST_SUITE(indexwriter_tests, IndexWriterTestingSetup)
+
+static CScript GetScriptForKeyID(const uint160& hash)
+{
+    return CScript() << OP_DUP << OP_HASH160 << ToByteVector(hash) << OP_EQUALVERIFY << OP_CHECKSIG;
+}
+
+BOOST_AUTO_TEST_CASE(indexwriter_connect_disconnect)
+{
+    fAddressIndex = true;
+    fSpentIndex = true;
+
+    uint160 addrSpent = uint160(std::vector<unsigned char>(20, 1));
+    uint160 addrReceived = uint160(std::vector<unsigned char>(20, 2));
+    uint256 txidPrev = GetRandHash();
+
+    CBlock block;
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vout.resize(1);
+    block.vtx.push_back(MakeTransactionRef(coinbase));
+    CMutableTransaction tx;
+    tx.vin.push_back(CTxIn(COutPoint(txidPrev, 3)));
+    tx.vout.push_back(CTxOut(4000, GetScriptForKeyID(addrReceived)));
+    block.vtx.push_back(MakeTransactionRef(tx));
+
+    CBlockUndo blockundo;
+    blockundo.vtxundo.resize(1);
+    blockundo.vtxundo[0].vprevout.push_back(Coin(CTxOut(5000, GetScriptForKeyID(addrSpent)), 7, false));
+
+    uint256 hashPrev = GetRandHash();
+    uint256 hash = block.GetHash();
+    CBlockIndex indexPrev;
+    indexPrev.phashBlock = &hashPrev;
+    indexPrev.nHeight = 9;
+    CBlockIndex index;
+    index.phashBlock = &hash;
+    index.pprev = &indexPrev;
+    index.nHeight = 10;
+
+    // Start with the spent output in the unspent index
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vUnspent;
+    vUnspent.push_back(std::make_pair(CAddressUnspentKey(1, addrSpent, txidPrev, 3), CAddressUnspentValue(5000, GetScriptForKeyID(addrSpent), 7)));
+    BOOST_CHECK(pblocktree->UpdateAddressUnspentIndex(vUnspent));
+
+    CIndexWriter writer(pblocktree);
+    CBlockUndo blockundoCopy = blockundo;
+    BOOST_CHECK(writer.Connect(block, std::move(blockundoCopy), &index));
+    BOOST_CHECK(writer.Flush());
+
+    uint256 hashIndexed;
+    BOOST_CHECK(pblocktree->ReadIndexedBlock(hashIndexed));
+    BOOST_CHECK(hashIndexed == hash);
+
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vAddressIndex;
+    BOOST_CHECK(pblocktree->ReadAddressIndex(addrSpent, 1, vAddressIndex));
+    BOOST_CHECK_EQUAL(vAddressIndex.size(), 1);
+    BOOST_CHECK_EQUAL(vAddressIndex[0].second, -5000);
+    BOOST_CHECK(vAddressIndex[0].first.spending);
+
+    vUnspent.clear();
+    BOOST_CHECK(pblocktree->ReadAddressUnspentIndex(addrSpent, 1, vUnspent));
+    BOOST_CHECK(vUnspent.empty());
+    BOOST_CHECK(pblocktree->ReadAddressUnspentIndex(addrReceived, 1, vUnspent));
+    BOOST_CHECK_EQUAL(vUnspent.size(), 1);
+    BOOST_CHECK_EQUAL(vUnspent[0].second.satoshis, 4000);
+    BOOST_CHECK_EQUAL(vUnspent[0].second.blockHeight, 10);
+
+    CAddressBalanceValue balance;
+    BOOST_CHECK(pblocktree->ReadAddressBalance(1, addrReceived, balance));
+    BOOST_CHECK_EQUAL(balance.balance, 4000);
+    BOOST_CHECK_EQUAL(balance.received, 4000);
+    BOOST_CHECK_EQUAL(balance.txCount, 1);
+    BOOST_CHECK_EQUAL(balance.lastHeight, 10);
+    BOOST_CHECK(pblocktree->ReadAddressBalance(1, addrSpent, balance));
+    BOOST_CHECK_EQUAL(balance.balance, -5000);
+    BOOST_CHECK_EQUAL(balance.received, 0);
+
+    CSpentIndexKey spentKey(txidPrev, 3);
+    CSpentIndexValue spentValue;
+    BOOST_CHECK(pblocktree->ReadSpentIndex(spentKey, spentValue));
+    BOOST_CHECK(spentValue.txid == block.vtx[1]->GetHash());
+    BOOST_CHECK_EQUAL(spentValue.satoshis, 5000);
+
+    // Disconnecting restores the previous state
+    BOOST_CHECK(writer.Disconnect(block, std::move(blockundo), &index));
+    BOOST_CHECK(writer.Flush());
+
+    BOOST_CHECK(pblocktree->ReadIndexedBlock(hashIndexed));
+    BOOST_CHECK(hashIndexed == hashPrev);
+
+    vAddressIndex.clear();
+    BOOST_CHECK(pblocktree->ReadAddressIndex(addrSpent, 1, vAddressIndex));
+    BOOST_CHECK(vAddressIndex.empty());
+    vUnspent.clear();
+    BOOST_CHECK(pblocktree->ReadAddressUnspentIndex(addrReceived, 1, vUnspent));
+    BOOST_CHECK(vUnspent.empty());
+    BOOST_CHECK(pblocktree->ReadAddressUnspentIndex(addrSpent, 1, vUnspent));
+    BOOST_CHECK_EQUAL(vUnspent.size(), 1);
+    BOOST_CHECK_EQUAL(vUnspent[0].second.blockHeight, 7);
+    BOOST_CHECK(!pblocktree->ReadSpentIndex(spentKey, spentValue));
+    BOOST_CHECK(pblocktree->ReadAddressBalance(1, addrReceived, balance));
+    BOOST_CHECK(balance.IsNull());
+}
+
+BOOST_AUTO_TEST_CASE(indexwriter_address_balance)
+{
+    fAddressIndex = true;
+
+    uint160 addr = uint160(std::vector<unsigned char>(20, 3));
+    std::vector<CBlock> blocks(3);
+    std::vector<uint256> hashes(3);
+    std::vector<CBlockIndex> indexes(3);
+    for (int i = 0; i < 3; i++) {
+        CMutableTransaction coinbase;
+        coinbase.vin.resize(1);
+        coinbase.vin[0].scriptSig = CScript() << i;
+        coinbase.vout.push_back(CTxOut(1000 * (i + 1), GetScriptForKeyID(addr)));
+        blocks[i].vtx.push_back(MakeTransactionRef(coinbase));
+        hashes[i] = blocks[i].GetHash();
+        indexes[i].phashBlock = &hashes[i];
+        indexes[i].nHeight = 20 + i;
+        indexes[i].pprev = i > 0 ? &indexes[i - 1] : NULL;
+    }
+
+    CIndexWriter writer(pblocktree);
+    for (int i = 0; i < 3; i++)
+        BOOST_CHECK(writer.Connect(blocks[i], CBlockUndo(), &indexes[i]));
+    BOOST_CHECK(writer.Flush());
+
+    CAddressBalanceValue balance;
+    BOOST_CHECK(pblocktree->ReadAddressBalance(1, addr, balance));
+    BOOST_CHECK_EQUAL(balance.balance, 6000);
+    BOOST_CHECK_EQUAL(balance.txCount, 3);
+    BOOST_CHECK_EQUAL(balance.lastHeight, 22);
+
+    // Rolling back a block finds the previous height the address was used at
+    BOOST_CHECK(writer.Disconnect(blocks[2], CBlockUndo(), &indexes[2]));
+    BOOST_CHECK(writer.Flush());
+    BOOST_CHECK(pblocktree->ReadAddressBalance(1, addr, balance));
+    BOOST_CHECK_EQUAL(balance.balance, 3000);
+    BOOST_CHECK_EQUAL(balance.received, 3000);
+    BOOST_CHECK_EQUAL(balance.txCount, 2);
+    BOOST_CHECK_EQUAL(balance.lastHeight, 21);
+
+    // Rebuilding from the address index gives the same result
+    CAddressBalanceValue rebuilt;
+    BOOST_CHECK(pblocktree->BuildAddressBalanceIndex());
+    BOOST_CHECK(pblocktree->ReadAddressBalance(1, addr, rebuilt));
+    BOOST_CHECK_EQUAL(rebuilt.balance, balance.balance);
+    BOOST_CHECK_EQUAL(rebuilt.received, balance.received);
+    BOOST_CHECK_EQUAL(rebuilt.txCount, balance.txCount);
+    BOOST_CHECK_EQUAL(rebuilt.lastHeight, balance.lastHeight);
+}
+
+BOOST_AUTO_TEST_CASE(indexwriter_replay_unknown_block)
+{
+    fAddressIndex = true;
+    pIndexWriter = new CIndexWriter(pblocktree);
+
+    // Indexes written past a block we don't know can't be rolled back
+    BOOST_CHECK(pblocktree->WriteIndexedBlock(GetRandHash()));
+    BOOST_CHECK(!ReplayIndexUpdates(Params()));
+
+    BOOST_CHECK(pblocktree->WriteIndexedBlock(chainActive.Tip()->GetBlockHash()));
+    BOOST_CHECK(ReplayIndexUpdates(Params()));
+}
+
+BOOST_AUTO_TEST_CASE(indexwriter_last_address_height)
+{
+    // The compact address index is the last table in the database, nothing
+    // comes after the entries of the greatest address
+    uint160 addr = uint160(std::vector<unsigned char>(20, 0xff));
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vEntries;
+    vEntries.push_back(std::make_pair(CAddressIndexKey(255, addr, 40, 1, GetRandHash(), 0, false), 100));
+    vEntries.push_back(std::make_pair(CAddressIndexKey(255, addr, 41, 1, GetRandHash(), 0, false), 200));
+    BOOST_CHECK(pblocktree->WriteAddressIndex(vEntries));
+
+    BOOST_CHECK_EQUAL(pblocktree->ReadAddressLastHeight(255, addr, 42), 41);
+    BOOST_CHECK_EQUAL(pblocktree->ReadAddressLastHeight(255, addr, 41), 40);
+    BOOST_CHECK_EQUAL(pblocktree->ReadAddressLastHeight(255, addr, 40), 0);
+}
+
+BOOST_AUTO_TEST_CASE(indexwriter_address_index_migration)
+{
+    uint160 addr = uint160(std::vector<unsigned char>(20, 4));
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vExpected;
+    for (int i = 0; i < 5; i++) {
+        uint256 txhash = GetRandHash();
+        vExpected.push_back(std::make_pair(CAddressIndexKey(1, addr, 30 + i, 1, txhash, 0, true), -100 * i));
+        vExpected.push_back(std::make_pair(CAddressIndexKey(1, addr, 30 + i, 1, txhash, 300, false), 1000 + i));
+    }
+
+    // Entries written in the old format
+    CDBBatch batch(*pblocktree);
+    for (size_t i = 0; i < vExpected.size(); i++)
+        batch.Write(std::make_pair('a', vExpected[i].first), vExpected[i].second);
+    BOOST_CHECK(pblocktree->WriteBatch(batch));
+
+    // Half way through the migration both formats are read together
+    bool fDone = true;
+    BOOST_CHECK(pblocktree->MigrateAddressIndex(3, fDone));
+    BOOST_CHECK(!fDone);
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vAddressIndex;
+    BOOST_CHECK(pblocktree->ReadAddressIndex(addr, 1, vAddressIndex));
+    BOOST_CHECK_EQUAL(vAddressIndex.size(), vExpected.size());
+    for (size_t i = 0; i < vAddressIndex.size() && i < vExpected.size(); i++) {
+        BOOST_CHECK(vAddressIndex[i].first.txhash == vExpected[i].first.txhash);
+        BOOST_CHECK_EQUAL(vAddressIndex[i].first.index, vExpected[i].first.index);
+        BOOST_CHECK_EQUAL(vAddressIndex[i].second, vExpected[i].second);
+    }
+    BOOST_CHECK_EQUAL(pblocktree->ReadAddressLastHeight(1, addr, 34), 33);
+
+    CAddressBalanceValue balance;
+    BOOST_CHECK(pblocktree->BuildAddressBalanceIndex());
+    BOOST_CHECK(pblocktree->ReadAddressBalance(1, addr, balance));
+    BOOST_CHECK_EQUAL(balance.txCount, 5);
+    BOOST_CHECK_EQUAL(balance.received, 5010);
+    BOOST_CHECK_EQUAL(balance.balance, 5010 - 1000);
+    BOOST_CHECK_EQUAL(balance.lastHeight, 34);
+
+    while (!fDone)
+        BOOST_CHECK(pblocktree->MigrateAddressIndex(3, fDone));
+    vAddressIndex.clear();
+    BOOST_CHECK(pblocktree->ReadAddressIndex(addr, 1, vAddressIndex, 31, 32));
+    BOOST_CHECK_EQUAL(vAddressIndex.size(), 4);
+    for (size_t i = 0; i < vAddressIndex.size() && i < 4; i++) {
+        BOOST_CHECK(vAddressIndex[i].first.txhash == vExpected[i + 2].first.txhash);
+        BOOST_CHECK_EQUAL(vAddressIndex[i].second, vExpected[i + 2].second);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -6,6 +6,8 @@
 #include "chainparams.h"
 #include "validation.h"
 #include "net.h"
+#include "hash.h"
+#include "random.h"
 
 #include "test/test_dash.h"
 
@@ -79,4 +81,26 @@ BOOST_AUTO_TEST_CASE(test_combiner_all)
     Test.disconnect(&ReturnTrue);
     BOOST_CHECK(Test());
 }
+
+BOOST_AUTO_TEST_CASE(header_batch_hash)
+{
+    // Enough headers to be split between the header hashing threads, and a
+    // batch too small for them
+    std::vector<CBlockHeader> vHeaders(1000);
+    for (size_t i = 0; i < vHeaders.size(); i++) {
+        vHeaders[i].nVersion = 3;
+        vHeaders[i].hashPrevBlock = GetRandHash();
+        vHeaders[i].nTime = insecure_rand();
+        vHeaders[i].nNonce = insecure_rand();
+    }
+    std::vector<CBlockHeader> vHeadersSmall(vHeaders.begin(), vHeaders.begin() + MIN_PARALLEL_HEADER_HASHES - 1);
+
+    HashBlockHeaders(vHeaders);
+    HashBlockHeaders(vHeadersSmall);
+    for (size_t i = 0; i < vHeaders.size(); i++)
+        BOOST_CHECK(vHeaders[i].GetHash() == HashX11(BEGIN(vHeaders[i].nVersion), END(vHeaders[i].nNonce)));
+    for (size_t i = 0; i < vHeadersSmall.size(); i++)
+        BOOST_CHECK(vHeadersSmall[i].GetHash() == vHeaders[i].GetHash());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,102 @@
+// Copyright (c) 2014-2017 The Dune Spice developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "masternode.h"
+#include "masternode-sigqueue.h"
+#include "protocol.h"
+#include "utiltime.h"
+
+#include "test/test_dash.h"
+
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+typedef CMasternodeSigQueue::message_t message_t;
+
+static CDataStream PingMessage(int64_t nTime)
+{
+    CMasternodePing mnp;
+    mnp.sigTime = nTime;
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << mnp;
+    return ss;
+}
+
+static void WaitVerified(CMasternodeSigQueue& queue, NodeId nodeid, size_t nCount, std::vector<message_t>& vMessagesRet)
+{
+    for (int i = 0; i < 1000 && vMessagesRet.size() < nCount; i++) {
+        std::vector<message_t> vMessages;
+        queue.PopVerified(nodeid, vMessages);
+        for (auto& message : vMessages)
+            vMessagesRet.push_back(std::move(message));
+        if (vMessagesRet.size() < nCount)
+            MilliSleep(10);
+    }
+}
+
+BOOST_FIXTURE_TEST_SUITE(masternode_sigqueue_tests, TestingSetup)
+
+BOOST_AUTO_TEST_CASE(sigqueue_peer_order)
+{
+    CMasternodeSigQueue queue;
+    BOOST_CHECK(!queue.Push(1, NetMsgType::MNPING, PingMessage(1)));
+    BOOST_CHECK(!queue.ShouldDelay(1, NetMsgType::TX));
+
+    queue.Enable();
+    BOOST_CHECK(!queue.Push(1, NetMsgType::TX, CDataStream(SER_NETWORK, PROTOCOL_VERSION)));
+    for (int i = 0; i < 10; i++)
+        BOOST_CHECK(queue.Push(1, NetMsgType::MNPING, PingMessage(i)));
+    BOOST_CHECK(queue.Push(2, NetMsgType::MNPING, PingMessage(100)));
+
+    // The peer's other messages wait behind the ones held, further masternode
+    // messages join them, other peers aren't affected
+    BOOST_CHECK(queue.ShouldDelay(1, NetMsgType::TX));
+    BOOST_CHECK(!queue.ShouldDelay(1, NetMsgType::MNPING));
+    BOOST_CHECK(!queue.ShouldDelay(3, NetMsgType::TX));
+
+    // The messages of a disconnected peer are dropped
+    queue.RemovePeer(2);
+    BOOST_CHECK(!queue.ShouldDelay(2, NetMsgType::TX));
+
+    boost::thread thread(boost::bind(&CMasternodeSigQueue::Thread, &queue, boost::ref(*connman)));
+
+    // They come back in the order they were received
+    std::vector<message_t> vMessages;
+    WaitVerified(queue, 1, 10, vMessages);
+    BOOST_CHECK_EQUAL(vMessages.size(), 10);
+    for (size_t i = 0; i < vMessages.size(); i++) {
+        BOOST_CHECK_EQUAL(vMessages[i].first, NetMsgType::MNPING);
+        CMasternodePing mnp;
+        vMessages[i].second >> mnp;
+        BOOST_CHECK_EQUAL(mnp.sigTime, (int64_t)i);
+    }
+    BOOST_CHECK(!queue.ShouldDelay(1, NetMsgType::TX));
+
+    std::vector<message_t> vRemoved;
+    queue.PopVerified(2, vRemoved);
+    BOOST_CHECK(vRemoved.empty());
+
+    thread.interrupt();
+    thread.join();
+}
+
+BOOST_AUTO_TEST_CASE(sigqueue_full)
+{
+    CMasternodeSigQueue queue;
+    queue.Enable();
+    CDataStream ssPing = PingMessage(1);
+    for (size_t i = 0; i < CMasternodeSigQueue::MAX_PENDING_MESSAGES; i++)
+        queue.Push(1, NetMsgType::MNPING, ssPing);
+
+    // A full queue holds back the masternode messages of every peer rather
+    // than having them processed on the message handler thread
+    BOOST_CHECK(queue.ShouldDelay(2, NetMsgType::MNPING));
+    BOOST_CHECK(queue.ShouldDelay(2, NetMsgType::MNANNOUNCE));
+    BOOST_CHECK(!queue.ShouldDelay(2, NetMsgType::TX));
+
+    queue.RemovePeer(1);
+    BOOST_CHECK(!queue.ShouldDelay(2, NetMsgType::MNPING));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
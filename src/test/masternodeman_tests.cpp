@@ -0,0 +1,69 @@
+// Copyright (c) 2014-2017 The Dune Spice developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "masternode-sync.h"
+#include "masternodeman.h"
+
+#include "test/test_dash.h"
+
+#include <boost/test/unit_test.hpp>
+
+static COutPoint AddMasternode(int n, int nProtocolVersion)
+{
+    COutPoint outpoint(ArithToUint256(arith_uint256(n + 1)), 0);
+    CMasternode mn(CService(), outpoint, CPubKey(), CPubKey(), nProtocolVersion);
+    BOOST_CHECK(mnodeman.Add(mn));
+    return outpoint;
+}
+
+static void CheckRanks(int nMinProtocol, size_t nExpected)
+{
+    CMasternodeMan::rank_pair_vec_t vecRanks;
+    BOOST_CHECK(mnodeman.GetMasternodeRanks(vecRanks, 0, nMinProtocol));
+    BOOST_CHECK_EQUAL(vecRanks.size(), nExpected);
+    for (const auto& rankPair : vecRanks) {
+        int nRank = -1;
+        BOOST_CHECK(mnodeman.GetMasternodeRank(rankPair.second.vin.prevout, nRank, 0, nMinProtocol));
+        BOOST_CHECK_EQUAL(nRank, rankPair.first);
+    }
+}
+
+BOOST_FIXTURE_TEST_SUITE(masternodeman_tests, TestingSetup)
+
+BOOST_AUTO_TEST_CASE(masternode_rank_cache)
+{
+    masternodeSync.Reset();
+    while (!masternodeSync.IsMasternodeListSynced())
+        masternodeSync.SwitchToNextAsset(*connman);
+
+    for (int i = 0; i < 3; i++)
+        AddMasternode(i, PROTOCOL_VERSION);
+    CheckRanks(0, 3);
+
+    // Ranks cached before a masternode is added don't hide it
+    AddMasternode(3, PROTOCOL_VERSION);
+    CheckRanks(0, 4);
+    COutPoint outpointOld = AddMasternode(4, PROTOCOL_VERSION - 1);
+    CheckRanks(0, 5);
+    CheckRanks(PROTOCOL_VERSION, 4);
+    int nRank = -1;
+    BOOST_CHECK(!mnodeman.GetMasternodeRank(outpointOld, nRank, 0, PROTOCOL_VERSION));
+
+    // More blocks ranked than the cache holds, the earlier ones are recalculated
+    for (int i = 0; i < 40; i++)
+        CheckRanks(i, 5);
+    CheckRanks(0, 5);
+    CheckRanks(PROTOCOL_VERSION, 4);
+
+    // Nor does clearing the list leave any ranks behind
+    mnodeman.Clear();
+    CMasternodeMan::rank_pair_vec_t vecRanks;
+    BOOST_CHECK(!mnodeman.GetMasternodeRanks(vecRanks, 0));
+    BOOST_CHECK(vecRanks.empty());
+    BOOST_CHECK(!mnodeman.GetMasternodeRank(outpointOld, nRank, 0));
+
+    masternodeSync.Reset();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -318,6 +318,185 @@ BOOST_AUTO_TEST_CASE(MempoolIndexingTest)
 }
 
 
+BOOST_AUTO_TEST_CASE(MempoolAncestorIndexingTest)
+{
+    CTxMemPool pool(CFeeRate(0));
+    TestMemPoolEntryHelper entry;
+    entry.hadNoDependencies = true;
+
+    /* 3rd highest fee */
+    CMutableTransaction tx1 = CMutableTransaction();
+    tx1.vout.resize(1);
+    tx1.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    tx1.vout[0].nValue = 10 * COIN;
+    pool.addUnchecked(tx1.GetHash(), entry.Fee(10000LL).Priority(10.0).FromTx(tx1));
+
+    /* highest fee */
+    CMutableTransaction tx2 = CMutableTransaction();
+    tx2.vout.resize(1);
+    tx2.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    tx2.vout[0].nValue = 2 * COIN;
+    pool.addUnchecked(tx2.GetHash(), entry.Fee(20000LL).Priority(9.0).FromTx(tx2));
+    uint64_t tx2Size = ::GetSerializeSize(tx2, SER_NETWORK, PROTOCOL_VERSION);
+
+    /* lowest fee */
+    CMutableTransaction tx3 = CMutableTransaction();
+    tx3.vout.resize(1);
+    tx3.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    tx3.vout[0].nValue = 5 * COIN;
+    pool.addUnchecked(tx3.GetHash(), entry.Fee(0LL).Priority(100.0).FromTx(tx3));
+
+    /* 2nd highest fee */
+    CMutableTransaction tx4 = CMutableTransaction();
+    tx4.vout.resize(1);
+    tx4.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    tx4.vout[0].nValue = 6 * COIN;
+    pool.addUnchecked(tx4.GetHash(), entry.Fee(15000LL).Priority(1.0).FromTx(tx4));
+
+    /* equal fee rate to tx1, but newer */
+    CMutableTransaction tx5 = CMutableTransaction();
+    tx5.vout.resize(1);
+    tx5.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    tx5.vout[0].nValue = 11 * COIN;
+    pool.addUnchecked(tx5.GetHash(), entry.Fee(10000LL).FromTx(tx5));
+    BOOST_CHECK_EQUAL(pool.size(), 5);
+
+    std::vector<std::string> sortedOrder;
+    sortedOrder.resize(5);
+    sortedOrder[0] = tx2.GetHash().ToString(); // 20000
+    sortedOrder[1] = tx4.GetHash().ToString(); // 15000
+    // tx1 and tx5 are both 10000
+    // Ties are broken by hash, not timestamp, so determine which
+    // hash comes first.
+    if (tx1.GetHash() < tx5.GetHash()) {
+        sortedOrder[2] = tx1.GetHash().ToString();
+        sortedOrder[3] = tx5.GetHash().ToString();
+    } else {
+        sortedOrder[2] = tx5.GetHash().ToString();
+        sortedOrder[3] = tx1.GetHash().ToString();
+    }
+    sortedOrder[4] = tx3.GetHash().ToString(); // 0
+
+    CheckSort<4>(pool, sortedOrder);
+
+    /* low fee parent with high fee child */
+    /* tx6 (0) -> tx7 (high) */
+    CMutableTransaction tx6 = CMutableTransaction();
+    tx6.vout.resize(1);
+    tx6.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    tx6.vout[0].nValue = 20 * COIN;
+    uint64_t tx6Size = ::GetSerializeSize(tx6, SER_NETWORK, PROTOCOL_VERSION);
+
+    pool.addUnchecked(tx6.GetHash(), entry.Fee(0LL).FromTx(tx6));
+    BOOST_CHECK_EQUAL(pool.size(), 6);
+    // Ties are broken by hash
+    if (tx3.GetHash() < tx6.GetHash())
+        sortedOrder.push_back(tx6.GetHash().ToString());
+    else
+        sortedOrder.insert(sortedOrder.end()-1,tx6.GetHash().ToString());
+
+    CheckSort<4>(pool, sortedOrder);
+
+    CMutableTransaction tx7 = CMutableTransaction();
+    tx7.vin.resize(1);
+    tx7.vin[0].prevout = COutPoint(tx6.GetHash(), 0);
+    tx7.vin[0].scriptSig = CScript() << OP_11;
+    tx7.vout.resize(1);
+    tx7.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    tx7.vout[0].nValue = 10 * COIN;
+    uint64_t tx7Size = ::GetSerializeSize(tx7, SER_NETWORK, PROTOCOL_VERSION);
+
+    /* set the fee to just below tx2's feerate when including ancestor */
+    CAmount fee = (20000/tx2Size)*(tx7Size + tx6Size) - 1;
+
+    pool.addUnchecked(tx7.GetHash(), entry.Fee(fee).FromTx(tx7));
+    BOOST_CHECK_EQUAL(pool.size(), 7);
+    sortedOrder.insert(sortedOrder.begin()+1, tx7.GetHash().ToString());
+    CheckSort<4>(pool, sortedOrder);
+
+    /* after tx6 is mined, tx7 should move up in the sort */
+    std::vector<CTransactionRef> vtx;
+    vtx.push_back(MakeTransactionRef(tx6));
+    std::list<CTransaction> conflicts;
+    pool.removeForBlock(vtx, 1, conflicts);
+
+    sortedOrder.erase(sortedOrder.begin()+1);
+    // Ties are broken by hash
+    if (tx3.GetHash() < tx6.GetHash())
+        sortedOrder.pop_back();
+    else
+        sortedOrder.erase(sortedOrder.end()-2);
+    sortedOrder.insert(sortedOrder.begin(), tx7.GetHash().ToString());
+    CheckSort<4>(pool, sortedOrder);
+}
+
+BOOST_AUTO_TEST_CASE(MempoolReorgAncestorStateTest)
+{
+    CTxMemPool pool(CFeeRate(0));
+    TestMemPoolEntryHelper entry;
+
+    // A transaction from a disconnected block with more in-mempool
+    // descendants than used to be walked when it was re-added
+    const unsigned int nChildren = 101;
+    CMutableTransaction txParent;
+    txParent.vout.resize(nChildren);
+    for (unsigned int i = 0; i < nChildren; i++) {
+        txParent.vout[i].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        txParent.vout[i].nValue = COIN;
+    }
+
+    std::vector<CMutableTransaction> vChildren(nChildren);
+    for (unsigned int i = 0; i < nChildren; i++) {
+        vChildren[i].vin.resize(1);
+        vChildren[i].vin[0].prevout = COutPoint(txParent.GetHash(), i);
+        vChildren[i].vin[0].scriptSig = CScript() << OP_11;
+        vChildren[i].vout.resize(1);
+        vChildren[i].vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        vChildren[i].vout[0].nValue = COIN - 1000;
+        pool.addUnchecked(vChildren[i].GetHash(), entry.Fee(1000LL).FromTx(vChildren[i]));
+    }
+
+    CMutableTransaction txGrandChild;
+    txGrandChild.vin.resize(1);
+    txGrandChild.vin[0].prevout = COutPoint(vChildren[0].GetHash(), 0);
+    txGrandChild.vin[0].scriptSig = CScript() << OP_11;
+    txGrandChild.vout.resize(1);
+    txGrandChild.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txGrandChild.vout[0].nValue = COIN - 2000;
+    pool.addUnchecked(txGrandChild.GetHash(), entry.Fee(1000LL).FromTx(txGrandChild));
+
+    // Re-add the parent the way a disconnected block's transactions are
+    pool.addUnchecked(txParent.GetHash(), entry.Fee(0LL).FromTx(txParent));
+    std::vector<uint256> vHashUpdate;
+    vHashUpdate.push_back(txParent.GetHash());
+    pool.UpdateTransactionsFromBlock(vHashUpdate);
+
+    CTxMemPool::txiter itParent = pool.mapTx.find(txParent.GetHash());
+    BOOST_CHECK_EQUAL(itParent->GetCountWithDescendants(), nChildren + 2);
+    BOOST_CHECK_EQUAL(itParent->GetModFeesWithDescendants(), 1000LL * (nChildren + 1));
+    for (unsigned int i = 0; i < nChildren; i++) {
+        CTxMemPool::txiter it = pool.mapTx.find(vChildren[i].GetHash());
+        BOOST_CHECK_EQUAL(it->GetCountWithAncestors(), 2);
+        BOOST_CHECK_EQUAL(it->GetSizeWithAncestors(), it->GetTxSize() + itParent->GetTxSize());
+    }
+    BOOST_CHECK_EQUAL(pool.mapTx.find(txGrandChild.GetHash())->GetCountWithAncestors(), 3);
+
+    // Mining the parent again takes it out of every descendant's ancestor
+    // state
+    std::vector<CTransactionRef> vtx;
+    vtx.push_back(MakeTransactionRef(txParent));
+    std::list<CTransaction> conflicts;
+    pool.removeForBlock(vtx, 1, conflicts);
+    BOOST_CHECK_EQUAL(pool.size(), nChildren + 1);
+    for (unsigned int i = 0; i < nChildren; i++) {
+        CTxMemPool::txiter it = pool.mapTx.find(vChildren[i].GetHash());
+        BOOST_CHECK_EQUAL(it->GetCountWithAncestors(), 1);
+        BOOST_CHECK_EQUAL(it->GetSizeWithAncestors(), it->GetTxSize());
+        BOOST_CHECK_EQUAL(it->GetModFeesWithAncestors(), 1000LL);
+    }
+    BOOST_CHECK_EQUAL(pool.mapTx.find(txGrandChild.GetHash())->GetCountWithAncestors(), 2);
+}
+
 BOOST_AUTO_TEST_CASE(MempoolSizeLimitTest)
 {
     CTxMemPool pool(CFeeRate(1000));
@@ -443,7 +622,7 @@ BOOST_AUTO_TEST_CASE(MempoolSizeLimitTest)
     pool.addUnchecked(tx5.GetHash(), entry.Fee(1000LL).FromTx(tx5, &pool));
     pool.addUnchecked(tx7.GetHash(), entry.Fee(9000LL).FromTx(tx7, &pool));
 
-    std::vector<CTransaction> vtx;
+    std::vector<CTransactionRef> vtx;
     std::list<CTransaction> conflicts;
     SetMockTime(42);
     SetMockTime(42 + CTxMemPool::ROLLING_FEE_HALFLIFE);
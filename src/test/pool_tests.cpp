@@ -0,0 +1,111 @@
+// Copyright (c) 2014-2017 The Dune Spice developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "memusage.h"
+#include "support/allocators/pool.h"
+
+#include "test/test_dash.h"
+
+#include <unordered_map>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(pool_tests, BasicTestingSetup)
+
+typedef PoolResource<64, 8> testPool;
+
+BOOST_AUTO_TEST_CASE(pool_reuses_blocks)
+{
+    testPool pool(1024);
+    BOOST_CHECK_EQUAL(pool.ChunkSizeBytes(), 1024);
+    BOOST_CHECK_EQUAL(pool.NumAllocatedChunks(), 0);
+
+    // Blocks of the same size are carved from one chunk, and a freed
+    // block is handed out again
+    void* p1 = pool.Allocate(24, 8);
+    void* p2 = pool.Allocate(20, 4);
+    BOOST_CHECK_EQUAL(pool.NumAllocatedChunks(), 1);
+    BOOST_CHECK_EQUAL(static_cast<char*>(p2) - static_cast<char*>(p1), 24);
+    BOOST_CHECK_EQUAL(pool.BytesInUse(), 48);
+    pool.Deallocate(p1, 24, 8);
+    BOOST_CHECK_EQUAL(pool.BytesInUse(), 24);
+    BOOST_CHECK(pool.Allocate(17, 8) == p1);
+
+    // A freed block isn't used for allocations of another size
+    pool.Deallocate(p2, 20, 4);
+    void* p3 = pool.Allocate(8, 8);
+    BOOST_CHECK(p3 != p2);
+    BOOST_CHECK(pool.Allocate(24, 8) == p2);
+
+    // Blocks larger than the pool's and over-aligned ones don't come from it
+    void* pLarge = pool.Allocate(65, 8);
+    void* pAligned = pool.Allocate(8, 16);
+    BOOST_CHECK_EQUAL(pool.NumAllocatedChunks(), 1);
+    BOOST_CHECK_EQUAL(pool.BytesInUse(), 56);
+    pool.Deallocate(pLarge, 65, 8);
+    pool.Deallocate(pAligned, 8, 16);
+
+    // Filling the chunk allocates another one, the rest of the first one
+    // goes to the free list of its size
+    for (int i = 0; i < 16; i++)
+        pool.Allocate(64, 8);
+    BOOST_CHECK_EQUAL(pool.NumAllocatedChunks(), 2);
+}
+
+BOOST_AUTO_TEST_CASE(pool_unordered_map)
+{
+    typedef std::unordered_map<int, int, std::hash<int>, std::equal_to<int>, PoolAllocator<std::pair<const int, int>, 64, 8> > testMap;
+    testPool pool(1024);
+    testMap mapTest(0, testMap::hasher(), testMap::key_equal(), testMap::allocator_type(&pool));
+
+    for (int i = 0; i < 1000; i++)
+        mapTest[i] = i * 2;
+    for (int i = 0; i < 1000; i += 2)
+        mapTest.erase(i);
+    BOOST_CHECK_EQUAL(mapTest.size(), 500);
+    BOOST_CHECK_EQUAL(mapTest[501], 1002);
+    BOOST_CHECK_EQUAL(mapTest.count(500), 0);
+
+    // The erased nodes are reused, the map doesn't need more chunks
+    size_t nChunks = pool.NumAllocatedChunks();
+    for (int i = 0; i < 1000; i += 2)
+        mapTest[i] = i;
+    BOOST_CHECK_EQUAL(pool.NumAllocatedChunks(), nChunks);
+
+    mapTest.clear();
+    for (int i = 0; i < 1000; i++)
+        mapTest[i] = i;
+    BOOST_CHECK_EQUAL(pool.NumAllocatedChunks(), nChunks);
+}
+
+BOOST_AUTO_TEST_CASE(pool_unordered_map_usage)
+{
+    typedef std::unordered_map<int, int, std::hash<int>, std::equal_to<int>, PoolAllocator<std::pair<const int, int>, 64, 8> > testMap;
+    testPool pool(1024);
+    testMap mapTest(0, testMap::hasher(), testMap::key_equal(), testMap::allocator_type(&pool));
+
+    for (int i = 0; i < 1000; i++)
+        mapTest[i] = i;
+    size_t nUsageFull = memusage::DynamicUsage(mapTest);
+    BOOST_CHECK(nUsageFull >= 1000 * sizeof(std::pair<const int, int>));
+
+    // The usage reported falls as entries are removed, although the pool
+    // keeps its chunks
+    size_t nChunks = pool.NumAllocatedChunks();
+    for (int i = 0; i < 1000; i += 2)
+        mapTest.erase(i);
+    size_t nUsageHalf = memusage::DynamicUsage(mapTest);
+    BOOST_CHECK(nUsageHalf < nUsageFull);
+    BOOST_CHECK_EQUAL(pool.NumAllocatedChunks(), nChunks);
+
+    mapTest.clear();
+    BOOST_CHECK(memusage::DynamicUsage(mapTest) < nUsageHalf);
+
+    // Filling it again brings it back where it was
+    for (int i = 0; i < 1000; i++)
+        mapTest[i] = i;
+    BOOST_CHECK_EQUAL(memusage::DynamicUsage(mapTest), nUsageFull);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -64,4 +64,56 @@ BOOST_AUTO_TEST_CASE(streams_serializedata_xor)
             std::string(ds.begin(), ds.end()));  
 }         
 
+BOOST_AUTO_TEST_CASE(streams_getandclear)
+{
+    CDataStream ds(SER_NETWORK, PROTOCOL_VERSION);
+    ds << (uint8_t)1 << (uint8_t)2 << (uint8_t)3;
+
+    // hands over the buffer to an empty target
+    CSerializeData data;
+    ds.GetAndClear(data);
+    BOOST_CHECK(ds.empty());
+    BOOST_CHECK_EQUAL(data.size(), 3);
+    BOOST_CHECK_EQUAL(data[2], 3);
+
+    // appends to a non-empty target
+    ds << (uint8_t)4;
+    ds.GetAndClear(data);
+    BOOST_CHECK(ds.empty());
+    BOOST_CHECK_EQUAL(data.size(), 4);
+    BOOST_CHECK_EQUAL(data[3], 4);
+
+    // skips what was already read
+    CSerializeData data2;
+    ds << (uint8_t)5 << (uint8_t)6;
+    uint8_t n;
+    ds >> n;
+    ds.GetAndClear(data2);
+    BOOST_CHECK(ds.empty());
+    BOOST_CHECK_EQUAL(data2.size(), 1);
+    BOOST_CHECK_EQUAL(data2[0], 6);
+}
+
+BOOST_AUTO_TEST_CASE(streams_memoryreader)
+{
+    CDataStream ds(SER_DISK, PROTOCOL_VERSION);
+    ds << (uint32_t)0x01020304 << std::string("spice");
+    std::vector<char> vch(ds.begin(), ds.end());
+
+    CMemoryReader reader(&vch[0], &vch[0] + vch.size(), SER_DISK, PROTOCOL_VERSION);
+    uint32_t n;
+    std::string str;
+    reader >> n >> str;
+    BOOST_CHECK_EQUAL(n, 0x01020304);
+    BOOST_CHECK_EQUAL(str, "spice");
+    BOOST_CHECK(reader.empty());
+
+    // reading past the end throws instead of touching memory it doesn't own
+    CMemoryReader reader2(&vch[0], &vch[0] + 2, SER_DISK, PROTOCOL_VERSION);
+    BOOST_CHECK_THROW(reader2 >> n, std::ios_base::failure);
+    reader2.ignore(1);
+    BOOST_CHECK_EQUAL(reader2.size(), 1);
+    BOOST_CHECK_THROW(reader2.ignore(2), std::ios_base::failure);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -83,4 +83,58 @@ BOOST_FIXTURE_TEST_CASE(tx_mempool_block_doublespend, TestChain100Setup)
     BOOST_CHECK_EQUAL(mempool.size(), 0);
 }
 
+BOOST_FIXTURE_TEST_CASE(checkinputs_script_execution_cache, TestChain100Setup)
+{
+    // Scripts that were fully executed with cacheFullScriptStore set must
+    // not be run again for the same transaction and flags, but must be for
+    // any other flags.
+    LOCK(cs_main);
+
+    CScript scriptPubKey = CScript() <<  ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+
+    CMutableTransaction spend;
+    spend.vin.resize(1);
+    spend.vin[0].prevout.hash = coinbaseTxns[0].GetHash();
+    spend.vin[0].prevout.n = 0;
+    spend.vout.resize(1);
+    spend.vout[0].nValue = 11*CENT;
+    spend.vout[0].scriptPubKey = scriptPubKey;
+
+    std::vector<unsigned char> vchSig;
+    uint256 hash = SignatureHash(scriptPubKey, spend, 0, SIGHASH_ALL);
+    BOOST_CHECK(coinbaseKey.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    spend.vin[0].scriptSig << vchSig;
+
+    CTransaction tx(spend);
+    CCoinsViewCache coins(pcoinsTip);
+    CValidationState state;
+    std::vector<CScriptCheck> scriptchecks;
+
+    // Nothing cached yet: the script check is handed back to the caller
+    BOOST_CHECK(CheckInputs(tx, state, coins, true, SCRIPT_VERIFY_P2SH, true, true, &scriptchecks));
+    BOOST_CHECK_EQUAL(scriptchecks.size(), 1);
+    scriptchecks.clear();
+
+    // Checking inline stores the result...
+    BOOST_CHECK(CheckInputs(tx, state, coins, true, SCRIPT_VERIFY_P2SH, true, true, NULL));
+
+    // ...so the same flags no longer need any script check
+    BOOST_CHECK(CheckInputs(tx, state, coins, true, SCRIPT_VERIFY_P2SH, true, true, &scriptchecks));
+    BOOST_CHECK_EQUAL(scriptchecks.size(), 0);
+
+    // Different flags are a separate cache entry
+    BOOST_CHECK(CheckInputs(tx, state, coins, true, SCRIPT_VERIFY_P2SH | SCRIPT_VERIFY_DERSIG, true, true, &scriptchecks));
+    BOOST_CHECK_EQUAL(scriptchecks.size(), 1);
+    scriptchecks.clear();
+
+    // A transaction that fails its scripts is never cached
+    CMutableTransaction badSpend(spend);
+    badSpend.vout[0].nValue = 10*CENT;
+    CTransaction badTx(badSpend);
+    BOOST_CHECK(!CheckInputs(badTx, state, coins, true, SCRIPT_VERIFY_P2SH, true, true, NULL));
+    BOOST_CHECK(CheckInputs(badTx, state, coins, true, SCRIPT_VERIFY_P2SH, true, true, &scriptchecks));
+    BOOST_CHECK_EQUAL(scriptchecks.size(), 1);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
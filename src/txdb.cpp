@@ -13,6 +13,9 @@
 #include "init.h"
 
 #include <stdint.h>
+#include <algorithm>
+#include <limits>
+#include <set>
 
 #include <boost/thread.hpp>
 
@@ -24,6 +27,9 @@ static const char DB_BLOCK_FILES = 'f';
 static const char DB_TXINDEX = 't';
 static const char DB_ADDRESSINDEX = 'a';
 static const char DB_ADDRESSUNSPENTINDEX = 'u';
+static const char DB_ADDRESSBALANCEINDEX = 'A';
+static const char DB_ADDRESSINDEX_COMPACT = 'x';
+static const char DB_ADDRESSINDEX_TXID = 'h';
 static const char DB_TIMESTAMPINDEX = 's';
 static const char DB_SPENTINDEX = 'p';
 static const char DB_BLOCK_INDEX = 'b';
@@ -32,6 +38,7 @@ static const char DB_BEST_BLOCK = 'B';
 static const char DB_FLAG = 'F';
 static const char DB_REINDEX_FLAG = 'R';
 static const char DB_LAST_BLOCK = 'l';
+static const char DB_INDEXED_BLOCK = 'I';
 
 namespace {
 
@@ -55,9 +62,144 @@ struct CoinEntry {
     }
 };
 
+// Unsigned integers as a length byte followed by the significant bytes big
+// endian: small values take one or two bytes and keys still sort numerically
+template<typename Stream>
+void WriteOrderedInt(Stream& s, uint32_t n)
+{
+    unsigned char nBytes = 0;
+    while (nBytes < 4 && (n >> (8 * nBytes)) != 0)
+        nBytes++;
+    ser_writedata8(s, nBytes);
+    for (int i = nBytes - 1; i >= 0; i--)
+        ser_writedata8(s, (n >> (8 * i)) & 0xff);
+}
+
+template<typename Stream>
+uint32_t ReadOrderedInt(Stream& s)
+{
+    unsigned char nBytes = ser_readdata8(s);
+    if (nBytes > 4)
+        throw std::ios_base::failure("non-canonical ordered integer");
+    uint32_t n = 0;
+    for (unsigned char i = 0; i < nBytes; i++)
+        n = (n << 8) | ser_readdata8(s);
+    return n;
+}
+
+/**
+ * Address index entry in the compact (version 2) format. Entries sort like
+ * version 1 ones but leave out the txid, which is stored once per
+ * transaction as a TxidEntry, and use short encodings for the positions.
+ */
+struct CompactAddressIndexEntry {
+    CAddressIndexKey* key;
+    char prefix;
+    CompactAddressIndexEntry(const CAddressIndexKey* ptr) : key(const_cast<CAddressIndexKey*>(ptr)), prefix(DB_ADDRESSINDEX_COMPACT) {}
+
+    template<typename Stream>
+    void Serialize(Stream &s, int nType, int nVersion) const {
+        s << prefix;
+        ser_writedata8(s, key->type);
+        key->hashBytes.Serialize(s, nType, nVersion);
+        ser_writedata32be(s, key->blockHeight);
+        WriteOrderedInt(s, key->txindex);
+        WriteOrderedInt(s, key->index);
+        ser_writedata8(s, key->spending);
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion) {
+        s >> prefix;
+        key->type = ser_readdata8(s);
+        key->hashBytes.Unserialize(s, nType, nVersion);
+        key->blockHeight = ser_readdata32be(s);
+        key->txindex = ReadOrderedInt(s);
+        key->index = ReadOrderedInt(s);
+        key->spending = ser_readdata8(s);
+    }
+};
+
+/** The txid of the transaction at a position in the active chain */
+struct TxidEntry {
+    char prefix;
+    int nHeight;
+    unsigned int nTxIndex;
+    TxidEntry(int nHeightIn, unsigned int nTxIndexIn) : prefix(DB_ADDRESSINDEX_TXID), nHeight(nHeightIn), nTxIndex(nTxIndexIn) {}
+
+    template<typename Stream>
+    void Serialize(Stream &s, int nType, int nVersion) const {
+        s << prefix;
+        ser_writedata32be(s, nHeight);
+        WriteOrderedInt(s, nTxIndex);
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion) {
+        s >> prefix;
+        nHeight = ser_readdata32be(s);
+        nTxIndex = ReadOrderedInt(s);
+    }
+};
+
+// Version 2 entries store the absolute amount, its sign follows from the spending flag
+void WriteCompactAddressIndex(CDBBatch& batch, const CAddressIndexKey& key, CAmount nValue)
+{
+    uint64_t nAmount = key.spending ? -nValue : nValue;
+    batch.Write(CompactAddressIndexEntry(&key), VARINT(nAmount));
+    batch.Write(TxidEntry(key.blockHeight, key.txindex), key.txhash);
+}
+
+void EraseAddressIndexEntry(CDBBatch& batch, const CAddressIndexKey& key)
+{
+    batch.Erase(make_pair(DB_ADDRESSINDEX, key));
+    batch.Erase(CompactAddressIndexEntry(&key));
+    batch.Erase(TxidEntry(key.blockHeight, key.txindex));
+}
+
+/**
+ * Decode the address index entry at pcursor if it is one of prefix's format.
+ * The txid of compact entries is left null.
+ */
+bool GetAddressIndexEntry(CDBIterator* pcursor, char prefix, CAddressIndexKey& key, CAmount& nValue)
+{
+    if (!pcursor->Valid())
+        return false;
+    if (prefix == DB_ADDRESSINDEX) {
+        std::pair<char, CAddressIndexKey> entry;
+        if (!pcursor->GetKey(entry) || entry.first != DB_ADDRESSINDEX)
+            return false;
+        key = entry.second;
+        if (!pcursor->GetValue(nValue))
+            throw std::runtime_error("failed to get address index value");
+    } else {
+        CompactAddressIndexEntry entry(&key);
+        if (!pcursor->GetKey(entry) || entry.prefix != DB_ADDRESSINDEX_COMPACT)
+            return false;
+        uint64_t nAmount;
+        CVarInt<uint64_t> value = WrapVarInt(nAmount);
+        if (!pcursor->GetValue(value))
+            throw std::runtime_error("failed to get address index value");
+        nValue = key.spending ? -(CAmount)nAmount : (CAmount)nAmount;
+    }
+    return true;
+}
+
+// The order of both formats, the txid is the same for equal positions
+bool AddressIndexEntryLess(const std::pair<CAddressIndexKey, CAmount>& a, const std::pair<CAddressIndexKey, CAmount>& b)
+{
+    if (a.first.blockHeight != b.first.blockHeight)
+        return a.first.blockHeight < b.first.blockHeight;
+    if (a.first.txindex != b.first.txindex)
+        return a.first.txindex < b.first.txindex;
+    if (a.first.index != b.first.index)
+        return a.first.index < b.first.index;
+    return a.first.spending < b.first.spending;
+}
+
 }
 
-CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe, true) 
+CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe, true), nWriteGeneration(0)
 {
 }
 
@@ -97,6 +239,7 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
         batch.Write(DB_BEST_BLOCK, hashBlock);
 
     bool ret = db.WriteBatch(batch);
+    nWriteGeneration++;
     LogPrint("coindb", "Committed %u changed transaction outputs (out of %u) to coin database...\n", (unsigned int)changed, (unsigned int)count);
     return ret;
 }
@@ -106,7 +249,9 @@ size_t CCoinsViewDB::EstimateSize() const
     return db.EstimateSize(DB_COIN, (char)(DB_COIN+1));
 }
 
-CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe) {
+CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe), fAddressIndexMigrateStarted(false) {
+    bool fCompact = false;
+    fAddressIndexMigrated = ReadFlag("addressindexcompact", fCompact) && fCompact;
 }
 
 bool CBlockTreeDB::ReadBlockFileInfo(int nFile, CBlockFileInfo &info) {
@@ -263,42 +408,97 @@ bool CBlockTreeDB::ReadAddressUnspentIndex(uint160 addressHash, int type,
 bool CBlockTreeDB::WriteAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount > >&vect) {
     CDBBatch batch(*this);
     for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
-        batch.Write(make_pair(DB_ADDRESSINDEX, it->first), it->second);
+        WriteCompactAddressIndex(batch, it->first, it->second);
     return WriteBatch(batch);
 }
 
 bool CBlockTreeDB::EraseAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount > >&vect) {
     CDBBatch batch(*this);
     for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
-        batch.Erase(make_pair(DB_ADDRESSINDEX, it->first));
+        EraseAddressIndexEntry(batch, it->first);
     return WriteBatch(batch);
 }
 
 bool CBlockTreeDB::ReadAddressIndex(uint160 addressHash, int type,
                                     std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
                                     int start, int end) {
+    CAddressIndexKey keyStart(type, addressHash, start > 0 && end > 0 ? start : 0, 0, uint256(), 0, false);
+    return ReadAddressIndexPage(keyStart, start > 0 && end > 0 ? end : 0, std::numeric_limits<size_t>::max(), addressIndex);
+}
+
+bool CBlockTreeDB::ReadAddressIndexPage(const CAddressIndexKey &keyStart, int end, size_t nLimit,
+                                        std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex) {
 
+    // One iterator reads both formats from the same snapshot, so entries
+    // being migrated are seen exactly once
     boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vEntries;
+
+    if (!fAddressIndexMigrated)
+        pcursor->Seek(make_pair(DB_ADDRESSINDEX, keyStart));
+    size_t nLegacy = 0;
+    for (char prefix : {DB_ADDRESSINDEX, DB_ADDRESSINDEX_COMPACT}) {
+        if (prefix == DB_ADDRESSINDEX_COMPACT) {
+            nLegacy = vEntries.size();
+            pcursor->Seek(CompactAddressIndexEntry(&keyStart));
+        } else if (fAddressIndexMigrated) {
+            continue;
+        }
+        while (vEntries.size() - nLegacy < nLimit) {
+            boost::this_thread::interruption_point();
+            CAddressIndexKey key;
+            CAmount nValue;
+            if (!GetAddressIndexEntry(pcursor.get(), prefix, key, nValue) || key.type != keyStart.type || key.hashBytes != keyStart.hashBytes)
+                break;
+            if (end > 0 && key.blockHeight > end)
+                break;
+            vEntries.push_back(make_pair(key, nValue));
+            pcursor->Next();
+        }
+    }
 
-    if (start > 0 && end > 0) {
-        pcursor->Seek(make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorHeightKey(type, addressHash, start)));
-    } else {
-        pcursor->Seek(make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorKey(type, addressHash)));
+    // Look up the txids of the compact entries, they are sorted so each is read once
+    for (size_t i = nLegacy; i < vEntries.size(); i++) {
+        CAddressIndexKey& key = vEntries[i].first;
+        if (i > nLegacy && key.blockHeight == vEntries[i-1].first.blockHeight && key.txindex == vEntries[i-1].first.txindex) {
+            key.txhash = vEntries[i-1].first.txhash;
+            continue;
+        }
+        TxidEntry entry(key.blockHeight, key.txindex);
+        pcursor->Seek(entry);
+        TxidEntry found(-1, 0);
+        if (!pcursor->Valid() || !pcursor->GetKey(found) || found.prefix != entry.prefix || found.nHeight != entry.nHeight ||
+            found.nTxIndex != entry.nTxIndex || !pcursor->GetValue(key.txhash))
+            return error("failed to get address index txid");
     }
 
-    while (pcursor->Valid()) {
+    // Only while the migration is running can an address have entries in both formats
+    if (nLegacy > 0 && nLegacy < vEntries.size())
+        std::stable_sort(vEntries.begin(), vEntries.end(), AddressIndexEntryLess);
+    if (vEntries.size() > nLimit)
+        vEntries.resize(nLimit);
+    addressIndex.insert(addressIndex.end(), vEntries.begin(), vEntries.end());
+
+    return true;
+}
+
+bool CBlockTreeDB::ReadAddressUnspentIndexPage(const CAddressUnspentKey &keyStart, size_t nLimit,
+                                               std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs) {
+
+    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+
+    pcursor->Seek(make_pair(DB_ADDRESSUNSPENTINDEX, keyStart));
+
+    while (pcursor->Valid() && unspentOutputs.size() < nLimit) {
         boost::this_thread::interruption_point();
-        std::pair<char,CAddressIndexKey> key;
-        if (pcursor->GetKey(key) && key.first == DB_ADDRESSINDEX && key.second.hashBytes == addressHash) {
-            if (end > 0 && key.second.blockHeight > end) {
-                break;
-            }
-            CAmount nValue;
+        std::pair<char,CAddressUnspentKey> key;
+        if (pcursor->GetKey(key) && key.first == DB_ADDRESSUNSPENTINDEX && key.second.type == keyStart.type && key.second.hashBytes == keyStart.hashBytes) {
+            CAddressUnspentValue nValue;
             if (pcursor->GetValue(nValue)) {
-                addressIndex.push_back(make_pair(key.second, nValue));
+                unspentOutputs.push_back(make_pair(key.second, nValue));
                 pcursor->Next();
             } else {
-                return error("failed to get address index value");
+                return error("failed to get address unspent value");
             }
         } else {
             break;
@@ -334,6 +534,225 @@ bool CBlockTreeDB::ReadTimestampIndex(const unsigned int &high, const unsigned i
     return true;
 }
 
+bool CBlockTreeDB::WriteIndexUpdates(const std::vector<CIndexUpdates>& vUpdates, const uint256& hashIndexed) {
+    CDBBatch batch(*this);
+    // Balances touched by this batch, read from the database as needed
+    std::map<std::pair<unsigned int, uint160>, CAddressBalanceValue> mapBalances;
+    for (std::vector<CIndexUpdates>::const_iterator it = vUpdates.begin(); it != vUpdates.end(); it++) {
+        std::set<std::pair<std::pair<unsigned int, uint160>, uint256> > setAddressTxs;
+        for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator ai = it->addressIndex.begin(); ai != it->addressIndex.end(); ai++) {
+            if (it->fEraseAddressIndex)
+                EraseAddressIndexEntry(batch, ai->first);
+            else
+                WriteCompactAddressIndex(batch, ai->first, ai->second);
+
+            std::pair<unsigned int, uint160> address(ai->first.type, ai->first.hashBytes);
+            std::map<std::pair<unsigned int, uint160>, CAddressBalanceValue>::iterator bi = mapBalances.find(address);
+            if (bi == mapBalances.end()) {
+                bi = mapBalances.insert(std::make_pair(address, CAddressBalanceValue())).first;
+                ReadAddressBalance(address.first, address.second, bi->second);
+            }
+            CAddressBalanceValue& balance = bi->second;
+            int nSign = it->fEraseAddressIndex ? -1 : 1;
+            balance.balance += nSign * ai->second;
+            if (!ai->first.spending)
+                balance.received += nSign * ai->second;
+            if (setAddressTxs.insert(std::make_pair(address, ai->first.txhash)).second)
+                balance.txCount += nSign;
+            if (!it->fEraseAddressIndex) {
+                balance.lastHeight = ai->first.blockHeight;
+            } else if (balance.lastHeight >= ai->first.blockHeight) {
+                // CIndexWriter never batches a disconnect after a connect, so
+                // the database has everything below the disconnected block
+                balance.lastHeight = ReadAddressLastHeight(address.first, address.second, ai->first.blockHeight);
+            }
+        }
+        for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator ui = it->addressUnspentIndex.begin(); ui != it->addressUnspentIndex.end(); ui++) {
+            if (ui->second.IsNull())
+                batch.Erase(make_pair(DB_ADDRESSUNSPENTINDEX, ui->first));
+            else
+                batch.Write(make_pair(DB_ADDRESSUNSPENTINDEX, ui->first), ui->second);
+        }
+        for (std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >::const_iterator si = it->spentIndex.begin(); si != it->spentIndex.end(); si++) {
+            if (si->second.IsNull())
+                batch.Erase(make_pair(DB_SPENTINDEX, si->first));
+            else
+                batch.Write(make_pair(DB_SPENTINDEX, si->first), si->second);
+        }
+        for (std::vector<CTimestampIndexKey>::const_iterator ti = it->timestampIndex.begin(); ti != it->timestampIndex.end(); ti++)
+            batch.Write(make_pair(DB_TIMESTAMPINDEX, *ti), 0);
+    }
+    for (std::map<std::pair<unsigned int, uint160>, CAddressBalanceValue>::const_iterator bi = mapBalances.begin(); bi != mapBalances.end(); bi++) {
+        if (bi->second.IsNull())
+            batch.Erase(make_pair(DB_ADDRESSBALANCEINDEX, CAddressIndexIteratorKey(bi->first.first, bi->first.second)));
+        else
+            batch.Write(make_pair(DB_ADDRESSBALANCEINDEX, CAddressIndexIteratorKey(bi->first.first, bi->first.second)), bi->second);
+    }
+    batch.Write(DB_INDEXED_BLOCK, hashIndexed);
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::ReadAddressBalance(unsigned int type, const uint160& addressHash, CAddressBalanceValue& balance) {
+    if (!Read(make_pair(DB_ADDRESSBALANCEINDEX, CAddressIndexIteratorKey(type, addressHash)), balance))
+        balance.SetNull();
+    return true;
+}
+
+int CBlockTreeDB::ReadAddressLastHeight(unsigned int type, const uint160& addressHash, int nHeight) {
+    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+    CAddressIndexKey keyStart(type, addressHash, nHeight, 0, uint256(), 0, false);
+    int nLastHeight = 0;
+
+    // The entry right before the first one at nHeight, in either format
+    for (char prefix : {DB_ADDRESSINDEX, DB_ADDRESSINDEX_COMPACT}) {
+        if (prefix == DB_ADDRESSINDEX) {
+            if (fAddressIndexMigrated)
+                continue;
+            pcursor->Seek(make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorHeightKey(type, addressHash, nHeight)));
+        } else {
+            pcursor->Seek(CompactAddressIndexEntry(&keyStart));
+        }
+        // Past the last key the entry before is the last one
+        if (pcursor->Valid())
+            pcursor->Prev();
+        else
+            pcursor->SeekToLast();
+
+        CAddressIndexKey key;
+        CAmount nValue;
+        if (GetAddressIndexEntry(pcursor.get(), prefix, key, nValue) && key.type == type && key.hashBytes == addressHash)
+            nLastHeight = std::max(nLastHeight, key.blockHeight);
+    }
+    return nLastHeight;
+}
+
+bool CBlockTreeDB::BuildAddressBalanceIndex() {
+    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+    CDBBatch batch(*this);
+
+    // Start over, a previous attempt may have been interrupted
+    pcursor->Seek(DB_ADDRESSBALANCEINDEX);
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        std::pair<char, CAddressIndexIteratorKey> key;
+        if (!pcursor->GetKey(key) || key.first != DB_ADDRESSBALANCEINDEX)
+            break;
+        batch.Erase(key);
+        pcursor->Next();
+    }
+    if (!WriteBatch(batch))
+        return false;
+    batch.Clear();
+
+    // Entries are sorted by address, then height and position in the block,
+    // so the entries of one transaction are next to each other. An address
+    // can have entries in both formats if the migration to the compact one
+    // didn't finish, but all entries of a transaction are in the same one.
+    for (char prefix : {DB_ADDRESSINDEX, DB_ADDRESSINDEX_COMPACT}) {
+        std::pair<unsigned int, uint160> address;
+        CAddressBalanceValue balance;
+        std::pair<int, unsigned int> txLast;
+
+        pcursor.reset(NewIterator());
+        pcursor->Seek(prefix);
+        while (true) {
+            boost::this_thread::interruption_point();
+            CAddressIndexKey key;
+            CAmount nValue;
+            bool fValid = GetAddressIndexEntry(pcursor.get(), prefix, key, nValue);
+            if (!balance.IsNull() && (!fValid || key.type != address.first || key.hashBytes != address.second)) {
+                batch.Write(make_pair(DB_ADDRESSBALANCEINDEX, CAddressIndexIteratorKey(address.first, address.second)), balance);
+                balance.SetNull();
+                if (batch.SizeEstimate() > 16 << 20) {
+                    if (!WriteBatch(batch))
+                        return false;
+                    batch.Clear();
+                }
+            }
+            if (!fValid)
+                break;
+
+            if (balance.IsNull()) {
+                address = std::make_pair(key.type, key.hashBytes);
+                txLast = std::make_pair(-1, 0);
+                // Add to what the other format had
+                ReadAddressBalance(address.first, address.second, balance);
+            }
+            balance.balance += nValue;
+            if (!key.spending)
+                balance.received += nValue;
+            if (std::make_pair(key.blockHeight, key.txindex) != txLast)
+                balance.txCount++;
+            txLast = std::make_pair(key.blockHeight, key.txindex);
+            balance.lastHeight = std::max(balance.lastHeight, key.blockHeight);
+            pcursor->Next();
+        }
+        if (!WriteBatch(batch))
+            return false;
+        batch.Clear();
+    }
+
+    return true;
+}
+
+bool CBlockTreeDB::MigrateAddressIndex(size_t nMaxEntries, bool& fDone) {
+    fDone = fAddressIndexMigrated;
+    if (fDone)
+        return true;
+
+    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+    CDBBatch batch(*this);
+    size_t nEntries = 0;
+    CAddressIndexKey keyLast;
+
+    // Convert whole transactions so every transaction of an address is in one format.
+    // Converted entries are erased, and new ones are only written in the compact
+    // format, so everything before the last converted entry is done. Seeking past
+    // it saves iterating over the deleted entries of all previous batches.
+    if (fAddressIndexMigrateStarted)
+        pcursor->Seek(make_pair(DB_ADDRESSINDEX, keyAddressIndexMigrated));
+    else
+        pcursor->Seek(DB_ADDRESSINDEX);
+    while (true) {
+        CAddressIndexKey key;
+        CAmount nValue;
+        if (!GetAddressIndexEntry(pcursor.get(), DB_ADDRESSINDEX, key, nValue)) {
+            fDone = true;
+            break;
+        }
+        if (nEntries >= nMaxEntries && (key.type != keyLast.type || key.hashBytes != keyLast.hashBytes ||
+                                        key.blockHeight != keyLast.blockHeight || key.txindex != keyLast.txindex))
+            break;
+        batch.Erase(make_pair(DB_ADDRESSINDEX, key));
+        WriteCompactAddressIndex(batch, key, nValue);
+        keyLast = key;
+        nEntries++;
+        pcursor->Next();
+    }
+
+    if (fDone)
+        batch.Write(std::make_pair(DB_FLAG, std::string("addressindexcompact")), '1');
+    if (!WriteBatch(batch))
+        return false;
+    if (nEntries > 0) {
+        fAddressIndexMigrateStarted = true;
+        keyAddressIndexMigrated = keyLast;
+    }
+    if (fDone) {
+        fAddressIndexMigrated = true;
+        LogPrintf("%s: the address index uses the compact format\n", __func__);
+    }
+    return true;
+}
+
+bool CBlockTreeDB::WriteIndexedBlock(const uint256& hashIndexed) {
+    return Write(DB_INDEXED_BLOCK, hashIndexed);
+}
+
+bool CBlockTreeDB::ReadIndexedBlock(uint256& hashIndexed) {
+    return Read(DB_INDEXED_BLOCK, hashIndexed);
+}
+
 bool CBlockTreeDB::WriteFlag(const std::string &name, bool fValue) {
     return Write(std::make_pair(DB_FLAG, name), fValue ? '1' : '0');
 }
@@ -359,6 +778,9 @@ bool CBlockTreeDB::LoadBlockIndexGuts(boost::function<CBlockIndex*(const uint256
         if (pcursor->GetKey(key) && key.first == DB_BLOCK_INDEX) {
             CDiskBlockIndex diskindex;
             if (pcursor->GetValue(diskindex)) {
+                // Entries are keyed by their block hash, never fall back to recomputing X11 here
+                if (diskindex.hash.IsNull())
+                    diskindex.hash = key.second;
                 // Construct block index object
                 CBlockIndex* pindexNew = insertBlockIndex(diskindex.GetBlockHash());
                 pindexNew->pprev          = insertBlockIndex(diskindex.hashPrev);
@@ -11,6 +11,7 @@
 #include "chain.h"
 #include "spentindex.h"
 
+#include <atomic>
 #include <map>
 #include <string>
 #include <utility>
@@ -71,9 +72,18 @@ class CCoinsViewDB : public CCoinsView
 {
 protected:
     CDBWrapper db;
+    //! Number of completed BatchWrite calls
+    std::atomic<uint64_t> nWriteGeneration;
 public:
     CCoinsViewDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
 
+    /**
+     * A coin read while this didn't change is still what the database holds.
+     * It is incremented after each write completes, so a reader has to get it
+     * before reading the coin.
+     */
+    uint64_t GetWriteGeneration() const { return nWriteGeneration.load(); }
+
     bool GetCoin(const COutPoint &outpoint, Coin &coin) const override;
     bool HaveCoin(const COutPoint &outpoint) const override;
     uint256 GetBestBlock() const override;
@@ -107,6 +117,20 @@ private:
     friend class CCoinsViewDB;
 };
 
+/** Changes to the address, spent and timestamp indexes made by connecting or disconnecting one block */
+struct CIndexUpdates
+{
+    //! Address index entries to write, or to erase if fEraseAddressIndex
+    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    bool fEraseAddressIndex;
+    //! Entries with a null value are erased
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > addressUnspentIndex;
+    std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > spentIndex;
+    std::vector<CTimestampIndexKey> timestampIndex;
+
+    CIndexUpdates() : fEraseAddressIndex(false) {}
+};
+
 /** Access to the block database (blocks/index/) */
 class CBlockTreeDB : public CDBWrapper
 {
@@ -115,6 +139,12 @@ public:
 private:
     CBlockTreeDB(const CBlockTreeDB&);
     void operator=(const CBlockTreeDB&);
+
+    //! Whether all address index entries are in the compact format
+    std::atomic<bool> fAddressIndexMigrated;
+    //! Last entry MigrateAddressIndex converted, the next batch starts after it
+    bool fAddressIndexMigrateStarted;
+    CAddressIndexKey keyAddressIndexMigrated;
 public:
     bool WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*> >& fileInfo, int nLastFile, const std::vector<const CBlockIndex*>& blockinfo);
     bool ReadBlockFileInfo(int nFile, CBlockFileInfo &fileinfo);
@@ -133,8 +163,26 @@ public:
     bool ReadAddressIndex(uint160 addressHash, int type,
                           std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
                           int start = 0, int end = 0);
+    //! Read up to nLimit address index entries of keyStart's address, starting at keyStart and up to height end if end > 0
+    bool ReadAddressIndexPage(const CAddressIndexKey &keyStart, int end, size_t nLimit,
+                              std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex);
+    //! Read up to nLimit unspent outputs of keyStart's address, starting at keyStart
+    bool ReadAddressUnspentIndexPage(const CAddressUnspentKey &keyStart, size_t nLimit,
+                                     std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs);
     bool WriteTimestampIndex(const CTimestampIndexKey &timestampIndex);
     bool ReadTimestampIndex(const unsigned int &high, const unsigned int &low, std::vector<uint256> &vect);
+    //! Apply vUpdates in order and mark the indexes as up to date with hashIndexed, in one batch
+    bool WriteIndexUpdates(const std::vector<CIndexUpdates>& vUpdates, const uint256& hashIndexed);
+    //! Aggregated address index entries of an address, null if it has none
+    bool ReadAddressBalance(unsigned int type, const uint160& addressHash, CAddressBalanceValue& balance);
+    //! Height of the last address index entry of an address below nHeight, 0 if there is none
+    int ReadAddressLastHeight(unsigned int type, const uint160& addressHash, int nHeight);
+    //! Compute the address balances of an address index written before they were maintained
+    bool BuildAddressBalanceIndex();
+    //! Convert up to about nMaxEntries address index entries to the compact format, fDone is set once none are left
+    bool MigrateAddressIndex(size_t nMaxEntries, bool& fDone);
+    bool WriteIndexedBlock(const uint256& hashIndexed);
+    bool ReadIndexedBlock(uint256& hashIndexed);
     bool WriteFlag(const std::string &name, bool fValue);
     bool ReadFlag(const std::string &name, bool &fValue);
     bool LoadBlockIndexGuts(boost::function<CBlockIndex*(const uint256&)> insertBlockIndex);
@@ -44,4 +44,10 @@ static const int SENDHEADERS_VERSION = 70201;
 //! DIP0001 was activated in this version
 static const int DIP0001_PROTOCOL_VERSION = 70208;
 
+//! short-id-based block download is offered (with "sendcmpct") to peers from this version on.
+//! It is negotiated rather than tied to a new PROTOCOL_VERSION: peers that don't know
+//! "sendcmpct" ignore it, and compact blocks are only used with peers that sent their own.
+//! Bumping PROTOCOL_VERSION would force every masternode to be re-activated.
+static const int SHORT_IDS_BLOCKS_VERSION = 70208;
+
 #endif // BITCOIN_VERSION_H